@@ -0,0 +1,771 @@
+// SPDX-License-Identifier: MIT
+
+// _GNU_SOURCE is needed for accept4()
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <poll.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/prctl.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/time.h>
+#include <sys/utsname.h>
+#include <sys/wait.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#include "lib/tinyjail.h"
+#include "lib/seccomp.h"
+#include "lib/utils.h"
+
+#define MAX_CONCURRENCY_LEVELS (16)
+
+// The network benchmark gives an isolated container a vEth pair of its own with these addresses. In the bridged, pooled,
+// macvlan and ipvlan modes, they come from --ip-address and --target-address instead. The container command is expected
+// to connect to the target address (passed in TINYJAIL_BENCH_TARGET) on this port and echo everything back until the connection is closed.
+#define THROUGHPUT_INSIDE_ADDRESS "10.213.0.2/30"
+#define THROUGHPUT_OUTSIDE_ADDRESS "10.213.0.1/30"
+#define THROUGHPUT_OUTSIDE_TARGET "10.213.0.1"
+#define THROUGHPUT_PORT (5201)
+#define THROUGHPUT_BUFFER_SIZE (256 * 1024)
+// Round trips per container for the latency, each with a small message like an RPC
+#define THROUGHPUT_PING_COUNT (1000)
+#define THROUGHPUT_PING_SIZE (64)
+// Bytes echoed per container for the throughput
+#define THROUGHPUT_BULK_BYTES (256L * 1024 * 1024)
+// A run fails if the container does not answer for this long, e.g. because the target address is not routed back to it
+#define THROUGHPUT_IO_TIMEOUT_MS (5000)
+// The container may not notice that the sink gave up on it, so it is killed after this long
+#define THROUGHPUT_CONTAINER_TIMEOUT_MS (60000)
+
+/// @brief The network setups the benchmark can run the containers with.
+enum benchNetworkMode {
+    BENCH_NETWORK_HOST,
+    BENCH_NETWORK_ISOLATED,
+    BENCH_NETWORK_BRIDGED,
+    BENCH_NETWORK_POOLED,
+    BENCH_NETWORK_MACVLAN,
+    BENCH_NETWORK_IPVLAN_L2,
+    BENCH_NETWORK_IPVLAN_L3,
+    BENCH_NETWORK_MODE_COUNT
+};
+
+static const char* networkModeNames[BENCH_NETWORK_MODE_COUNT] = {
+    [BENCH_NETWORK_HOST] = "host",
+    [BENCH_NETWORK_ISOLATED] = "isolated",
+    [BENCH_NETWORK_BRIDGED] = "bridged",
+    [BENCH_NETWORK_POOLED] = "pooled",
+    [BENCH_NETWORK_MACVLAN] = "macvlan",
+    [BENCH_NETWORK_IPVLAN_L2] = "ipvlan-l2",
+    [BENCH_NETWORK_IPVLAN_L3] = "ipvlan-l3",
+};
+
+struct benchArgs {
+    char* containerDir;
+    char** commandList;
+    char* bridgeName;
+    /// @brief Parent device of the macvlan and ipvlan modes
+    char* parentDevice;
+    /// @brief Container address and the address it sends to in the network benchmark, for the modes other than host and isolated
+    char* ipAddress;
+    char* targetAddress;
+    long launches;
+    long warmupLaunches;
+    int concurrencyLevels[MAX_CONCURRENCY_LEVELS];
+    int concurrencyLevelCount;
+    int networkModes[BENCH_NETWORK_MODE_COUNT];
+    /// @brief If nonzero, the cost of a system call is measured under each seccomp profile, with this many calls
+    long seccompCalls;
+    /// @brief If nonzero, network latency and throughput are measured with this many containers per configuration instead of launch latency
+    long throughputRuns;
+    /// @brief vEth tuning (see tinyjailContainerParams) of the containers in the launch benchmark and the tuned throughput configuration
+    long networkQueueCount;
+    long networkMtu;
+    long networkTxQueueLength;
+    int networkGro;
+};
+
+static const char* seccompProfileNames[TINYJAIL_SECCOMP_PROFILE_COUNT] = {
+    [TINYJAIL_SECCOMP_NONE] = "none",
+    [TINYJAIL_SECCOMP_DEFAULT] = "default",
+    [TINYJAIL_SECCOMP_STRICT] = "strict",
+};
+
+/// @brief State of the thread which exchanges traffic with one container in the network benchmark.
+struct throughputSink {
+    int listeningFd;
+    /// @brief Set once the container has exited. If no connection is pending by then, the sink gives up.
+    int launchDone;
+    /// @brief Set if all round trips and the bulk transfer completed
+    int completed;
+    /// @brief Output: the time of each round trip, THROUGHPUT_PING_COUNT entries, in nanoseconds
+    uint64_t *pingLatencies;
+    uint64_t bytes;
+    /// @brief Time the bulk transfer took, in nanoseconds
+    uint64_t duration;
+};
+
+/// @brief State shared by all worker threads of one benchmark run.
+struct benchRun {
+    struct tinyjailContainerParams containerParams;
+    long launches;
+    /// @brief Index of the next launch, taken by the worker threads with an atomic increment
+    long nextLaunch;
+    long failures;
+    /// @brief Whether the latencies are recorded. Off for the warmup round, which can have more launches than the arrays hold.
+    int record;
+    /// @brief Launch-to-exec and launch-to-exit latency of each successful launch, in nanoseconds
+    uint64_t *execLatencies;
+    uint64_t *exitLatencies;
+    long successes;
+    pthread_mutex_t lock;
+    /// @brief Error of the first failed launch, to make it easy to see why a run failed
+    char firstError[ERROR_INFO_SIZE];
+};
+
+static int parseLong(const char* input, long* output) {
+    char *endptr = NULL;
+    errno = 0;
+    *output = strtol(input, &endptr, 0);
+    if (*endptr != 0 || errno != 0 || *output < 0) {
+        return 1;
+    }
+    return 0;
+}
+
+/// @brief Parses a comma-separated list of concurrency levels, e.g. "1,4,16"
+static int parseConcurrencyLevels(char* input, struct benchArgs *parsedArgs) {
+    parsedArgs->concurrencyLevelCount = 0;
+    char* savePtr = NULL;
+    for (char* level = strtok_r(input, ",", &savePtr); level != NULL; level = strtok_r(NULL, ",", &savePtr)) {
+        long value;
+        if (parsedArgs->concurrencyLevelCount >= MAX_CONCURRENCY_LEVELS || parseLong(level, &value) != 0 || value <= 0) {
+            return 1;
+        }
+        parsedArgs->concurrencyLevels[parsedArgs->concurrencyLevelCount++] = value;
+    }
+    return parsedArgs->concurrencyLevelCount == 0;
+}
+
+/// @brief Parses a comma-separated list of network modes, e.g. "host,isolated"
+static int parseNetworkModes(char* input, struct benchArgs *parsedArgs) {
+    memset(parsedArgs->networkModes, 0, sizeof(parsedArgs->networkModes));
+    char* savePtr = NULL;
+    for (char* mode = strtok_r(input, ",", &savePtr); mode != NULL; mode = strtok_r(NULL, ",", &savePtr)) {
+        int found = 0;
+        for (int i = 0; i < BENCH_NETWORK_MODE_COUNT; i++) {
+            if (strcmp(mode, networkModeNames[i]) == 0) {
+                parsedArgs->networkModes[i] = 1;
+                found = 1;
+            }
+        }
+        if (!found) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static int parseArgs(char** argv, struct benchArgs *parsedArgs) {
+    if (*argv == NULL) {
+        return -1;
+    }
+
+    char** currentArg = argv + 1;
+    while (*currentArg != NULL) {
+        char* command = *(currentArg++);
+        if (*currentArg == NULL) {
+            return -1;
+        }
+
+        if (strcmp(command, "--") == 0) {
+            parsedArgs->commandList = currentArg;
+            break;
+        } else if (strcmp(command, "--root") == 0) {
+            parsedArgs->containerDir = *(currentArg++);
+        } else if (strcmp(command, "--launches") == 0) {
+            if (parseLong(*(currentArg++), &parsedArgs->launches) != 0 || parsedArgs->launches == 0) {
+                printf("Unable to parse --launches\n");
+                return -1;
+            }
+        } else if (strcmp(command, "--warmup") == 0) {
+            if (parseLong(*(currentArg++), &parsedArgs->warmupLaunches) != 0) {
+                printf("Unable to parse --warmup\n");
+                return -1;
+            }
+        } else if (strcmp(command, "--concurrency") == 0) {
+            if (parseConcurrencyLevels(*(currentArg++), parsedArgs) != 0) {
+                printf("Unable to parse --concurrency\n");
+                return -1;
+            }
+        } else if (strcmp(command, "--network") == 0) {
+            if (parseNetworkModes(*(currentArg++), parsedArgs) != 0) {
+                printf("Unable to parse --network\n");
+                return -1;
+            }
+        } else if (strcmp(command, "--network-bridge") == 0) {
+            parsedArgs->bridgeName = *(currentArg++);
+        } else if (strcmp(command, "--network-parent") == 0) {
+            parsedArgs->parentDevice = *(currentArg++);
+        } else if (strcmp(command, "--ip-address") == 0) {
+            parsedArgs->ipAddress = *(currentArg++);
+        } else if (strcmp(command, "--target-address") == 0) {
+            parsedArgs->targetAddress = *(currentArg++);
+        } else if (strcmp(command, "--throughput") == 0) {
+            if (parseLong(*(currentArg++), &parsedArgs->throughputRuns) != 0) {
+                printf("Unable to parse --throughput\n");
+                return -1;
+            }
+        } else if (strcmp(command, "--network-queues") == 0) {
+            if (parseLong(*(currentArg++), &parsedArgs->networkQueueCount) != 0 || parsedArgs->networkQueueCount > INT_MAX) {
+                printf("Unable to parse --network-queues\n");
+                return -1;
+            }
+        } else if (strcmp(command, "--network-mtu") == 0) {
+            if (parseLong(*(currentArg++), &parsedArgs->networkMtu) != 0 || parsedArgs->networkMtu > INT_MAX) {
+                printf("Unable to parse --network-mtu\n");
+                return -1;
+            }
+        } else if (strcmp(command, "--network-txqueuelen") == 0) {
+            if (parseLong(*(currentArg++), &parsedArgs->networkTxQueueLength) != 0 || parsedArgs->networkTxQueueLength > INT_MAX) {
+                printf("Unable to parse --network-txqueuelen\n");
+                return -1;
+            }
+        } else if (strcmp(command, "--network-gro") == 0) {
+            parsedArgs->networkGro = 1;
+        } else if (strcmp(command, "--seccomp-overhead") == 0) {
+            if (parseLong(*(currentArg++), &parsedArgs->seccompCalls) != 0) {
+                printf("Unable to parse --seccomp-overhead\n");
+                return -1;
+            }
+        } else {
+            printf("Unknown argument: %s.\n", command);
+            return -1;
+        }
+    }
+    // Measuring the seccomp overhead does not launch any containers
+    if ((parsedArgs->containerDir == NULL || parsedArgs->commandList == NULL) && parsedArgs->seccompCalls == 0) {
+        return -1;
+    }
+    if ((parsedArgs->networkModes[BENCH_NETWORK_BRIDGED] || parsedArgs->networkModes[BENCH_NETWORK_POOLED]) && parsedArgs->bridgeName == NULL) {
+        printf("The bridged and pooled network modes need --network-bridge.\n");
+        return -1;
+    }
+    int usesParentDevice = parsedArgs->networkModes[BENCH_NETWORK_MACVLAN]
+        || parsedArgs->networkModes[BENCH_NETWORK_IPVLAN_L2]
+        || parsedArgs->networkModes[BENCH_NETWORK_IPVLAN_L3];
+    if (usesParentDevice && parsedArgs->parentDevice == NULL) {
+        printf("The macvlan and ipvlan network modes need --network-parent.\n");
+        return -1;
+    }
+    if (parsedArgs->throughputRuns > 0 && (usesParentDevice || parsedArgs->networkModes[BENCH_NETWORK_BRIDGED] || parsedArgs->networkModes[BENCH_NETWORK_POOLED])
+        && (parsedArgs->ipAddress == NULL || parsedArgs->targetAddress == NULL)) {
+        printf("--throughput needs --ip-address and --target-address for network modes other than host and isolated.\n");
+        return -1;
+    }
+    return 0;
+}
+
+static void* runBenchWorker(void* arg) {
+    struct benchRun *run = arg;
+    while (__atomic_fetch_add(&run->nextLaunch, 1, __ATOMIC_RELAXED) < run->launches) {
+        struct tinyjailContainerResultEx resultEx = { .version = TINYJAIL_RESULT_EX_VERSION };
+        tinyjailLaunchContainerEx(run->containerParams, &resultEx);
+        const uint64_t *timings = resultEx.launchTimings;
+        pthread_mutex_lock(&run->lock);
+        if (resultEx.result.containerStartedStatus != 0 || timings[TINYJAIL_PHASE_EXITED] == 0) {
+            if (run->failures++ == 0) {
+                snprintf(run->firstError, sizeof(run->firstError), "%s", resultEx.result.errorInfo);
+            }
+        } else if (run->record) {
+            run->execLatencies[run->successes] = timings[TINYJAIL_PHASE_STARTED] - timings[TINYJAIL_PHASE_PREPARE_START];
+            run->exitLatencies[run->successes] = timings[TINYJAIL_PHASE_EXITED] - timings[TINYJAIL_PHASE_PREPARE_START];
+            run->successes++;
+        }
+        pthread_mutex_unlock(&run->lock);
+    }
+    return NULL;
+}
+
+static uint64_t monotonicNow(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t) now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+/// @brief Launches the given number of containers from concurrency threads.
+/// @return Wall-clock duration of the run in nanoseconds
+static uint64_t runLaunches(struct benchRun *run, int concurrency) {
+    pthread_t threads[concurrency];
+    int threadCount = 0;
+    uint64_t startTime = monotonicNow();
+    for (int i = 0; i < concurrency; i++) {
+        if (pthread_create(&threads[threadCount], NULL, runBenchWorker, run) == 0) {
+            threadCount++;
+        }
+    }
+    // If no thread could be started, run the launches on this one
+    if (threadCount == 0) {
+        runBenchWorker(run);
+    }
+    for (int i = 0; i < threadCount; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    return monotonicNow() - startTime;
+}
+
+static int compareLatencies(const void* a, const void* b) {
+    uint64_t first = *(const uint64_t*) a;
+    uint64_t second = *(const uint64_t*) b;
+    return (first > second) - (first < second);
+}
+
+/// @brief Nearest-rank percentile of a sorted array, in microseconds
+static double percentileUsec(const uint64_t *sortedLatencies, long count, int percentile) {
+    if (count == 0) {
+        return 0;
+    }
+    long rank = (count * percentile + 99) / 100;
+    return sortedLatencies[rank > 0 ? rank - 1 : 0] / 1e3;
+}
+
+static void printLatencies(const char* name, uint64_t *latencies, long count) {
+    qsort(latencies, count, sizeof(uint64_t), compareLatencies);
+    printf(
+        "\"%s\":{\"p50\":%.1f,\"p90\":%.1f,\"p99\":%.1f,\"max\":%.1f}",
+        name,
+        percentileUsec(latencies, count, 50),
+        percentileUsec(latencies, count, 90),
+        percentileUsec(latencies, count, 99),
+        percentileUsec(latencies, count, 100)
+    );
+}
+
+/// @brief Sets the network parameters of a container for one of the network modes. Pools are left to the caller.
+static void setNetworkParams(const struct benchArgs *args, int networkMode, struct tinyjailContainerParams *params) {
+    params->useHostNetwork = (networkMode == BENCH_NETWORK_HOST);
+    params->networkBridgeName = (networkMode == BENCH_NETWORK_BRIDGED || networkMode == BENCH_NETWORK_POOLED) ? args->bridgeName : NULL;
+    if (networkMode == BENCH_NETWORK_MACVLAN) {
+        params->networkMode = TINYJAIL_NETWORK_MACVLAN;
+    } else if (networkMode == BENCH_NETWORK_IPVLAN_L2) {
+        params->networkMode = TINYJAIL_NETWORK_IPVLAN_L2;
+    } else if (networkMode == BENCH_NETWORK_IPVLAN_L3) {
+        params->networkMode = TINYJAIL_NETWORK_IPVLAN_L3;
+    }
+    if (params->networkMode != TINYJAIL_NETWORK_VETH) {
+        params->networkParentDevice = args->parentDevice;
+    }
+}
+
+/// @brief Runs one benchmark configuration and prints its result as a single line of JSON.
+static int runBenchmark(const struct benchArgs *args, const char* kernelRelease, int networkMode, int concurrency) {
+    char* emptyList[] = { NULL };
+    struct benchRun run = {
+        .containerParams = {
+            .containerDir = args->containerDir,
+            .commandList = args->commandList,
+            .environment = emptyList,
+            .cgroupOptions = emptyList,
+            .uid = -1,
+            .gid = -1,
+            .networkQueueCount = args->networkQueueCount,
+            .networkMtu = args->networkMtu,
+            .networkTxQueueLength = args->networkTxQueueLength,
+            .networkGro = args->networkGro,
+        },
+        .execLatencies = calloc(args->launches, sizeof(uint64_t)),
+        .exitLatencies = calloc(args->launches, sizeof(uint64_t)),
+    };
+    if (run.execLatencies == NULL || run.exitLatencies == NULL) {
+        fprintf(stderr, "calloc() failed.\n");
+        free(run.execLatencies);
+        free(run.exitLatencies);
+        return -1;
+    }
+    setNetworkParams(args, networkMode, &run.containerParams);
+    pthread_mutex_init(&run.lock, NULL);
+    // The pooled mode is the bridged one with the network namespaces set up ahead of time, one per concurrent launch
+    if (networkMode == BENCH_NETWORK_POOLED) {
+        struct tinyjailContainerResult poolResult;
+        run.containerParams.networkPool = tinyjailCreateNetworkPool(run.containerParams, concurrency, &poolResult);
+        if (run.containerParams.networkPool == NULL) {
+            fprintf(stderr, "Could not create network pool: %s\n", poolResult.errorInfo);
+            pthread_mutex_destroy(&run.lock);
+            free(run.execLatencies);
+            free(run.exitLatencies);
+            return -1;
+        }
+    }
+
+    // Warm up caches (dentries, page cache of the rootfs, ...) without recording anything
+    run.launches = args->warmupLaunches;
+    runLaunches(&run, concurrency);
+    run.nextLaunch = 0;
+    run.failures = 0;
+    run.successes = 0;
+    run.launches = args->launches;
+    run.record = 1;
+    uint64_t duration = runLaunches(&run, concurrency);
+
+    printf(
+        "{\"kernel\":\"%s\",\"network\":\"%s\",\"concurrency\":%d,\"launches\":%ld,\"failures\":%ld,"
+        "\"duration_s\":%.3f,\"launches_per_second\":%.1f,",
+        kernelRelease, networkModeNames[networkMode], concurrency, run.launches, run.failures,
+        duration / 1e9, run.successes / (duration / 1e9)
+    );
+    printLatencies("launch_to_exec_us", run.execLatencies, run.successes);
+    printf(",");
+    printLatencies("launch_to_exit_us", run.exitLatencies, run.successes);
+    printf("}\n");
+    fflush(stdout);
+    if (run.failures > 0) {
+        fprintf(stderr, "%ld launches failed (%s mode), first error: %s\n", run.failures, networkModeNames[networkMode], run.firstError);
+    }
+
+    if (run.containerParams.networkPool != NULL) {
+        tinyjailDestroyNetworkPool(run.containerParams.networkPool);
+    }
+    pthread_mutex_destroy(&run.lock);
+    free(run.execLatencies);
+    free(run.exitLatencies);
+    return run.failures > 0 ? -1 : 0;
+}
+
+/// @brief Sends small messages to the container one at a time and times each round trip.
+static int measurePingLatencies(int connectionFd, uint64_t *latencies) {
+    char message[THROUGHPUT_PING_SIZE] = {0};
+    for (int i = 0; i < THROUGHPUT_PING_COUNT; i++) {
+        uint64_t startTime = monotonicNow();
+        if (writeAll(connectionFd, message, sizeof(message)) != 0 || readAll(connectionFd, message, sizeof(message)) != 0) {
+            return -1;
+        }
+        latencies[i] = monotonicNow() - startTime;
+    }
+    return 0;
+}
+
+/// @brief Sends THROUGHPUT_BULK_BYTES to the container and receives them back.
+/// Sending and receiving are interleaved, so that neither side blocks on a full socket buffer.
+static int measureEchoThroughput(int connectionFd, struct throughputSink *sink) {
+    if (fcntl(connectionFd, F_SETFL, O_NONBLOCK) != 0) {
+        return -1;
+    }
+    char buffer[THROUGHPUT_BUFFER_SIZE];
+    memset(buffer, 0, sizeof(buffer));
+    uint64_t bytesSent = 0;
+    uint64_t bytesReceived = 0;
+    uint64_t startTime = monotonicNow();
+    while (bytesReceived < THROUGHPUT_BULK_BYTES) {
+        struct pollfd pollFd = { .fd = connectionFd, .events = POLLIN | (bytesSent < THROUGHPUT_BULK_BYTES ? POLLOUT : 0) };
+        int ready = poll(&pollFd, 1, THROUGHPUT_IO_TIMEOUT_MS);
+        if (ready < 0 && errno == EINTR) {
+            continue;
+        }
+        if (ready <= 0) {
+            return -1;
+        }
+        if (pollFd.revents & POLLOUT) {
+            size_t chunkSize = THROUGHPUT_BULK_BYTES - bytesSent < sizeof(buffer) ? THROUGHPUT_BULK_BYTES - bytesSent : sizeof(buffer);
+            ssize_t bytesWritten = write(connectionFd, buffer, chunkSize);
+            if (bytesWritten > 0) {
+                bytesSent += bytesWritten;
+            } else if (errno != EAGAIN && errno != EINTR) {
+                return -1;
+            }
+        }
+        if (pollFd.revents & (POLLIN | POLLHUP | POLLERR)) {
+            ssize_t bytesRead = read(connectionFd, buffer, sizeof(buffer));
+            if (bytesRead > 0) {
+                bytesReceived += bytesRead;
+            } else if (bytesRead == 0 || (errno != EAGAIN && errno != EINTR)) {
+                return -1;
+            }
+        }
+    }
+    sink->duration = monotonicNow() - startTime;
+    sink->bytes = bytesReceived;
+    return 0;
+}
+
+/// @brief Accepts one connection from the container, measures round trips and then throughput over it, and closes it,
+/// which tells the container to exit.
+static void* runThroughputSink(void* arg) {
+    struct throughputSink *sink = arg;
+    struct pollfd pollFd = { .fd = sink->listeningFd, .events = POLLIN };
+    while (1) {
+        int ready = poll(&pollFd, 1, 100);
+        if (ready > 0) {
+            break;
+        }
+        if (ready == 0 && __atomic_load_n(&sink->launchDone, __ATOMIC_ACQUIRE)) {
+            return NULL;
+        }
+    }
+    RAII_FD connectionFd = accept4(sink->listeningFd, NULL, NULL, SOCK_CLOEXEC);
+    if (connectionFd < 0) {
+        return NULL;
+    }
+    int enable = 1;
+    struct timeval timeout = { .tv_sec = THROUGHPUT_IO_TIMEOUT_MS / 1000, .tv_usec = (THROUGHPUT_IO_TIMEOUT_MS % 1000) * 1000 };
+    setsockopt(connectionFd, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+    setsockopt(connectionFd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(connectionFd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+    if (measurePingLatencies(connectionFd, sink->pingLatencies) == 0 && measureEchoThroughput(connectionFd, sink) == 0) {
+        sink->completed = 1;
+    }
+    return NULL;
+}
+
+/// @brief Measures round-trip latency and throughput between the host and containers in one network mode,
+/// and prints the result as a single line of JSON.
+/// @param tuned If nonzero, vEth pairs get the tuning options, otherwise the kernel defaults
+static int runThroughputBenchmark(const struct benchArgs *args, const char* kernelRelease, int networkMode, int tuned) {
+    // Bound to any address, since the target address may only exist while a container is running
+    RAII_FD listeningFd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    int enable = 1;
+    struct sockaddr_in address = { .sin_family = AF_INET, .sin_port = htons(THROUGHPUT_PORT), .sin_addr.s_addr = htonl(INADDR_ANY) };
+    if (listeningFd < 0
+        || setsockopt(listeningFd, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable)) != 0
+        || bind(listeningFd, (struct sockaddr*) &address, sizeof(address)) != 0
+        || listen(listeningFd, 1) != 0) {
+        fprintf(stderr, "Could not listen on port %d: %s\n", THROUGHPUT_PORT, strerror(errno));
+        return -1;
+    }
+
+    const char* target = args->targetAddress;
+    char* emptyList[] = { NULL };
+    struct tinyjailContainerParams containerParams = {
+        .containerDir = args->containerDir,
+        .commandList = args->commandList,
+        .cgroupOptions = emptyList,
+        .uid = -1,
+        .gid = -1,
+        .networkIpAddr = args->ipAddress,
+        .timeoutMilliseconds = THROUGHPUT_CONTAINER_TIMEOUT_MS,
+    };
+    setNetworkParams(args, networkMode, &containerParams);
+    if (networkMode == BENCH_NETWORK_HOST) {
+        target = "127.0.0.1";
+    } else if (networkMode == BENCH_NETWORK_ISOLATED) {
+        containerParams.networkIpAddr = THROUGHPUT_INSIDE_ADDRESS;
+        containerParams.networkPeerIpAddr = THROUGHPUT_OUTSIDE_ADDRESS;
+        target = THROUGHPUT_OUTSIDE_TARGET;
+    }
+    ALLOC_LOCAL_FORMAT_STRING(targetVariable, "TINYJAIL_BENCH_TARGET=%s", target);
+    char* environment[] = { targetVariable, NULL };
+    containerParams.environment = environment;
+    if (tuned) {
+        containerParams.networkQueueCount = args->networkQueueCount;
+        containerParams.networkMtu = args->networkMtu;
+        containerParams.networkTxQueueLength = args->networkTxQueueLength;
+        containerParams.networkGro = args->networkGro;
+    }
+    // The containers run one after another, so the pool only needs one namespace
+    if (networkMode == BENCH_NETWORK_POOLED) {
+        struct tinyjailContainerResult poolResult;
+        containerParams.networkPool = tinyjailCreateNetworkPool(containerParams, 1, &poolResult);
+        if (containerParams.networkPool == NULL) {
+            fprintf(stderr, "Could not create network pool: %s\n", poolResult.errorInfo);
+            return -1;
+        }
+    }
+    uint64_t *pingLatencies = calloc(args->throughputRuns * THROUGHPUT_PING_COUNT, sizeof(uint64_t));
+    if (pingLatencies == NULL) {
+        fprintf(stderr, "calloc() failed.\n");
+        if (containerParams.networkPool != NULL) {
+            tinyjailDestroyNetworkPool(containerParams.networkPool);
+        }
+        return -1;
+    }
+
+    long successes = 0;
+    long failures = 0;
+    uint64_t totalBytes = 0;
+    uint64_t totalDuration = 0;
+    char firstError[ERROR_INFO_SIZE] = "the container did not echo the traffic";
+    for (long run = 0; run < args->throughputRuns; run++) {
+        struct throughputSink sink = { .listeningFd = listeningFd, .pingLatencies = pingLatencies + successes * THROUGHPUT_PING_COUNT };
+        pthread_t sinkThread;
+        if (pthread_create(&sinkThread, NULL, runThroughputSink, &sink) != 0) {
+            fprintf(stderr, "Could not start sink thread.\n");
+            break;
+        }
+        struct tinyjailContainerResultEx resultEx = { .version = TINYJAIL_RESULT_EX_VERSION };
+        tinyjailLaunchContainerEx(containerParams, &resultEx);
+        __atomic_store_n(&sink.launchDone, 1, __ATOMIC_RELEASE);
+        pthread_join(sinkThread, NULL);
+        if (resultEx.result.containerStartedStatus != 0 || !sink.completed) {
+            if (failures++ == 0 && resultEx.result.containerStartedStatus != 0) {
+                snprintf(firstError, sizeof(firstError), "%s", resultEx.result.errorInfo);
+            }
+            continue;
+        }
+        successes++;
+        totalBytes += sink.bytes;
+        totalDuration += sink.duration;
+    }
+    printf(
+        "{\"kernel\":\"%s\",\"network\":\"%s\",\"queues\":%d,\"mtu\":%d,\"txqueuelen\":%d,\"gro\":%d,"
+        "\"runs\":%ld,\"failures\":%ld,\"gbit_per_second\":%.3f,",
+        kernelRelease, networkModeNames[networkMode], containerParams.networkQueueCount, containerParams.networkMtu,
+        containerParams.networkTxQueueLength, containerParams.networkGro, args->throughputRuns, failures,
+        totalDuration > 0 ? totalBytes * 8.0 / totalDuration : 0.0
+    );
+    printLatencies("round_trip_us", pingLatencies, successes * THROUGHPUT_PING_COUNT);
+    printf("}\n");
+    fflush(stdout);
+    if (failures > 0) {
+        fprintf(stderr, "%ld network runs failed (%s mode), first error: %s\n", failures, networkModeNames[networkMode], firstError);
+    }
+
+    if (containerParams.networkPool != NULL) {
+        tinyjailDestroyNetworkPool(containerParams.networkPool);
+    }
+    free(pingLatencies);
+    return failures > 0 ? -1 : 0;
+}
+
+/// @brief Time per call of a system call the profiles allow, in nanoseconds. read() is one of the hot system calls
+/// which are checked first, getppid() goes through the binary search.
+struct syscallCosts {
+    double readNs;
+    double getppidNs;
+};
+
+static void measureSyscallCosts(long calls, struct syscallCosts *costs) {
+    uint64_t startTime = monotonicNow();
+    for (long i = 0; i < calls; i++) {
+        syscall(SYS_read, -1, NULL, 0);
+    }
+    costs->readNs = (double) (monotonicNow() - startTime) / calls;
+    startTime = monotonicNow();
+    for (long i = 0; i < calls; i++) {
+        syscall(SYS_getppid);
+    }
+    costs->getppidNs = (double) (monotonicNow() - startTime) / calls;
+}
+
+/// @brief Measures the cost of system calls under each seccomp profile and prints one line of JSON per profile.
+/// A filter cannot be removed again, so each profile is measured in a child process of its own.
+static int runSeccompBenchmark(const char* kernelRelease, long calls) {
+    int exitCode = 0;
+    for (int profile = 0; profile < TINYJAIL_SECCOMP_PROFILE_COUNT; profile++) {
+        struct tinyjailContainerResult result;
+        const struct sock_fprog *filter = NULL;
+        if (loadSeccompFilter(profile, &filter, &result) != 0) {
+            fprintf(stderr, "%s\n", result.errorInfo);
+            exitCode = 1;
+            continue;
+        }
+        int costPipe[2];
+        if (pipe(costPipe) != 0) {
+            fprintf(stderr, "pipe() failed: %s\n", strerror(errno));
+            return 1;
+        }
+        int childPid = fork();
+        if (childPid == 0) {
+            close(costPipe[0]);
+            struct syscallCosts costs = {0};
+            if (filter == NULL || (prctl(PR_SET_NO_NEW_PRIVS, 1, 0, 0, 0) == 0 && installSeccompFilter(filter) == 0)) {
+                measureSyscallCosts(calls, &costs);
+                write(costPipe[1], &costs, sizeof(costs));
+            }
+            _exit(0);
+        }
+        close(costPipe[1]);
+        struct syscallCosts costs;
+        ssize_t bytesRead = (childPid > 0) ? read(costPipe[0], &costs, sizeof(costs)) : -1;
+        close(costPipe[0]);
+        if (childPid > 0) {
+            waitpid(childPid, NULL, 0);
+        }
+        if (bytesRead != sizeof(costs)) {
+            fprintf(stderr, "Could not measure seccomp profile %s.\n", seccompProfileNames[profile]);
+            exitCode = 1;
+            continue;
+        }
+        printf(
+            "{\"kernel\":\"%s\",\"seccomp\":\"%s\",\"filter_instructions\":%d,\"calls\":%ld,"
+            "\"read_ns\":%.1f,\"getppid_ns\":%.1f}\n",
+            kernelRelease, seccompProfileNames[profile], filter != NULL ? filter->len : 0, calls,
+            costs.readNs, costs.getppidNs
+        );
+        fflush(stdout);
+    }
+    return exitCode;
+}
+
+int main(int argc, char** argv) {
+    struct benchArgs args = {
+        .launches = 100,
+        .warmupLaunches = 10,
+        .concurrencyLevels = { 1 },
+        .concurrencyLevelCount = 1,
+        .networkModes = { [BENCH_NETWORK_HOST] = 1, [BENCH_NETWORK_ISOLATED] = 1 },
+    };
+    if (parseArgs(argv, &args) != 0) {
+        printf(
+            "Usage: ./tinyjail-bench --root <root directory> "
+            "[--launches <launches per configuration>] "
+            "[--warmup <launches>] "
+            "[--concurrency <level>[,<level>]*] "
+            "[--network host|isolated|bridged|pooled|macvlan|ipvlan-l2|ipvlan-l3[,...]] "
+            "[--network-bridge <device name>] "
+            "[--network-parent <device name>] "
+            "[--network-queues <count>] "
+            "[--network-mtu <bytes>] "
+            "[--network-txqueuelen <packets>] "
+            "[--network-gro] "
+            "[--throughput <containers per configuration> [--ip-address <address>] [--target-address <address>]] "
+            "[--seccomp-overhead <system calls per profile>] "
+            "-- <command>\n"
+            "Prints one JSON object per configuration to stdout, latencies are in microseconds.\n"
+            "With --throughput, round-trip latency and throughput to the host are measured instead of the launch latency: the command has to\n"
+            "connect to $TINYJAIL_BENCH_TARGET on port %d and echo everything back until the connection is closed. vEth-based modes run\n"
+            "once with the default setup and once more with the --network-* tuning options, if any are given.\n"
+            "With --seccomp-overhead, the cost of a system call under each seccomp profile is printed as well (--root and the command are optional then).\n",
+            THROUGHPUT_PORT);
+        return -1;
+    }
+
+    struct utsname systemInfo;
+    const char* kernelRelease = (uname(&systemInfo) == 0) ? systemInfo.release : "unknown";
+
+    int exitCode = 0;
+    if (args.seccompCalls > 0 && runSeccompBenchmark(kernelRelease, args.seccompCalls) != 0) {
+        exitCode = 1;
+    }
+    if (args.containerDir == NULL || args.commandList == NULL) {
+        return exitCode;
+    }
+    int hasTuning = args.networkQueueCount > 0 || args.networkMtu > 0 || args.networkTxQueueLength > 0 || args.networkGro;
+    for (int networkMode = 0; networkMode < BENCH_NETWORK_MODE_COUNT; networkMode++) {
+        if (!args.networkModes[networkMode]) {
+            continue;
+        }
+        if (args.throughputRuns > 0) {
+            int usesVeth = (networkMode == BENCH_NETWORK_ISOLATED || networkMode == BENCH_NETWORK_BRIDGED || networkMode == BENCH_NETWORK_POOLED);
+            for (int tuned = 0; tuned <= (usesVeth && hasTuning); tuned++) {
+                if (runThroughputBenchmark(&args, kernelRelease, networkMode, tuned) != 0) {
+                    exitCode = 1;
+                }
+            }
+            continue;
+        }
+        for (int i = 0; i < args.concurrencyLevelCount; i++) {
+            if (runBenchmark(&args, kernelRelease, networkMode, args.concurrencyLevels[i]) != 0) {
+                exitCode = 1;
+            }
+        }
+    }
+    return exitCode;
+}
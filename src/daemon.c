@@ -0,0 +1,317 @@
+// SPDX-License-Identifier: MIT
+
+// _GNU_SOURCE is needed for accept4()
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "lib/tinyjail.h"
+#include "lib/protocol.h"
+#include "lib/utils.h"
+
+struct daemonArgs {
+    char* socketPath;
+    long workers;
+};
+
+/// @brief A client connection. It stays around until the client has disconnected and all of its containers are collected.
+struct clientConnection {
+    int fd;
+    /// @brief Held while writing a response, since responses are sent from the worker threads and the supervisor thread
+    pthread_mutex_t writeLock;
+    /// @brief One reference for the thread reading requests, plus one for each request that has not been answered yet
+    long references;
+};
+
+/// @brief A launch request on its way through the daemon: queued, launched by a worker, then supervised until it exits.
+struct launchJob {
+    struct clientConnection *connection;
+    struct daemonRequest request;
+    struct tinyjailContainerHandle *handle;
+    struct launchJob *next;
+};
+
+/// @brief Requests waiting for a worker thread, in the order they were received
+static struct launchJob *queueHead = NULL;
+static struct launchJob *queueTail = NULL;
+static pthread_mutex_t queueLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t queueNotEmpty = PTHREAD_COND_INITIALIZER;
+
+/// @brief epoll set over the FDs of all running containers, which the supervisor thread waits on
+static int supervisorEpollFd = -1;
+
+static int parseLong(const char* input, long* output) {
+    char *endptr = NULL;
+    errno = 0;
+    *output = strtol(input, &endptr, 0);
+    if (*endptr != 0 || errno != 0 || *output <= 0) {
+        return 1;
+    }
+    return 0;
+}
+
+static int parseArgs(char** argv, struct daemonArgs *parsedArgs) {
+    if (*argv == NULL) {
+        return -1;
+    }
+
+    char** currentArg = argv + 1;
+    while (*currentArg != NULL) {
+        char* command = *(currentArg++);
+        if (*currentArg == NULL) {
+            return -1;
+        }
+
+        if (strcmp(command, "--socket") == 0) {
+            parsedArgs->socketPath = *(currentArg++);
+        } else if (strcmp(command, "--workers") == 0) {
+            if (parseLong(*(currentArg++), &parsedArgs->workers) != 0) {
+                printf("Unable to parse --workers\n");
+                return -1;
+            }
+        } else {
+            printf("Unknown argument: %s.\n", command);
+            return -1;
+        }
+    }
+    if (parsedArgs->socketPath == NULL) {
+        return -1;
+    }
+    return 0;
+}
+
+static void releaseConnection(struct clientConnection *connection) {
+    if (__atomic_sub_fetch(&connection->references, 1, __ATOMIC_ACQ_REL) == 0) {
+        closep(&connection->fd);
+        pthread_mutex_destroy(&connection->writeLock);
+        free(connection);
+    }
+}
+
+/// @brief Sends the result of a job to its client and frees the job.
+static void finishJob(struct launchJob *job, const struct tinyjailContainerResultEx *resultEx) {
+    struct clientConnection *connection = job->connection;
+    pthread_mutex_lock(&connection->writeLock);
+    // If the client is gone, there is nobody to tell - the container has been collected either way
+    writeDaemonResponse(connection->fd, job->request.requestId, resultEx);
+    pthread_mutex_unlock(&connection->writeLock);
+    // The client has its own copies of the captured output now
+    if (resultEx->capturedStdout.fd >= 0) {
+        close(resultEx->capturedStdout.fd);
+    }
+    if (resultEx->capturedStderr.fd >= 0) {
+        close(resultEx->capturedStderr.fd);
+    }
+    freeDaemonRequest(&job->request);
+    free(job);
+    releaseConnection(connection);
+}
+
+static void queueJob(struct launchJob *job) {
+    pthread_mutex_lock(&queueLock);
+    job->next = NULL;
+    if (queueTail != NULL) {
+        queueTail->next = job;
+    } else {
+        queueHead = job;
+    }
+    queueTail = job;
+    pthread_cond_signal(&queueNotEmpty);
+    pthread_mutex_unlock(&queueLock);
+}
+
+static struct launchJob* dequeueJob(void) {
+    pthread_mutex_lock(&queueLock);
+    while (queueHead == NULL) {
+        pthread_cond_wait(&queueNotEmpty, &queueLock);
+    }
+    struct launchJob *job = queueHead;
+    queueHead = job->next;
+    if (queueHead == NULL) {
+        queueTail = NULL;
+    }
+    pthread_mutex_unlock(&queueLock);
+    return job;
+}
+
+/// @brief Worker thread: launches queued containers and hands them over to the supervisor thread once their command is running.
+/// This is the expensive part of a launch, so there is one worker per core by default.
+static void* runLaunchWorker(void* arg) {
+    (void) arg;
+    while (1) {
+        struct launchJob *job = dequeueJob();
+        struct tinyjailContainerResultEx resultEx = {
+            .version = TINYJAIL_RESULT_EX_VERSION,
+            .capturedStdout = { .fd = -1 },
+            .capturedStderr = { .fd = -1 }
+        };
+        job->handle = tinyjailLaunchContainerAsync(job->request.params, &resultEx.result);
+        if (job->handle == NULL) {
+            finishJob(job, &resultEx);
+            continue;
+        }
+        // The container does not need the request anymore
+        freeDaemonRequest(&job->request);
+        struct epoll_event event = { .events = EPOLLIN, .data.ptr = job };
+        if (epoll_ctl(supervisorEpollFd, EPOLL_CTL_ADD, tinyjailContainerFd(job->handle), &event) != 0) {
+            // Without supervision, the best we can do is to wait for the container here
+            tinyjailCollectEx(job->handle, &resultEx);
+            finishJob(job, &resultEx);
+        }
+    }
+    return NULL;
+}
+
+/// @brief Supervisor thread: handles the events of all running containers (e.g. deadlines), and collects them once they exit.
+static void* runSupervisor(void* arg) {
+    (void) arg;
+    struct epoll_event events[64];
+    while (1) {
+        int eventCount = epoll_wait(supervisorEpollFd, events, 64, -1);
+        for (int i = 0; i < eventCount; i++) {
+            struct launchJob *job = events[i].data.ptr;
+            if (!tinyjailHandleEvents(job->handle)) {
+                continue;
+            }
+            epoll_ctl(supervisorEpollFd, EPOLL_CTL_DEL, tinyjailContainerFd(job->handle), NULL);
+            struct tinyjailContainerResultEx resultEx = { .version = TINYJAIL_RESULT_EX_VERSION };
+            tinyjailCollectEx(job->handle, &resultEx);
+            finishJob(job, &resultEx);
+        }
+    }
+    return NULL;
+}
+
+/// @brief Connection thread: reads requests from one client and queues them, until the client disconnects.
+static void* runConnectionReader(void* arg) {
+    struct clientConnection *connection = arg;
+    while (1) {
+        struct launchJob *job = calloc(1, sizeof(struct launchJob));
+        if (job == NULL) {
+            break;
+        }
+        if (readDaemonRequest(connection->fd, &job->request) != 0) {
+            if (errno != EPIPE) {
+                fprintf(stderr, "Dropping client connection: %s\n", strerror(errno));
+            }
+            free(job);
+            break;
+        }
+        job->connection = connection;
+        __atomic_add_fetch(&connection->references, 1, __ATOMIC_ACQ_REL);
+        queueJob(job);
+    }
+    // Results of requests which are still running are sent once they exit, so only stop reading here
+    shutdown(connection->fd, SHUT_RD);
+    releaseConnection(connection);
+    return NULL;
+}
+
+/// @brief Creates the listening socket. It is only accessible by root, since anyone who can connect can launch containers.
+static int openListeningSocket(const char* socketPath) {
+    struct sockaddr_un address = { .sun_family = AF_UNIX };
+    if (strlen(socketPath) >= sizeof(address.sun_path)) {
+        fprintf(stderr, "Socket path %s is too long.\n", socketPath);
+        return -1;
+    }
+    strcpy(address.sun_path, socketPath);
+    RAII_FD listeningFd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listeningFd < 0) {
+        fprintf(stderr, "socket() failed: %s\n", strerror(errno));
+        return -1;
+    }
+    // Replace the socket of a previous daemon, if any
+    unlink(socketPath);
+    mode_t previousUmask = umask(0177);
+    int bindResult = bind(listeningFd, (struct sockaddr*) &address, sizeof(address));
+    umask(previousUmask);
+    if (bindResult != 0 || listen(listeningFd, SOMAXCONN) != 0) {
+        fprintf(stderr, "Could not listen on %s: %s\n", socketPath, strerror(errno));
+        return -1;
+    }
+    int result = listeningFd;
+    listeningFd = -1;
+    return result;
+}
+
+static int startThread(void* (*function)(void*), void* arg) {
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, function, arg) != 0) {
+        return -1;
+    }
+    pthread_detach(thread);
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    struct daemonArgs args = { .workers = sysconf(_SC_NPROCESSORS_ONLN) };
+    if (args.workers <= 0) {
+        args.workers = 1;
+    }
+    if (parseArgs(argv, &args) != 0) {
+        printf(
+            "Usage: ./tinyjaild --socket <socket path> "
+            "[--workers <number of launch threads>]\n"
+            "Launches containers for clients which connect to the socket (see tinyjailDaemonConnect()).\n");
+        return -1;
+    }
+
+    // Clients which disconnect early must not kill the daemon
+    signal(SIGPIPE, SIG_IGN);
+    // This has to happen before any other thread is started
+    struct tinyjailContainerResult result;
+    if (tinyjailInitLaunchResources(&result) != 0) {
+        fprintf(stderr, "Could not set up launch resources: %s\n", result.errorInfo);
+        return -1;
+    }
+    supervisorEpollFd = epoll_create1(EPOLL_CLOEXEC);
+    if (supervisorEpollFd < 0) {
+        fprintf(stderr, "epoll_create1() failed: %s\n", strerror(errno));
+        return -1;
+    }
+    RAII_FD listeningFd = openListeningSocket(args.socketPath);
+    if (listeningFd < 0) {
+        return -1;
+    }
+    if (startThread(runSupervisor, NULL) != 0) {
+        fprintf(stderr, "Could not start supervisor thread.\n");
+        return -1;
+    }
+    for (long i = 0; i < args.workers; i++) {
+        if (startThread(runLaunchWorker, NULL) != 0) {
+            fprintf(stderr, "Could not start worker thread.\n");
+            return -1;
+        }
+    }
+
+    while (1) {
+        int clientFd = accept4(listeningFd, NULL, NULL, SOCK_CLOEXEC);
+        if (clientFd < 0) {
+            if (errno != EINTR && errno != ECONNABORTED) {
+                fprintf(stderr, "accept() failed: %s\n", strerror(errno));
+            }
+            continue;
+        }
+        struct clientConnection *connection = calloc(1, sizeof(struct clientConnection));
+        if (connection == NULL) {
+            close(clientFd);
+            continue;
+        }
+        connection->fd = clientFd;
+        connection->references = 1;
+        pthread_mutex_init(&connection->writeLock, NULL);
+        if (startThread(runConnectionReader, connection) != 0) {
+            releaseConnection(connection);
+        }
+    }
+}
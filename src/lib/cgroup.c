@@ -1,6 +1,6 @@
 // SPDX-License-Identifier: MIT
 
-// _GNU_SOURCE is needed for the DT_DIR constant
+// _GNU_SOURCE is needed for the DT_DIR constant and the CPU_* macros
 #define _GNU_SOURCE
 
 #include "cgroup.h"
@@ -8,44 +8,57 @@
 
 #include <errno.h>
 #include <fcntl.h>
+#include <poll.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdlib.h>
 #include <string.h>
-#include <sys/mount.h>
 #include <unistd.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
 #include <sys/types.h>
 #include <dirent.h>
 
-static int configureContainerCgroup(
-    const char* cgroupfsMountPath,
-    int childPid,
-    const struct tinyjailContainerParams* containerParams,
-    struct tinyjailContainerResult *result
+/// @brief Reads a (small) cgroup interface file (or sysfs file) into a NULL-terminated buffer.
+/// @return 0 on success, -1 if the file does not exist or could not be read. The buffer is set to an empty string in that case.
+static int readCgroupFile(
+    int cgroupFd,
+    const char* filename,
+    char* buffer,
+    size_t size
 ) {
-    ALLOC_LOCAL_FORMAT_STRING(containerCgroupPath, "%s/%s", cgroupfsMountPath, containerParams->containerId);
-    RAII_FD cgroupPathFd = open(containerCgroupPath, 0);
-    if (cgroupPathFd < 0) {
-        snprintf(result->errorInfo, ERROR_INFO_SIZE, "Could not open cgroup %s: %s.", containerCgroupPath, strerror(errno));
+    buffer[0] = '\0';
+    RAII_FD fileFd = openat(cgroupFd, filename, O_RDONLY | O_CLOEXEC);
+    if (fileFd < 0) {
         return -1;
     }
-    // Set up delegation
-    if (fchownat(cgroupPathFd, ".", containerParams->uid, containerParams->gid, 0) != 0) {
-        snprintf(result->errorInfo, ERROR_INFO_SIZE, "Could not delegate container cgroup: %s", strerror(errno));
-        return -1; 
-    }
-    if (fchownat(cgroupPathFd, "cgroup.procs", containerParams->uid, containerParams->gid, 0) != 0) {
-        snprintf(result->errorInfo, ERROR_INFO_SIZE, "Could not delegate container cgroup.procs: %s", strerror(errno));
-        return -1; 
-    }
-    if (fchownat(cgroupPathFd, "cgroup.subtree_control", containerParams->uid, containerParams->gid, 0) != 0) {
-        snprintf(result->errorInfo, ERROR_INFO_SIZE, "Could not delegate container cgroup.subtree_control: %s", strerror(errno));
-        return -1; 
-    }
-    if (fchownat(cgroupPathFd, "cgroup.threads", containerParams->uid, containerParams->gid, 0) != 0) {
-        snprintf(result->errorInfo, ERROR_INFO_SIZE, "Could not delegate container cgroup.threads: %s", strerror(errno));
-        return -1; 
+    size_t totalRead = 0;
+    while (totalRead < size - 1) {
+        ssize_t bytesRead = read(fileFd, buffer + totalRead, size - 1 - totalRead);
+        if (bytesRead < 0 && errno == EINTR) {
+            continue;
+        }
+        if (bytesRead < 0) {
+            buffer[0] = '\0';
+            return -1;
+        }
+        if (bytesRead == 0) {
+            break;
+        }
+        totalRead += bytesRead;
     }
+    buffer[totalRead] = '\0';
+    return 0;
+}
 
-    // Apply cgroup configuration options
-    for (char** curOptPtr = containerParams->cgroupOptions; *curOptPtr != NULL; curOptPtr++) {
+/// @brief Writes a NULL-terminated list of "filename=value" cgroup options into a cgroup.
+static int applyCgroupOptions(
+    int cgroupPathFd,
+    char** cgroupOptions,
+    struct tinyjailContainerResult *result
+) {
+    for (char** curOptPtr = cgroupOptions; curOptPtr != NULL && *curOptPtr != NULL; curOptPtr++) {
         // Make a copy of the option and make sure it's null-terminated
         // Later on we'll replace the first "=" in this copy with a NULL.
         // The first part (before the NULL) will be the filename in the cgroup folder
@@ -69,68 +82,885 @@ static int configureContainerCgroup(
             return -1;
         }
     }
+    return 0;
+}
 
-    // Move the child process to the cgroup
-    ALLOC_LOCAL_FORMAT_STRING(childPidStr, "%d", childPid);
-    RAII_FD cgroupChildPidFd = openat(cgroupPathFd, "cgroup.procs", O_WRONLY);
-    if (cgroupChildPidFd < 0 || write(cgroupChildPidFd, childPidStr, lenchildPidStr) < lenchildPidStr) {
-        snprintf(result->errorInfo, ERROR_INFO_SIZE, "Could not move container process to cgroup: %s", strerror(errno));
-        return -1;
+static int configureContainerCgroup(
+    int cgroupPathFd,
+    const struct tinyjailContainerParams* containerParams,
+    struct tinyjailContainerResult *result
+) {
+    // Set up delegation
+    if (fchownat(cgroupPathFd, ".", containerParams->uid, containerParams->gid, 0) != 0) {
+        snprintf(result->errorInfo, ERROR_INFO_SIZE, "Could not delegate container cgroup: %s", strerror(errno));
+        return -1; 
+    }
+    if (fchownat(cgroupPathFd, "cgroup.procs", containerParams->uid, containerParams->gid, 0) != 0) {
+        snprintf(result->errorInfo, ERROR_INFO_SIZE, "Could not delegate container cgroup.procs: %s", strerror(errno));
+        return -1; 
     }
+    if (fchownat(cgroupPathFd, "cgroup.subtree_control", containerParams->uid, containerParams->gid, 0) != 0) {
+        snprintf(result->errorInfo, ERROR_INFO_SIZE, "Could not delegate container cgroup.subtree_control: %s", strerror(errno));
+        return -1; 
+    }
+    if (fchownat(cgroupPathFd, "cgroup.threads", containerParams->uid, containerParams->gid, 0) != 0) {
+        snprintf(result->errorInfo, ERROR_INFO_SIZE, "Could not delegate container cgroup.threads: %s", strerror(errno));
+        return -1; 
+    }
+
+    // Apply cgroup configuration options
+    return applyCgroupOptions(cgroupPathFd, containerParams->cgroupOptions, result);
+}
 
+/// @brief Checks whether a space-separated list of controllers (as in cgroup.controllers) contains a controller.
+static int listHasController(const char* list, const char* controller) {
+    size_t length = strlen(controller);
+    for (const char* current = strstr(list, controller); current != NULL; current = strstr(current + 1, controller)) {
+        int startsWord = (current == list || current[-1] == ' ');
+        int endsWord = (current[length] == '\0' || current[length] == ' ' || current[length] == '\n');
+        if (startsWord && endsWord) {
+            return 1;
+        }
+    }
     return 0;
 }
 
-int setupContainerCgroup(
-    int childPid,
-    const struct tinyjailContainerParams* containerParams,
+/// @brief Enables all controllers of a cgroup for its children, by writing the missing ones into its cgroup.subtree_control.
+static int enableChildControllers(
+    int cgroupPathFd,
+    const char* name,
     struct tinyjailContainerResult *result
 ) {
-    if (mount("none", containerParams->containerDir, "cgroup2", 0, NULL) != 0) {
-        snprintf(result->errorInfo, ERROR_INFO_SIZE, "Could not mount cgroupfs: %s", strerror(errno));
-        return -1;
+    char controllers[512];
+    char enabledControllers[512];
+    char request[1024];
+    readCgroupFile(cgroupPathFd, "cgroup.controllers", controllers, sizeof(controllers));
+    readCgroupFile(cgroupPathFd, "cgroup.subtree_control", enabledControllers, sizeof(enabledControllers));
+    // "cpu io memory" becomes "+cpu +io +memory", leaving out the controllers which are enabled already.
+    // An existing parent cgroup usually has all of them, and then nothing is written.
+    size_t requestLength = 0;
+    char* savePtr = NULL;
+    for (char* controller = strtok_r(controllers, " \n", &savePtr); controller != NULL; controller = strtok_r(NULL, " \n", &savePtr)) {
+        if (!listHasController(enabledControllers, controller)) {
+            requestLength += snprintf(request + requestLength, sizeof(request) - requestLength, "%s+%s", requestLength > 0 ? " " : "", controller);
+        }
     }
-    // Make sure we unmount the cgroup2 mount, otherwise the cgroup cleanup won't work
-    int configureCgroupResult = configureContainerCgroup(containerParams->containerDir, childPid, containerParams, result);
-    int umount2Result = umount2(containerParams->containerDir, MNT_DETACH);
-    int umount2Errno = errno;
-    if (configureCgroupResult != 0) {
-        return -1;
+    if (requestLength == 0) {
+        return 0;
     }
-    if (umount2Result != 0) {
-        snprintf(result->errorInfo, ERROR_INFO_SIZE, "Could not umount temporary cgroupfs mount: %s", strerror(umount2Errno));
+    RAII_FD subtreeControlFd = openat(cgroupPathFd, "cgroup.subtree_control", O_WRONLY | O_CLOEXEC);
+    if (subtreeControlFd < 0 || write(subtreeControlFd, request, requestLength) != (ssize_t) requestLength) {
+        // The kernel refuses to enable controllers for the children of a cgroup which has processes of its own (EBUSY)
+        snprintf(result->errorInfo, ERROR_INFO_SIZE, "Could not enable controllers of parent cgroup %s (it must not contain processes itself): %s", name, strerror(errno));
         return -1;
     }
-
     return 0;
 }
 
-void deleteCgroupDir(
-    const char* path
+static void deleteCgroupDir(
+    int parentFd,
+    const char* name
 ) {
     // When clearing cgroups, we should make sure to delete child cgroups first.
     // Effectively this means to recursively delete all subdirectories before this one.
     // We could use nftw() here but it traverses in the wrong order - root first, children after.
-    DIR *openedDir = opendir(path);
+    int dirFd = openat(parentFd, name, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    DIR *openedDir = (dirFd < 0) ? NULL : fdopendir(dirFd);
     if (openedDir != NULL) {
         struct dirent *entry;
         while((entry = readdir(openedDir)) != NULL) {
-            if (entry->d_type == DT_DIR) {
-                ALLOC_LOCAL_FORMAT_STRING(subdirPath, "%s/%s", path, entry->d_name);
-                deleteCgroupDir(subdirPath);
+            if (entry->d_type == DT_DIR && stringIsRegularFilename(entry->d_name)) {
+                deleteCgroupDir(dirfd(openedDir), entry->d_name);
             }
         }
+        // This also closes dirFd
         closedir(openedDir);
+    } else {
+        closep(&dirFd);
     }
-    rmdir(path);
+    unlinkat(parentFd, name, AT_REMOVEDIR);
 }
 
-void cleanContainerCgroup(
+int openParentCgroup(
+    int cgroupfsFd,
+    const struct tinyjailContainerParams* containerParams,
+    struct tinyjailContainerResult *result
+) {
+    int currentFd = openat(cgroupfsFd, ".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (currentFd < 0) {
+        snprintf(result->errorInfo, ERROR_INFO_SIZE, "Could not open cgroupfs: %s", strerror(errno));
+        return -1;
+    }
+    if (containerParams->parentCgroup == NULL) {
+        return currentFd;
+    }
+    // Concurrent launches must not see a parent cgroup which is not configured yet, so they go through here one at a time
+    RAII_FD lockFd = currentFd;
+    if (flock(lockFd, LOCK_EX) != 0) {
+        snprintf(result->errorInfo, ERROR_INFO_SIZE, "Could not lock cgroupfs: %s", strerror(errno));
+        return -1;
+    }
+    currentFd = openat(lockFd, ".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (currentFd < 0) {
+        snprintf(result->errorInfo, ERROR_INFO_SIZE, "Could not open cgroupfs: %s", strerror(errno));
+        return -1;
+    }
+    // The first cgroup created here, and the directory it is in. All cgroups below it were created here as well,
+    // so if anything fails, it is removed as a whole and the next launch does not find a half-configured path.
+    RAII_FD firstCreatedParentFd = -1;
+    const char* firstCreatedName = NULL;
+#define RETURN_AFTER_CLEANUP() { \
+        closep(&currentFd); \
+        if (firstCreatedName != NULL) { deleteCgroupDir(firstCreatedParentFd, firstCreatedName); } \
+        return -1; \
+    }
+#define RETURN_WITH_ERROR(...) { snprintf(result->errorInfo, ERROR_INFO_SIZE, __VA_ARGS__); RETURN_AFTER_CLEANUP(); }
+    ALLOC_LOCAL_FORMAT_STRING(path, "%s", containerParams->parentCgroup);
+    char* savePtr = NULL;
+    int created = 0;
+    for (char* name = strtok_r(path, "/", &savePtr); name != NULL; name = strtok_r(NULL, "/", &savePtr)) {
+        if (!stringIsRegularFilename(name)) {
+            RETURN_WITH_ERROR("Invalid parent cgroup path: %s", containerParams->parentCgroup);
+        }
+        created = (mkdirat(currentFd, name, 0755) == 0);
+        if (!created && errno != EEXIST) {
+            RETURN_WITH_ERROR("Could not create parent cgroup %s: %s", name, strerror(errno));
+        }
+        int childFd = openat(currentFd, name, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (created && firstCreatedName == NULL) {
+            firstCreatedParentFd = currentFd;
+            firstCreatedName = name;
+        } else {
+            closep(&currentFd);
+        }
+        currentFd = childFd;
+        if (currentFd < 0) {
+            RETURN_WITH_ERROR("Could not open parent cgroup %s: %s", name, strerror(errno));
+        }
+        // Every parent cgroup passes all of its controllers on, also one which existed already
+        if (enableChildControllers(currentFd, name, result) != 0) {
+            RETURN_AFTER_CLEANUP();
+        }
+    }
+    // The parent is only configured when it is created, the containers in it share its limits from then on
+    if (created && applyCgroupOptions(currentFd, containerParams->parentCgroupOptions, result) != 0) {
+        RETURN_AFTER_CLEANUP();
+    }
+    return currentFd;
+#undef RETURN_WITH_ERROR
+#undef RETURN_AFTER_CLEANUP
+}
+
+/// @brief Upper bound on the number of NUMA nodes the placement distinguishes. CPUs of further nodes are not used.
+#define MAX_NUMA_NODES (64)
+
+/// @brief The CPUs of the host, grouped by NUMA node.
+struct hostTopology {
+    int nodeCount;
+    int nodeIds[MAX_NUMA_NODES];
+    cpu_set_t nodeCpus[MAX_NUMA_NODES];
+};
+
+/// @brief Parses a list in the kernel's list format (e.g. "0-3,8-11", as in cpuset.cpus) into a set.
+/// Numbers beyond CPU_SETSIZE are ignored.
+static void parseCpuList(const char* list, cpu_set_t *set) {
+    CPU_ZERO(set);
+    const char* current = list;
+    while (*current != '\0' && *current != '\n') {
+        char* end;
+        long first = strtol(current, &end, 10);
+        long last = first;
+        if (end == current) {
+            return;
+        }
+        if (*end == '-') {
+            current = end + 1;
+            last = strtol(current, &end, 10);
+        }
+        for (long cpu = first; cpu <= last && cpu < CPU_SETSIZE; cpu++) {
+            CPU_SET(cpu, set);
+        }
+        current = (*end == ',') ? end + 1 : end;
+    }
+}
+
+/// @brief Formats a set in the kernel's list format, e.g. "0-3,8".
+static void formatCpuList(const cpu_set_t *set, char* buffer, size_t size) {
+    size_t length = 0;
+    buffer[0] = '\0';
+    for (int cpu = 0; cpu < CPU_SETSIZE && length < size; cpu++) {
+        if (!CPU_ISSET(cpu, set)) {
+            continue;
+        }
+        int last = cpu;
+        while (last + 1 < CPU_SETSIZE && CPU_ISSET(last + 1, set)) {
+            last++;
+        }
+        const char* separator = (length == 0) ? "" : ",";
+        if (last == cpu) {
+            length += snprintf(buffer + length, size - length, "%s%d", separator, cpu);
+        } else {
+            length += snprintf(buffer + length, size - length, "%s%d-%d", separator, cpu, last);
+        }
+        cpu = last;
+    }
+}
+
+/// @brief Reads the online CPUs of each NUMA node from sysfs, leaving out the CPUs the parent cgroup may not use.
+/// Hosts without NUMA support get a single node 0 with all online CPUs.
+static void readHostTopology(int parentCgroupFd, struct hostTopology *topology) {
+    char contents[4096];
+    cpu_set_t onlineCpus;
+    readCgroupFile(AT_FDCWD, "/sys/devices/system/cpu/online", contents, sizeof(contents));
+    parseCpuList(contents, &onlineCpus);
+    // E.g. a tenant's parent cgroup may be pinned to one node
+    if (readCgroupFile(parentCgroupFd, "cpuset.cpus.effective", contents, sizeof(contents)) == 0 && contents[0] != '\0') {
+        cpu_set_t parentCpus;
+        parseCpuList(contents, &parentCpus);
+        CPU_AND(&onlineCpus, &onlineCpus, &parentCpus);
+    }
+
+    topology->nodeCount = 0;
+    DIR *nodesDir = opendir("/sys/devices/system/node");
+    struct dirent *entry;
+    while (nodesDir != NULL && (entry = readdir(nodesDir)) != NULL && topology->nodeCount < MAX_NUMA_NODES) {
+        int nodeId;
+        char suffix;
+        if (sscanf(entry->d_name, "node%d%c", &nodeId, &suffix) != 1) {
+            continue;
+        }
+        ALLOC_LOCAL_FORMAT_STRING(cpuListPath, "%s/cpulist", entry->d_name);
+        if (readCgroupFile(dirfd(nodesDir), cpuListPath, contents, sizeof(contents)) != 0) {
+            continue;
+        }
+        cpu_set_t *nodeCpus = &topology->nodeCpus[topology->nodeCount];
+        parseCpuList(contents, nodeCpus);
+        CPU_AND(nodeCpus, nodeCpus, &onlineCpus);
+        // Memory-only nodes have no CPUs to place containers on
+        if (CPU_COUNT(nodeCpus) > 0) {
+            topology->nodeIds[topology->nodeCount++] = nodeId;
+        }
+    }
+    if (nodesDir != NULL) {
+        closedir(nodesDir);
+    }
+    if (topology->nodeCount == 0) {
+        topology->nodeCount = 1;
+        topology->nodeIds[0] = 0;
+        topology->nodeCpus[0] = onlineCpus;
+    }
+}
+
+/// @brief Record of the CPUs that containers are placed on, shared by all processes launching containers.
+/// Keeping our own record means a placement reads one small file instead of walking the cgroup hierarchy.
+#define CPU_ASSIGNMENTS_DIR "/run/tinyjail"
+#define CPU_ASSIGNMENTS_PATH CPU_ASSIGNMENTS_DIR "/cpu-assignments"
+
+/// @brief Number of assignments read from the record at once
+#define CPU_ASSIGNMENTS_CHUNK (64)
+
+/// @brief A slot of the CPU assignment record.
+struct cpuAssignment {
+    /// @brief ID of the container cgroup (the inode number of its directory), 0 for a free slot
+    uint64_t cgroupId;
+    /// @brief The process which launched the container and collects it. If it is gone, it never will, so the slot counts as free.
+    pid_t ownerPid;
+    cpu_set_t cpus;
+};
+
+/// @brief Opens the CPU assignment record and locks it. The lock is held until the FD is closed.
+/// @return Close-on-exec FD of the record on success, -1 on failure (errno is set)
+static int openCpuAssignments(int flags) {
+    if ((flags & O_CREAT) && mkdir(CPU_ASSIGNMENTS_DIR, 0700) != 0 && errno != EEXIST) {
+        return -1;
+    }
+    RAII_FD assignmentsFd = open(CPU_ASSIGNMENTS_PATH, O_RDWR | O_CLOEXEC | flags, 0600);
+    if (assignmentsFd < 0 || flock(assignmentsFd, LOCK_EX) != 0) {
+        return -1;
+    }
+    // Hand the FD over to the caller without the RAII cleanup closing it
+    int retval = assignmentsFd;
+    assignmentsFd = -1;
+    return retval;
+}
+
+/// @brief Reads up to CPU_ASSIGNMENTS_CHUNK slots of the record, starting at the given slot.
+/// @return Number of slots read, 0 at the end of the record, -1 on failure. A partially written slot at the end is not counted.
+static ssize_t readCpuAssignments(int assignmentsFd, off_t firstSlot, struct cpuAssignment assignments[CPU_ASSIGNMENTS_CHUNK]) {
+    ssize_t bytesRead;
+    do {
+        bytesRead = pread(assignmentsFd, assignments, CPU_ASSIGNMENTS_CHUNK * sizeof(struct cpuAssignment), firstSlot * sizeof(struct cpuAssignment));
+    } while (bytesRead < 0 && errno == EINTR);
+    return (bytesRead < 0) ? -1 : (ssize_t) (bytesRead / sizeof(struct cpuAssignment));
+}
+
+/// @brief Counts for each CPU how many containers are placed on it, no matter which parent cgroup they are in.
+/// A container's CPUs are free again once it is collected (see releaseContainerCpus()), it does not have to wait for its cgroup to be removed.
+/// @param assignmentsFd FD of the locked record (see openCpuAssignments())
+/// @param freeSlot Output: the first free slot, which is the end of the record if there is none
+/// @return 0 on success, -1 if the record could not be read
+static int countCpuUsers(int assignmentsFd, int cpuUsers[CPU_SETSIZE], off_t *freeSlot) {
+    memset(cpuUsers, 0, CPU_SETSIZE * sizeof(int));
+    *freeSlot = -1;
+    struct cpuAssignment assignments[CPU_ASSIGNMENTS_CHUNK];
+    off_t slot = 0;
+    // Usually all containers come from the same few processes, so the last owner checked is remembered
+    pid_t lastOwnerPid = 0;
+    int lastOwnerAlive = 0;
+    ssize_t count;
+    while ((count = readCpuAssignments(assignmentsFd, slot, assignments)) > 0) {
+        for (ssize_t i = 0; i < count; i++, slot++) {
+            if (assignments[i].cgroupId != 0 && assignments[i].ownerPid != lastOwnerPid) {
+                lastOwnerPid = assignments[i].ownerPid;
+                lastOwnerAlive = (kill(lastOwnerPid, 0) == 0 || errno == EPERM);
+            }
+            if (assignments[i].cgroupId == 0 || !lastOwnerAlive) {
+                *freeSlot = (*freeSlot < 0) ? slot : *freeSlot;
+                continue;
+            }
+            for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+                cpuUsers[cpu] += CPU_ISSET(cpu, &assignments[i].cpus) ? 1 : 0;
+            }
+        }
+    }
+    *freeSlot = (*freeSlot < 0) ? slot : *freeSlot;
+    return (count < 0) ? -1 : 0;
+}
+
+/// @brief Picks cpuCount CPUs for a container. If a node has enough CPUs, the CPUs are consecutive ones of a single node,
+/// choosing the node and position that is shared with the fewest other containers. Otherwise, the least used CPUs of the whole host are taken.
+/// @return 0 on success, -1 if the host does not have that many CPUs
+static int chooseContainerCpus(
+    const struct hostTopology *topology,
+    const int cpuUsers[CPU_SETSIZE],
+    long cpuCount,
+    cpu_set_t *cpus,
+    cpu_set_t *mems
+) {
+    CPU_ZERO(cpus);
+    CPU_ZERO(mems);
+    long bestUsers = -1;
+    int bestNode = -1;
+    int bestStart = -1;
+    for (int node = 0; node < topology->nodeCount; node++) {
+        int nodeCpus[CPU_SETSIZE];
+        int nodeCpuCount = 0;
+        for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+            if (CPU_ISSET(cpu, &topology->nodeCpus[node])) {
+                nodeCpus[nodeCpuCount++] = cpu;
+            }
+        }
+        // Slide a window of cpuCount CPUs over the node
+        long windowUsers = 0;
+        for (int i = 0; i < nodeCpuCount; i++) {
+            windowUsers += cpuUsers[nodeCpus[i]];
+            if (i >= cpuCount) {
+                windowUsers -= cpuUsers[nodeCpus[i - cpuCount]];
+            }
+            if (i >= cpuCount - 1 && (bestUsers < 0 || windowUsers < bestUsers)) {
+                bestUsers = windowUsers;
+                bestNode = node;
+                bestStart = nodeCpus[i - cpuCount + 1];
+            }
+        }
+    }
+    if (bestNode >= 0) {
+        long chosen = 0;
+        for (int cpu = bestStart; chosen < cpuCount; cpu++) {
+            if (CPU_ISSET(cpu, &topology->nodeCpus[bestNode])) {
+                CPU_SET(cpu, cpus);
+                chosen++;
+            }
+        }
+        CPU_SET(topology->nodeIds[bestNode], mems);
+        return 0;
+    }
+
+    // No node is big enough: take the least used CPUs, and allow memory on all of their nodes
+    for (long chosen = 0; chosen < cpuCount; chosen++) {
+        int bestCpu = -1;
+        int bestCpuNode = -1;
+        for (int node = 0; node < topology->nodeCount; node++) {
+            for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+                if (CPU_ISSET(cpu, &topology->nodeCpus[node]) && !CPU_ISSET(cpu, cpus)
+                        && (bestCpu < 0 || cpuUsers[cpu] < cpuUsers[bestCpu])) {
+                    bestCpu = cpu;
+                    bestCpuNode = node;
+                }
+            }
+        }
+        if (bestCpu < 0) {
+            return -1;
+        }
+        CPU_SET(bestCpu, cpus);
+        CPU_SET(topology->nodeIds[bestCpuNode], mems);
+    }
+    return 0;
+}
+
+/// @brief Pins the container cgroup to cpuCount CPUs and the memory of their NUMA node, and adds them to the CPU assignment record.
+/// Launches from any number of processes are serialized with the lock on the record, so that they see each other's choices,
+/// no matter which parent cgroup their containers are in. The owner of an assignment is identified by its PID,
+/// so all processes sharing the record should be in the same PID namespace.
+static int placeContainerCpus(
+    int cgroupfsFd,
+    int cgroupPathFd,
+    const struct tinyjailContainerParams* containerParams,
+    struct tinyjailContainerResult *result
+) {
+    // Every open() has its own lock, so threads of the library caller exclude each other too
+    RAII_FD assignmentsFd = openCpuAssignments(O_CREAT);
+    if (assignmentsFd < 0) {
+        snprintf(result->errorInfo, ERROR_INFO_SIZE, "Could not lock %s for CPU placement: %s", CPU_ASSIGNMENTS_PATH, strerror(errno));
+        return -1;
+    }
+    struct stat cgroupStat;
+    if (fstat(cgroupPathFd, &cgroupStat) != 0) {
+        snprintf(result->errorInfo, ERROR_INFO_SIZE, "Could not stat container cgroup: %s", strerror(errno));
+        return -1;
+    }
+    RAII_FD parentCgroupFd = openat(cgroupfsFd, ".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (parentCgroupFd < 0) {
+        snprintf(result->errorInfo, ERROR_INFO_SIZE, "Could not open parent cgroup for CPU placement: %s", strerror(errno));
+        return -1;
+    }
+    // Child cgroups only get the cpuset files once the controller is enabled in their parent
+    char contents[4096];
+    readCgroupFile(parentCgroupFd, "cgroup.controllers", contents, sizeof(contents));
+    if (strstr(contents, "cpuset") == NULL) {
+        snprintf(result->errorInfo, ERROR_INFO_SIZE, "Cannot place container on CPUs, the cpuset controller is not available.");
+        return -1;
+    }
+    readCgroupFile(parentCgroupFd, "cgroup.subtree_control", contents, sizeof(contents));
+    if (strstr(contents, "cpuset") == NULL) {
+        RAII_FD subtreeControlFd = openat(parentCgroupFd, "cgroup.subtree_control", O_WRONLY | O_CLOEXEC);
+        if (subtreeControlFd < 0 || write(subtreeControlFd, "+cpuset", 7) != 7) {
+            snprintf(result->errorInfo, ERROR_INFO_SIZE, "Could not enable the cpuset controller: %s", strerror(errno));
+            return -1;
+        }
+    }
+
+    struct hostTopology topology;
+    readHostTopology(parentCgroupFd, &topology);
+    int cpuUsers[CPU_SETSIZE];
+    off_t freeSlot;
+    if (countCpuUsers(assignmentsFd, cpuUsers, &freeSlot) != 0) {
+        snprintf(result->errorInfo, ERROR_INFO_SIZE, "Could not read %s: %s", CPU_ASSIGNMENTS_PATH, strerror(errno));
+        return -1;
+    }
+    cpu_set_t cpus;
+    cpu_set_t mems;
+    if (chooseContainerCpus(&topology, cpuUsers, containerParams->cpuCount, &cpus, &mems) != 0) {
+        snprintf(result->errorInfo, ERROR_INFO_SIZE, "Cannot place container on %ld CPUs, its parent cgroup does not have that many.", containerParams->cpuCount);
+        return -1;
+    }
+
+    const char* filenames[] = { "cpuset.mems", "cpuset.cpus" };
+    const cpu_set_t *sets[] = { &mems, &cpus };
+    for (int i = 0; i < 2; i++) {
+        formatCpuList(sets[i], contents, sizeof(contents));
+        RAII_FD cpusetFd = openat(cgroupPathFd, filenames[i], O_WRONLY | O_CLOEXEC);
+        size_t length = strlen(contents);
+        if (cpusetFd < 0 || write(cpusetFd, contents, length) != (ssize_t) length) {
+            snprintf(result->errorInfo, ERROR_INFO_SIZE, "Could not write %s of container cgroup: %s", filenames[i], strerror(errno));
+            return -1;
+        }
+    }
+
+    // We run as a child of the library caller, which is the process that collects the container and releases its CPUs
+    struct cpuAssignment assignment = { .cgroupId = cgroupStat.st_ino, .ownerPid = getppid(), .cpus = cpus };
+    if (pwrite(assignmentsFd, &assignment, sizeof(assignment), freeSlot * sizeof(assignment)) != sizeof(assignment)) {
+        snprintf(result->errorInfo, ERROR_INFO_SIZE, "Could not write %s: %s", CPU_ASSIGNMENTS_PATH, strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+void releaseContainerCpus(
+    int cgroupfsFd,
+    const char* containerId
+) {
+    struct stat cgroupStat;
+    if (fstatat(cgroupfsFd, containerId, &cgroupStat, 0) != 0) {
+        return;
+    }
+    RAII_FD assignmentsFd = openCpuAssignments(0);
+    if (assignmentsFd < 0) {
+        return;
+    }
+    struct cpuAssignment assignments[CPU_ASSIGNMENTS_CHUNK];
+    off_t slot = 0;
+    ssize_t count;
+    while ((count = readCpuAssignments(assignmentsFd, slot, assignments)) > 0) {
+        for (ssize_t i = 0; i < count; i++, slot++) {
+            if (assignments[i].cgroupId == cgroupStat.st_ino) {
+                struct cpuAssignment freeAssignment = {0};
+                pwrite(assignmentsFd, &freeAssignment, sizeof(freeAssignment), slot * sizeof(freeAssignment));
+                return;
+            }
+        }
+    }
+}
+
+void discardContainerCgroup(
+    int cgroupfsFd,
     const struct tinyjailContainerParams* containerParams
 ) {
-    if (mount("none", containerParams->containerDir, "cgroup2", 0, NULL) == 0) {
-        ALLOC_LOCAL_FORMAT_STRING(cgroupPath, "%s/%s", containerParams->containerDir, containerParams->containerId);
-        deleteCgroupDir(cgroupPath);
-        umount2(containerParams->containerDir, MNT_DETACH);
+    if (containerParams->cpuCount > 0) {
+        releaseContainerCpus(cgroupfsFd, containerParams->containerId);
+    }
+    cleanContainerCgroup(cgroupfsFd, containerParams->containerId);
+}
+
+int setupContainerCgroup(
+    int cgroupfsFd,
+    const struct tinyjailContainerParams* containerParams,
+    struct tinyjailContainerResult *result
+) {
+    if (mkdirat(cgroupfsFd, containerParams->containerId, 0770) != 0) {
+        snprintf(result->errorInfo, ERROR_INFO_SIZE, "Could not create cgroup: %s.", strerror(errno));
+        return -1;
+    }
+    RAII_FD cgroupPathFd = openat(cgroupfsFd, containerParams->containerId, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (cgroupPathFd < 0) {
+        snprintf(result->errorInfo, ERROR_INFO_SIZE, "Could not open cgroup %s: %s.", containerParams->containerId, strerror(errno));
+        cleanContainerCgroup(cgroupfsFd, containerParams->containerId);
+        return -1;
+    }
+    // Placement comes first, so that cpuset options of the caller override it
+    if (containerParams->cpuCount > 0 && placeContainerCpus(cgroupfsFd, cgroupPathFd, containerParams, result) != 0) {
+        cleanContainerCgroup(cgroupfsFd, containerParams->containerId);
+        return -1;
+    }
+    if (configureContainerCgroup(cgroupPathFd, containerParams, result) != 0) {
+        discardContainerCgroup(cgroupfsFd, containerParams);
+        return -1;
+    }
+    // Hand the FD over to the caller without the RAII cleanup closing it
+    int retval = cgroupPathFd;
+    cgroupPathFd = -1;
+    return retval;
+}
+
+int moveProcessToCgroup(
+    int cgroupFd,
+    int pid,
+    struct tinyjailContainerResult *result
+) {
+    ALLOC_LOCAL_FORMAT_STRING(pidStr, "%d", pid);
+    RAII_FD cgroupProcsFd = openat(cgroupFd, "cgroup.procs", O_WRONLY | O_CLOEXEC);
+    if (cgroupProcsFd < 0 || write(cgroupProcsFd, pidStr, lenpidStr) < lenpidStr) {
+        snprintf(result->errorInfo, ERROR_INFO_SIZE, "Could not move container process to cgroup: %s", strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+/// @brief Sums up all values of a key in the contents of a cgroup interface file.
+/// Works for flat keyed files ("key value" lines, e.g. cpu.stat) and nested keyed files ("device key=value ..." lines, e.g. io.stat).
+/// @return The sum of all values of the key, 0 if the key does not appear.
+static uint64_t sumKeyedValues(
+    const char* contents,
+    const char* key
+) {
+    uint64_t sum = 0;
+    size_t keyLength = strlen(key);
+    const char* token = contents + strspn(contents, " \n");
+    while (*token != '\0') {
+        if (strncmp(token, key, keyLength) == 0 && (token[keyLength] == ' ' || token[keyLength] == '=')) {
+            sum += strtoull(token + keyLength + 1, NULL, 10);
+        }
+        token += strcspn(token, " \n");
+        token += strspn(token, " \n");
+    }
+    return sum;
+}
+
+int readContainerCgroupUsage(
+    int cgroupfsFd,
+    const char* containerId,
+    struct tinyjailContainerUsage *usage
+) {
+    memset(usage, 0, sizeof(*usage));
+    RAII_FD cgroupPathFd = (cgroupfsFd < 0) ? -1 : openat(cgroupfsFd, containerId, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (cgroupPathFd < 0) {
+        return -1;
+    }
+    // io.stat has one line per device, so it gets the most space. Everything else is a few hundred bytes at most.
+    char contents[8192];
+    // cpu.stat always exists, the throttling counters only if the cpu controller is enabled
+    if (readCgroupFile(cgroupPathFd, "cpu.stat", contents, sizeof(contents)) == 0) {
+        usage->cpuUsageUsec = sumKeyedValues(contents, "usage_usec");
+        usage->cpuUserUsec = sumKeyedValues(contents, "user_usec");
+        usage->cpuSystemUsec = sumKeyedValues(contents, "system_usec");
+        usage->cpuThrottledPeriods = sumKeyedValues(contents, "nr_throttled");
+        usage->cpuThrottledUsec = sumKeyedValues(contents, "throttled_usec");
+    }
+    if (readCgroupFile(cgroupPathFd, "memory.peak", contents, sizeof(contents)) == 0) {
+        usage->memoryPeakBytes = strtoull(contents, NULL, 10);
+    }
+    if (readCgroupFile(cgroupPathFd, "memory.events", contents, sizeof(contents)) == 0) {
+        usage->memoryOomEvents = sumKeyedValues(contents, "oom");
+        usage->memoryOomKillEvents = sumKeyedValues(contents, "oom_kill");
+    }
+    if (readCgroupFile(cgroupPathFd, "io.stat", contents, sizeof(contents)) == 0) {
+        usage->ioReadBytes = sumKeyedValues(contents, "rbytes");
+        usage->ioWriteBytes = sumKeyedValues(contents, "wbytes");
+        usage->ioReadOperations = sumKeyedValues(contents, "rios");
+        usage->ioWriteOperations = sumKeyedValues(contents, "wios");
+    }
+    if (readCgroupFile(cgroupPathFd, "pids.peak", contents, sizeof(contents)) == 0) {
+        usage->pidsPeak = strtoull(contents, NULL, 10);
+    }
+    return 0;
+}
+
+int openCgroupTelemetryFiles(
+    int cgroupfsFd,
+    const char* containerId,
+    struct cgroupTelemetryFiles *files
+) {
+    files->cpuStatFd = files->memoryCurrentFd = files->memoryStatFd = files->ioStatFd = files->pidsCurrentFd = -1;
+    RAII_FD cgroupPathFd = (cgroupfsFd < 0) ? -1 : openat(cgroupfsFd, containerId, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (cgroupPathFd < 0) {
+        return -1;
+    }
+    files->cpuStatFd = openat(cgroupPathFd, "cpu.stat", O_RDONLY | O_CLOEXEC);
+    files->memoryCurrentFd = openat(cgroupPathFd, "memory.current", O_RDONLY | O_CLOEXEC);
+    files->memoryStatFd = openat(cgroupPathFd, "memory.stat", O_RDONLY | O_CLOEXEC);
+    files->ioStatFd = openat(cgroupPathFd, "io.stat", O_RDONLY | O_CLOEXEC);
+    files->pidsCurrentFd = openat(cgroupPathFd, "pids.current", O_RDONLY | O_CLOEXEC);
+    return 0;
+}
+
+/// @brief Reads a whole cgroup file from the start into a NUL-terminated buffer.
+/// @return 0 on success, -1 if the file is not open or could not be read (the buffer is empty then)
+static int preadCgroupFile(int fileFd, char* buffer, size_t size) {
+    buffer[0] = '\0';
+    if (fileFd < 0) {
+        return -1;
+    }
+    // cgroup files are generated in one go, so a single read gets all of them if the buffer is large enough
+    ssize_t bytesRead = pread(fileFd, buffer, size - 1, 0);
+    if (bytesRead < 0) {
+        return -1;
+    }
+    buffer[bytesRead] = '\0';
+    return 0;
+}
+
+void sampleCgroupTelemetry(
+    const struct cgroupTelemetryFiles *files,
+    struct tinyjailTelemetryRecord *record
+) {
+    // memory.stat and io.stat are the largest files, at a few KB
+    char contents[8192];
+    preadCgroupFile(files->cpuStatFd, contents, sizeof(contents));
+    record->cpuUsageUsec = sumKeyedValues(contents, "usage_usec");
+    record->cpuUserUsec = sumKeyedValues(contents, "user_usec");
+    record->cpuSystemUsec = sumKeyedValues(contents, "system_usec");
+    record->cpuThrottledUsec = sumKeyedValues(contents, "throttled_usec");
+    preadCgroupFile(files->memoryCurrentFd, contents, sizeof(contents));
+    record->memoryCurrentBytes = strtoull(contents, NULL, 10);
+    preadCgroupFile(files->memoryStatFd, contents, sizeof(contents));
+    record->memoryAnonBytes = sumKeyedValues(contents, "anon");
+    record->memoryFileBytes = sumKeyedValues(contents, "file");
+    record->memoryKernelBytes = sumKeyedValues(contents, "kernel");
+    preadCgroupFile(files->ioStatFd, contents, sizeof(contents));
+    record->ioReadBytes = sumKeyedValues(contents, "rbytes");
+    record->ioWriteBytes = sumKeyedValues(contents, "wbytes");
+    record->ioReadOperations = sumKeyedValues(contents, "rios");
+    record->ioWriteOperations = sumKeyedValues(contents, "wios");
+    preadCgroupFile(files->pidsCurrentFd, contents, sizeof(contents));
+    record->pidsCurrent = strtoull(contents, NULL, 10);
+}
+
+void closeCgroupTelemetryFiles(struct cgroupTelemetryFiles *files) {
+    closep(&files->cpuStatFd);
+    closep(&files->memoryCurrentFd);
+    closep(&files->memoryStatFd);
+    closep(&files->ioStatFd);
+    closep(&files->pidsCurrentFd);
+}
+
+/// @brief Pressure files of the container cgroup, indexed by enum tinyjailPressureResource
+static const char* pressureFilenames[TINYJAIL_PRESSURE_RESOURCE_COUNT] = {
+    [TINYJAIL_PRESSURE_CPU] = "cpu.pressure",
+    [TINYJAIL_PRESSURE_MEMORY] = "memory.pressure",
+    [TINYJAIL_PRESSURE_IO] = "io.pressure",
+};
+
+int readContainerCgroupPressure(
+    int cgroupfsFd,
+    const char* containerId,
+    struct tinyjailPressureStats stats[TINYJAIL_PRESSURE_RESOURCE_COUNT]
+) {
+    memset(stats, 0, TINYJAIL_PRESSURE_RESOURCE_COUNT * sizeof(struct tinyjailPressureStats));
+    RAII_FD cgroupPathFd = (cgroupfsFd < 0) ? -1 : openat(cgroupfsFd, containerId, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (cgroupPathFd < 0) {
+        return -1;
+    }
+    int filesRead = 0;
+    for (int resource = 0; resource < TINYJAIL_PRESSURE_RESOURCE_COUNT; resource++) {
+        // One line per kind: "some avg10=0.00 avg60=0.00 avg300=0.00 total=0", then the same for "full"
+        char contents[256];
+        if (readCgroupFile(cgroupPathFd, pressureFilenames[resource], contents, sizeof(contents)) != 0) {
+            continue;
+        }
+        filesRead++;
+        char* savePtr = NULL;
+        for (char* line = strtok_r(contents, "\n", &savePtr); line != NULL; line = strtok_r(NULL, "\n", &savePtr)) {
+            struct tinyjailPressureTotals *totals = NULL;
+            if (strncmp(line, "some ", 5) == 0) {
+                totals = &stats[resource].some;
+            } else if (strncmp(line, "full ", 5) == 0) {
+                totals = &stats[resource].full;
+            } else {
+                continue;
+            }
+            unsigned long long totalUsec = 0;
+            sscanf(line + 5, "avg10=%lf avg60=%lf avg300=%lf total=%llu", &totals->avg10, &totals->avg60, &totals->avg300, &totalUsec);
+            totals->totalUsec = totalUsec;
+        }
+    }
+    return filesRead > 0 ? 0 : -1;
+}
+
+int openContainerPressureTrigger(
+    int cgroupfsFd,
+    const char* containerId,
+    int resource,
+    const struct tinyjailPressureTrigger *trigger
+) {
+    ALLOC_LOCAL_FORMAT_STRING(filePath, "%s/%s", containerId, pressureFilenames[resource]);
+    RAII_FD triggerFd = openat(cgroupfsFd, filePath, O_RDWR | O_NONBLOCK | O_CLOEXEC);
+    if (triggerFd < 0) {
+        return -1;
+    }
+    // Writing "<some|full> <stall us> <window us>" turns this open file into a trigger.
+    // The default window of 2 s is the one unprivileged callers are allowed to use too.
+    long windowMicroseconds = trigger->windowMicroseconds > 0 ? trigger->windowMicroseconds : 2000000;
+    ALLOC_LOCAL_FORMAT_STRING(triggerSpec, "%s %ld %ld", trigger->full ? "full" : "some", trigger->stallMicroseconds, windowMicroseconds);
+    if (write(triggerFd, triggerSpec, lentriggerSpec + 1) < 0) {
+        return -1;
+    }
+    int result = triggerFd;
+    triggerFd = -1;
+    return result;
+}
+
+void killContainerCgroup(
+    int cgroupfsFd,
+    const char* containerId
+) {
+    ALLOC_LOCAL_FORMAT_STRING(killPath, "%s/cgroup.kill", containerId);
+    RAII_FD killFd = (cgroupfsFd < 0) ? -1 : openat(cgroupfsFd, killPath, O_WRONLY | O_CLOEXEC);
+    if (killFd >= 0) {
+        write(killFd, "1", 1);
+    }
+}
+
+int openContainerInitPidFd(
+    int cgroupFd,
+    int procfsFd,
+    struct tinyjailContainerResult *result
+) {
+    char processes[16384];
+    if (readCgroupFile(cgroupFd, "cgroup.procs", processes, sizeof(processes)) != 0) {
+        snprintf(result->errorInfo, ERROR_INFO_SIZE, "Could not read processes of container cgroup: %s", strerror(errno));
+        return -1;
+    }
+    char status[4096];
+    char* nextLine = processes;
+    while (*nextLine != '\0') {
+        char* lineEnd;
+        long pid = strtol(nextLine, &lineEnd, 10);
+        if (lineEnd == nextLine) {
+            break;
+        }
+        nextLine = (*lineEnd == '\n') ? lineEnd + 1 : lineEnd;
+        // The pidfd keeps referring to this process, even if its PID is reused while we look at it
+        RAII_FD pidFd = syscall(SYS_pidfd_open, pid, 0);
+        char statusPath[32];
+        snprintf(statusPath, sizeof(statusPath), "%ld/status", pid);
+        if (pidFd < 0 || readCgroupFile(procfsFd, statusPath, status, sizeof(status)) != 0) {
+            continue;
+        }
+        // NSpid lists the PID of the process in each PID namespace it is in, down to its own one
+        char* nsPids = strstr(status, "\nNSpid:\t");
+        char* nsPidsEnd = (nsPids != NULL) ? strchr(nsPids + 1, '\n') : NULL;
+        if (nsPidsEnd == NULL) {
+            continue;
+        }
+        *nsPidsEnd = '\0';
+        char* ownNsPid = strrchr(nsPids, '\t');
+        int isNamespaceInit = (ownNsPid != nsPids + strlen("\nNSpid:") && strcmp(ownNsPid, "\t1") == 0);
+        // If the process was still alive after we read its status, the status was really its own
+        if (isNamespaceInit && syscall(SYS_pidfd_send_signal, pidFd, 0, NULL, 0) == 0) {
+            int initPidFd = pidFd;
+            pidFd = -1;
+            return initPidFd;
+        }
+    }
+    snprintf(result->errorInfo, ERROR_INFO_SIZE, "Could not find the init process of the container.");
+    return -1;
+}
+
+int openContainerCgroupFile(
+    int cgroupfsFd,
+    const char* containerId,
+    const char* filename
+) {
+    ALLOC_LOCAL_FORMAT_STRING(filePath, "%s/%s", containerId, filename);
+    return openat(cgroupfsFd, filePath, O_RDONLY | O_CLOEXEC);
+}
+
+int readCgroupEventCounter(
+    int eventsFd,
+    const char* key,
+    uint64_t *value
+) {
+    char events[512];
+    ssize_t eventsSize = pread(eventsFd, events, sizeof(events) - 1, 0);
+    if (eventsSize < 0) {
+        return -1;
+    }
+    events[eventsSize] = '\0';
+    *value = sumKeyedValues(events, key);
+    return 0;
+}
+
+/// @brief Waits until no process is left in a cgroup or any of its descendants ("populated 0" in cgroup.events).
+/// @param cgroupFd FD of the cgroup directory
+static void waitUntilCgroupEmpty(int cgroupFd) {
+    RAII_FD eventsFd = openat(cgroupFd, "cgroup.events", O_RDONLY | O_CLOEXEC);
+    if (eventsFd < 0) {
+        return;
+    }
+    while (1) {
+        uint64_t populated;
+        if (readCgroupEventCounter(eventsFd, "populated", &populated) != 0 || populated == 0) {
+            return;
+        }
+        // The kernel signals every change of cgroup.events with POLLPRI
+        struct pollfd eventsChange = { .fd = eventsFd, .events = POLLPRI };
+        if (poll(&eventsChange, 1, -1) < 0 && errno != EINTR) {
+            return;
+        }
+    }
+}
+
+void cleanContainerCgroup(
+    int cgroupfsFd,
+    const char* containerId
+) {
+    if (cgroupfsFd < 0) {
+        return;
+    }
+    // A cgroup can only be removed once all processes in it are gone, even if they have been killed already
+    RAII_FD cgroupPathFd = openat(cgroupfsFd, containerId, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (cgroupPathFd >= 0) {
+        waitUntilCgroupEmpty(cgroupPathFd);
     }
+    deleteCgroupDir(cgroupfsFd, containerId);
 }
@@ -2,21 +2,178 @@
 
 #pragma once
 
+#include <stdint.h>
+
 #include "tinyjail.h"
 
-/// @brief Set up the container cgroup restrictions.
-/// @param childPid PID of the container process
+/// @brief Opens the cgroup which the container cgroup is created in: the cgroupfs root, or the parentCgroup of the container parameters.
+/// Missing parent cgroups are created, and the last one is configured with parentCgroupOptions (existing ones keep their configuration).
+/// All parent cgroups, existing or not, get all available controllers enabled for their children, which fails for one that contains processes.
+/// If anything fails, the parent cgroups created by this call are removed again.
+/// @param cgroupfsFd FD of the cgroupfs root directory
 /// @param containerParams Container options object
 /// @param result Result object returned to the library caller
-/// @return 0 on success, -1 on failure
+/// @return Close-on-exec FD of the parent cgroup directory on success, -1 on failure
+int openParentCgroup(
+    int cgroupfsFd,
+    const struct tinyjailContainerParams* containerParams,
+    struct tinyjailContainerResult *result
+);
+
+/// @brief Creates the container cgroup, delegates it to the container user and applies the cgroup options.
+/// This happens before the container process exists, so that it can be started directly inside the cgroup.
+/// @param cgroupfsFd FD of the cgroupfs directory which holds the container cgroup (see openParentCgroup())
+/// @param containerParams Container options object
+/// @param result Result object returned to the library caller
+/// @return Close-on-exec FD of the container cgroup directory on success, -1 on failure (the cgroup is removed again in that case)
 int setupContainerCgroup(
-    int childPid,
+    int cgroupfsFd,
     const struct tinyjailContainerParams* containerParams,
     struct tinyjailContainerResult *result
 );
 
-/// @brief Attempts to clean the container cgroup after the container has exited.
+/// @brief Releases the CPUs a container was placed on (see cpuCount in the container parameters), so that the next placements can use them.
+/// Must be called before the container cgroup is cleaned, and only for containers which were placed.
+/// @param cgroupfsFd FD of the cgroupfs directory which holds the container cgroup (see openParentCgroup())
+/// @param containerId ID of the container, which is also the name of its cgroup
+void releaseContainerCpus(
+    int cgroupfsFd,
+    const char* containerId
+);
+
+/// @brief Releases the CPUs of a container which failed to launch, and removes its cgroup (see cleanContainerCgroup()).
+/// @param cgroupfsFd FD of the cgroupfs directory which holds the container cgroup (see openParentCgroup())
 /// @param containerParams Container options object
-void cleanContainerCgroup(
+void discardContainerCgroup(
+    int cgroupfsFd,
     const struct tinyjailContainerParams* containerParams
 );
+
+/// @brief Moves a process into a cgroup. Only used when the kernel cannot start the container process inside its cgroup.
+/// @param cgroupFd FD of the cgroup directory
+/// @param pid PID of the process
+/// @param result Result object returned to the library caller
+/// @return 0 on success, -1 on failure
+int moveProcessToCgroup(
+    int cgroupFd,
+    int pid,
+    struct tinyjailContainerResult *result
+);
+
+/// @brief Reads the resource usage counters of the container cgroup. Must be called before the cgroup is cleaned.
+/// @param cgroupfsFd FD of the cgroupfs directory which holds the container cgroup (see openParentCgroup())
+/// @param containerId ID of the container, which is also the name of its cgroup
+/// @param usage Output: the resource usage. Counters which could not be read are set to 0.
+/// @return 0 on success, -1 if the container cgroup could not be opened
+int readContainerCgroupUsage(
+    int cgroupfsFd,
+    const char* containerId,
+    struct tinyjailContainerUsage *usage
+);
+
+/// @brief Reads the pressure stall information of the container cgroup. Must be called before the cgroup is cleaned.
+/// @param cgroupfsFd FD of the cgroupfs directory which holds the container cgroup (see openParentCgroup())
+/// @param containerId ID of the container, which is also the name of its cgroup
+/// @param stats Output: the pressure of each resource, indexed by enum tinyjailPressureResource. Values which could not be read are set to 0.
+/// @return 0 on success, -1 if no pressure file could be read (e.g. the kernel has no PSI support)
+int readContainerCgroupPressure(
+    int cgroupfsFd,
+    const char* containerId,
+    struct tinyjailPressureStats stats[TINYJAIL_PRESSURE_RESOURCE_COUNT]
+);
+
+/// @brief Registers a PSI trigger on a pressure file of the container cgroup.
+/// The trigger stays active as long as the FD is open, and signals EPOLLPRI whenever it fires (EPOLLERR once the cgroup is gone).
+/// @param cgroupfsFd FD of the cgroupfs directory which holds the container cgroup (see openParentCgroup())
+/// @param containerId ID of the container, which is also the name of its cgroup
+/// @param resource The enum tinyjailPressureResource of the pressure file
+/// @param trigger The trigger
+/// @return Close-on-exec FD of the trigger on success, -1 on failure (errno is set)
+int openContainerPressureTrigger(
+    int cgroupfsFd,
+    const char* containerId,
+    int resource,
+    const struct tinyjailPressureTrigger *trigger
+);
+
+/// @brief Files of the container cgroup which telemetry samples are read from. They are opened once, so a sample is a few pread() calls.
+struct cgroupTelemetryFiles {
+    /// @brief FDs of cpu.stat, memory.current, memory.stat, io.stat and pids.current, -1 for files which do not exist
+    int cpuStatFd;
+    int memoryCurrentFd;
+    int memoryStatFd;
+    int ioStatFd;
+    int pidsCurrentFd;
+};
+
+/// @brief Opens the files of the container cgroup which telemetry samples are read from.
+/// Files of controllers which are not enabled for the container cgroup are left at -1.
+/// @param cgroupfsFd FD of the cgroupfs directory which holds the container cgroup (see openParentCgroup())
+/// @param containerId ID of the container, which is also the name of its cgroup
+/// @param files Output: the files, to be closed with closeCgroupTelemetryFiles()
+/// @return 0 on success, -1 if the container cgroup could not be opened
+int openCgroupTelemetryFiles(
+    int cgroupfsFd,
+    const char* containerId,
+    struct cgroupTelemetryFiles *files
+);
+
+/// @brief Reads the counters of a telemetry record from the container cgroup. The other fields of the record are left alone.
+void sampleCgroupTelemetry(
+    const struct cgroupTelemetryFiles *files,
+    struct tinyjailTelemetryRecord *record
+);
+
+void closeCgroupTelemetryFiles(struct cgroupTelemetryFiles *files);
+
+/// @brief Finds the init process of a running container among the processes in its cgroup: the one which is PID 1 in its own PID namespace.
+/// @param cgroupFd FD of the container cgroup directory
+/// @param procfsFd FD of the root directory of a procfs mount
+/// @param result Result object returned to the library caller
+/// @return Close-on-exec pidfd of the container init process on success, -1 on failure
+int openContainerInitPidFd(
+    int cgroupFd,
+    int procfsFd,
+    struct tinyjailContainerResult *result
+);
+
+/// @brief Opens a file in the container cgroup for reading, e.g. to watch cgroup.events for changes.
+/// @param cgroupfsFd FD of the cgroupfs directory which holds the container cgroup (see openParentCgroup())
+/// @param containerId ID of the container, which is also the name of its cgroup
+/// @param filename Name of the cgroup interface file
+/// @return Close-on-exec FD of the file on success, -1 on failure
+int openContainerCgroupFile(
+    int cgroupfsFd,
+    const char* containerId,
+    const char* filename
+);
+
+/// @brief Reads a key of an events file (e.g. "populated" in cgroup.events or "oom_kill" in memory.events).
+/// The file is read from the beginning, which also re-arms the POLLPRI notification for the next change.
+/// @param eventsFd FD of the events file
+/// @param key The key to read
+/// @param value Output: the value of the key, 0 if it does not appear
+/// @return 0 on success, -1 on failure
+int readCgroupEventCounter(
+    int eventsFd,
+    const char* key,
+    uint64_t *value
+);
+
+/// @brief Kills all processes in the container cgroup and its descendants at once, using cgroup.kill (since Linux 5.14).
+/// It does not wait for the processes to exit. Does nothing on kernels without cgroup.kill.
+/// @param cgroupfsFd FD of the cgroupfs directory which holds the container cgroup (see openParentCgroup())
+/// @param containerId ID of the container, which is also the name of its cgroup
+void killContainerCgroup(
+    int cgroupfsFd,
+    const char* containerId
+);
+
+/// @brief Attempts to clean the container cgroup after the container has exited.
+/// Waits until the processes in the cgroup are gone, then removes the cgroup and its descendants.
+/// @param cgroupfsFd FD of the cgroupfs directory which holds the container cgroup (see openParentCgroup())
+/// @param containerId ID of the container, which is also the name of its cgroup
+void cleanContainerCgroup(
+    int cgroupfsFd,
+    const char* containerId
+);
@@ -5,142 +5,414 @@
 
 #include <errno.h>
 #include <fcntl.h>
+#include <poll.h>
 #include <sched.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
 #include <sys/mount.h>
 #include <sys/prctl.h>
 #include <sys/stat.h>
 #include <sys/syscall.h>
+#include <sys/uio.h>
 #include <sys/wait.h>
+#include <time.h>
 #include <unistd.h>
 
 #include "tinyjail.h"
+#include "launcher.h"
 #include "utils.h"
 #include "cgroup.h"
+#include "mounts.h"
 #include "network.h"
+#include "rootfs.h"
+#include "seccomp.h"
 #include "userns.h"
 
+// Stack of the container process until its execve(). It only needs a few KB.
+#define CONTAINER_INIT_STACK_SIZE (64 * 1024)
+
+/// @brief Arguments of the container process. They live in its init memory (see allocateContainerInitArgs()), together with the stack
+/// and the strings they point to, since the container process shares the memory of the library caller, who may free anything else in the meantime.
 struct ContainerInitArgs {
-    const struct tinyjailContainerParams *containerParams;
+    // The whole mapping (guard page, stack, then this struct and the strings, then the thread pointer page), and the memory of the command received by the child
+    void* mapping;
+    size_t mappingSize;
+    // Thread pointer of the container process. With the one of the library caller, libc would use its TLS (errno, stack protector canary, ...)
+    void* threadPointer;
+    void* commandMemory;
+    size_t commandMemorySize;
+    // Copies of the parameters which the child needs. workDir can be NULL.
+    const char* containerDir;
+    const char* workDir;
+    const char* hostname;
     // Pipe used by the parent to signal to the child that its namespaces are initialized and it may execve() now.
     int syncPipeWrite;
     int syncPipeRead;
     // Pipe used by the child to send error messages to the parent.
     int errorPipeWrite;
     int errorPipeRead;
+    // FDs which become stdout and stderr of the container, -1 to keep the inherited ones.
+    int outputFds[2];
+    // Syscall filter of the container command, or NULL. It was compiled by the library caller, the child only installs it.
+    const struct sock_fprog *seccompFilter;
 };
 
-/// @brief Runs the initial part of the container init process. Runs in a separate process.
+/// @brief Sends an error and its error number to the library caller over the error pipe (see childTimingRecord).
+/// It only uses rawSyscall(), so the container process can use it too.
+static void writeChildError(int errorPipeWrite, const char* message, int errorNumber) {
+    int32_t errorNumberField = errorNumber;
+    struct iovec error[2] = {
+        { .iov_base = (void*) message, .iov_len = strlen(message) + 1 },
+        { .iov_base = &errorNumberField, .iov_len = sizeof(errorNumberField) }
+    };
+    rawSyscall(SYS_writev, errorPipeWrite, (long) error, 2, 0, 0, 0);
+}
+
+/// @brief monotonicNanoseconds() for the container process, without libc where the container process shares our memory
+static uint64_t containerInitNanoseconds(void) {
+#ifdef HAVE_RAW_SYSCALL
+    struct timespec now = { 0 };
+    rawSyscall(SYS_clock_gettime, CLOCK_MONOTONIC, (long) &now, 0, 0, 0, 0);
+    return (uint64_t) now.tv_sec * 1000000000 + now.tv_nsec;
+#else
+    return monotonicNanoseconds();
+#endif
+}
+
+/// @brief Runs the initial part of the container init process. Runs in a separate process, which shares the memory of the library caller
+/// until its execve() (see spawnContainerProcess()). Apart from its own init memory and thread pointer, the library caller may free
+/// or reuse anything at any time, even the thread which prepared the container, so this only makes system calls through rawSyscall()
+/// and never touches errno, the heap or libc state.
 /// @param args Arguments for container initialization
 /// @return Nothing if it gets to execve()-ing the container entrypoint, otherwise returns -1 on failure.
 static int runContainerInit(struct ContainerInitArgs *args) {
-#define RETURN_WITH_ERROR(...) { ALLOC_LOCAL_FORMAT_STRING(error, __VA_ARGS__); write(args->errorPipeWrite, error, strlen(error)); return -1; }
+#define RETURN_WITH_ERROR(MESSAGE, ERROR) { writeChildError(args->errorPipeWrite, MESSAGE, -(ERROR)); return -1; }
+#define CHECKED_SYSCALL(MESSAGE, ...) { long error = rawSyscall(__VA_ARGS__); if (error < 0) RETURN_WITH_ERROR(MESSAGE, error); }
 
     // We won't need the writing end of the sync pipe (and in case the parent crashes, we want to avoid being stuck waiting on ourselves)
-    close(args->syncPipeWrite);
-    close(args->errorPipeRead);
+    rawSyscall(SYS_close, args->syncPipeWrite, 0, 0, 0, 0, 0);
+    rawSyscall(SYS_close, args->errorPipeRead, 0, 0, 0, 0, 0);
     
     // Wait to get a message "OK" over the sync pipe. Only if we get that are we sure that our parent has initialized everything.
+    // The message is followed by the command we should run, which is only known once a prepared container is started.
     char result[2];
-    if (read(args->syncPipeRead, result, 2) != 2 || strncmp(result, "OK", 2) != 0) {
-        RETURN_WITH_ERROR("Child could not read() on sync pipe: %s", strerror(errno));
+    long readBytes = rawSyscall(SYS_read, args->syncPipeRead, (long) result, 2, 0, 0, 0);
+    if (readBytes != 2 || strncmp(result, "OK", 2) != 0) {
+        RETURN_WITH_ERROR("Child could not read() on sync pipe", (readBytes < 0) ? readBytes : -EPIPE);
     }
-    close(args->syncPipeRead);
-
-    // Set our UID and GID.
-    if (setuid(0) != 0 || setgid(0) != 0) {
-        RETURN_WITH_ERROR("Child could not switch UID or GID: %s", strerror(errno));
+    char** commandList;
+    char** environment;
+    // The memory of the command is released by the library caller, together with the init memory
+    int commandResult = readCommand(args->syncPipeRead, &commandList, &environment, &args->commandMemory, &args->commandMemorySize);
+    if (commandResult != 0) {
+        RETURN_WITH_ERROR("Child could not read command from sync pipe", commandResult);
     }
+    rawSyscall(SYS_close, args->syncPipeRead, 0, 0, 0, 0, 0);
+    // Our timestamps are sent to the parent right before execve(), together with the result of the execve() itself
+    struct childTimingRecord timingRecord = { .magic = CHILD_TIMING_RECORD_MAGIC };
+    timingRecord.timings[TINYJAIL_PHASE_CHILD_COMMAND_RECEIVED] = containerInitNanoseconds();
+
+    // Set our UID and GID. The libc wrappers would apply them to all threads of the library caller, since we share its memory.
+    CHECKED_SYSCALL("Child could not switch UID", SYS_setuid, 0, 0, 0, 0, 0, 0);
+    CHECKED_SYSCALL("Child could not switch GID", SYS_setgid, 0, 0, 0, 0, 0, 0);
 
     // Set the container init process to be a subreaper, since most init processes expect it.
-    if (prctl(PR_SET_CHILD_SUBREAPER, 1) < 0) {
-        RETURN_WITH_ERROR("Could not set container init as subreaper: %s", strerror(errno));
-    }
+    CHECKED_SYSCALL("Could not set container init as subreaper", SYS_prctl, PR_SET_CHILD_SUBREAPER, 1, 0, 0, 0, 0);
 
     // Unshare the cgroup namespace here (after our parent has had the chance to move us to our cgroup)
-    if (unshare(CLONE_NEWCGROUP) != 0) {
-        RETURN_WITH_ERROR("Unsharing cgroup namespace in child failed: %s", strerror(errno));
-    }
+    CHECKED_SYSCALL("Unsharing cgroup namespace in child failed", SYS_unshare, CLONE_NEWCGROUP, 0, 0, 0, 0, 0);
 
     // Make sure the container root is a mountpoint
-    if (mount(args->containerParams->containerDir, args->containerParams->containerDir, "none", MS_BIND | MS_PRIVATE | MS_REC | MS_NOSUID, NULL) != 0) {
-        RETURN_WITH_ERROR("Could not bind-mount container roor dir: %s", strerror(errno));
-    }
+    CHECKED_SYSCALL("Could not bind-mount container roor dir", SYS_mount,
+        (long) args->containerDir, (long) args->containerDir, (long) "none", MS_BIND | MS_PRIVATE | MS_REC | MS_NOSUID, 0, 0);
     // Pivot to the filesystem root
-    if (chdir(args->containerParams->containerDir) != 0) {
-        RETURN_WITH_ERROR("Child could not chdir to container roor dir: %s", strerror(errno));
-    }
-    if (syscall(SYS_pivot_root, ".", ".") != 0) {
-        RETURN_WITH_ERROR("Child could not pivot_root to container roor dir: %s", strerror(errno));
-    }
-    if (umount2(".", MNT_DETACH) != 0) {
-        RETURN_WITH_ERROR("Child could not unmount old root dir: %s", strerror(errno));
-    }
+    CHECKED_SYSCALL("Child could not chdir to container roor dir", SYS_chdir, (long) args->containerDir, 0, 0, 0, 0, 0);
+    CHECKED_SYSCALL("Child could not pivot_root to container roor dir", SYS_pivot_root, (long) ".", (long) ".", 0, 0, 0, 0);
+    CHECKED_SYSCALL("Child could not unmount old root dir", SYS_umount2, (long) ".", MNT_DETACH, 0, 0, 0, 0);
+    timingRecord.timings[TINYJAIL_PHASE_CHILD_ROOT_READY] = containerInitNanoseconds();
 
     // If a working directory was set, make sure to set that before execve-ing
-    if (args->containerParams->workDir != NULL && chdir(args->containerParams->workDir) != 0) {
-        RETURN_WITH_ERROR("Child could not chdir to chosen workdir: %s", strerror(errno));
+    if (args->workDir != NULL) {
+        CHECKED_SYSCALL("Child could not chdir to chosen workdir", SYS_chdir, (long) args->workDir, 0, 0, 0, 0, 0);
     }
 
     // Set up the hostname
-    if (sethostname(args->containerParams->hostname, strlen(args->containerParams->hostname)) < 0) {
-        RETURN_WITH_ERROR("fcntl() on error pipe failed: %s", strerror(errno));
+    CHECKED_SYSCALL("Could not set hostname", SYS_sethostname, (long) args->hostname, strlen(args->hostname), 0, 0, 0, 0);
+
+    // Route the output of the container. The copies made by dup3() are not close-on-exec, the originals are.
+    // dup3() refuses to copy an FD onto itself, in that case it only has to stay open across execve().
+    for (int i = 0; i < 2; i++) {
+        if (args->outputFds[i] == STDOUT_FILENO + i) {
+            CHECKED_SYSCALL("Could not redirect container output", SYS_fcntl, args->outputFds[i], F_SETFD, 0, 0, 0, 0);
+        } else if (args->outputFds[i] >= 0) {
+            CHECKED_SYSCALL("Could not redirect container output", SYS_dup3, args->outputFds[i], STDOUT_FILENO + i, 0, 0, 0, 0);
+        }
     }
 
     // Make sure that if we successfully execve(), the errorPipeWrite is closed
-    if (fcntl(args->errorPipeWrite, F_SETFD, FD_CLOEXEC) < 0) {
-        RETURN_WITH_ERROR("fcntl() on error pipe failed: %s", strerror(errno));
+    CHECKED_SYSCALL("fcntl() on error pipe failed", SYS_fcntl, args->errorPipeWrite, F_SETFD, FD_CLOEXEC, 0, 0, 0);
+
+    // Filter system calls from here on. Everything we still do (write() and execve()) is allowed by all profiles.
+    if (args->seccompFilter != NULL) {
+        int seccompResult = installSeccompFilter(args->seccompFilter);
+        if (seccompResult != 0) {
+            RETURN_WITH_ERROR("Could not install seccomp filter", seccompResult);
+        }
     }
 
     // All good, execute the target command.
-    execve(
-        args->containerParams->commandList[0], 
-        (args->containerParams->commandList + 1), 
-        args->containerParams->environment
-    );
+    timingRecord.timings[TINYJAIL_PHASE_CHILD_EXEC] = containerInitNanoseconds();
+    rawSyscall(SYS_write, args->errorPipeWrite, (long) &timingRecord, sizeof(timingRecord), 0, 0, 0);
+    long error = rawSyscall(SYS_execve, (long) commandList[0], (long) (commandList + 1), (long) environment, 0, 0, 0);
 
     // If we got here, the execve() call failed.
-    RETURN_WITH_ERROR("execve() failed: %s", strerror(errno));
+    RETURN_WITH_ERROR("execve() failed", error);
 
+#undef CHECKED_SYSCALL
 #undef RETURN_WITH_ERROR
 }
 
-static int finishConfiguringAndAwaitContainerProcess(
+static int finishConfiguringContainerProcess(
     const struct tinyjailContainerParams *containerParams,
-    struct tinyjailContainerResult *result,
+    struct launcherReport *report,
     int childPid,
-    int syncPipeWrite,
-    int errorPipeRead
+    int procfsFd,
+    int networkReady
 ) {
-    if (setupContainerCgroup(childPid, containerParams, result) != 0) {
+    if (setupContainerUserNamespace(childPid, procfsFd, containerParams, &report->result) != 0) {
         return -1;
     }
-    if (setupContainerUserNamespace(childPid, containerParams, result) != 0) {
+    report->timings[TINYJAIL_PHASE_USER_NAMESPACE_READY] = monotonicNanoseconds();
+    // A pooled network namespace is already set up
+    if (!networkReady && setupContainerNetwork(childPid, procfsFd, containerParams, &report->result) != 0) {
         return -1;
     }
-    if (setupContainerNetwork(childPid, containerParams, result) != 0) {
+    report->timings[TINYJAIL_PHASE_NETWORK_READY] = monotonicNanoseconds();
+    // This moves us into the mount namespace of the container, so it comes last
+    if (containerParams->idmapRootfs
+        && attachIdmappedContainerRoot(childPid, procfsFd, containerParams->containerDir, &report->result) != 0) {
         return -1;
     }
-    if (write(syncPipeWrite, "OK", 2) != 2) {
-        snprintf(result->errorInfo, ERROR_INFO_SIZE, "Could not give the child the go-ahead signal: %s", strerror(errno));
-        return -1;
+    return 0;
+}
+
+/// @brief Kills the container process and waits until it is gone. It is not our child, so it is reaped by the library caller.
+static void killContainerProcess(int childPid, int childPidFd) {
+    kill(childPid, SIGKILL);
+    struct pollfd childExit = { .fd = childPidFd, .events = POLLIN };
+    while (childPidFd >= 0 && poll(&childExit, 1, -1) < 0 && errno == EINTR) {}
+}
+
+/// @brief Argument structure of the clone3() system call, see linux/sched.h.
+struct cloneArgs {
+    uint64_t flags;
+    uint64_t pidfd;
+    uint64_t childTid;
+    uint64_t parentTid;
+    uint64_t exitSignal;
+    uint64_t stack;
+    uint64_t stackSize;
+    uint64_t tls;
+    uint64_t setTid;
+    uint64_t setTidSize;
+    uint64_t cgroup;
+};
+
+#ifndef CLONE_PIDFD
+#define CLONE_PIDFD 0x00001000
+#endif
+#ifndef CLONE_INTO_CGROUP
+#define CLONE_INTO_CGROUP 0x200000000ULL
+#endif
+
+#if defined(__x86_64__) || defined(__aarch64__)
+#define HAVE_CLONE3_WITH_STACK
+/// @brief clone3() with a new stack, on which the child runs function(arg) and then exits with its return value.
+/// libc has no wrapper for this: the child of a plain syscall() would return into the caller on its new, empty stack.
+/// clone3() is system call 435 on both architectures.
+/// @return PID of the child, or -errno on failure
+long clone3WithStack(struct cloneArgs *cloneArgs, size_t size, int (*function)(void*), void* arg);
+#if defined(__x86_64__)
+__asm__(
+    ".pushsection .text\n"
+    ".globl clone3WithStack\n"
+    ".hidden clone3WithStack\n"
+    ".type clone3WithStack, @function\n"
+    "clone3WithStack:\n"
+    // The system call only clobbers rax, rcx and r11, so function and arg survive in r8 and r9
+    "    mov %rdx, %r8\n"
+    "    mov %rcx, %r9\n"
+    "    mov $435, %eax\n"
+    "    syscall\n"
+    "    test %rax, %rax\n"
+    "    jnz 1f\n"
+    "    xor %ebp, %ebp\n"
+    "    mov %r9, %rdi\n"
+    "    call *%r8\n"
+    "    mov %eax, %edi\n"
+    "    mov $60, %eax\n"
+    "    syscall\n"
+    "    hlt\n"
+    "1:  ret\n"
+    ".size clone3WithStack, .-clone3WithStack\n"
+    ".popsection\n"
+);
+#else
+__asm__(
+    ".pushsection .text\n"
+    ".globl clone3WithStack\n"
+    ".hidden clone3WithStack\n"
+    ".type clone3WithStack, %function\n"
+    "clone3WithStack:\n"
+    // All registers but x0 survive the system call, so function and arg are still in x2 and x3
+    "    mov x8, #435\n"
+    "    svc #0\n"
+    "    cbnz x0, 1f\n"
+    "    mov x29, xzr\n"
+    "    mov x30, xzr\n"
+    "    mov x0, x3\n"
+    "    blr x2\n"
+    "    mov x8, #93\n"
+    "    svc #0\n"
+    "1:  ret\n"
+    ".size clone3WithStack, .-clone3WithStack\n"
+    ".popsection\n"
+);
+#endif
+#endif
+
+/// @brief Maps the init memory of the container process: a guard page, its stack, then its arguments with copies of the strings they point to,
+/// then a page for its thread pointer.
+/// @param template The arguments, apart from the init memory fields and the strings
+/// @return The arguments in the init memory on success, NULL on failure (the error is written to result)
+static struct ContainerInitArgs* allocateContainerInitArgs(
+    const struct ContainerInitArgs *template,
+    const struct tinyjailContainerParams *containerParams,
+    struct tinyjailContainerResult *result
+) {
+    const char* strings[3] = { containerParams->containerDir, containerParams->workDir, containerParams->hostname };
+    size_t stringsSize = 0;
+    for (int i = 0; i < 3; i++) {
+        stringsSize += (strings[i] != NULL) ? strlen(strings[i]) + 1 : 0;
+    }
+    long pageSize = sysconf(_SC_PAGESIZE);
+    size_t argsSize = (sizeof(struct ContainerInitArgs) + stringsSize + pageSize - 1) / pageSize * pageSize;
+    size_t mappingSize = pageSize + CONTAINER_INIT_STACK_SIZE + argsSize + pageSize;
+    char* mapping = mmap(NULL, mappingSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_STACK, -1, 0);
+    if (mapping == MAP_FAILED) {
+        snprintf(result->errorInfo, ERROR_INFO_SIZE, "Could not map container init memory: %s", strerror(errno));
+        return NULL;
+    }
+    if (mprotect(mapping, pageSize, PROT_NONE) != 0) {
+        snprintf(result->errorInfo, ERROR_INFO_SIZE, "Could not set up container stack guard page: %s", strerror(errno));
+        munmap(mapping, mappingSize);
+        return NULL;
     }
-    if (read(errorPipeRead, result->errorInfo, ERROR_INFO_SIZE - 1) > 0) {
+    // The stack grows down from the arguments towards the guard page
+    struct ContainerInitArgs *args = (struct ContainerInitArgs*) (mapping + pageSize + CONTAINER_INIT_STACK_SIZE);
+    *args = *template;
+    args->mapping = mapping;
+    args->mappingSize = mappingSize;
+    // The thread pointer is in the middle of a zeroed page, so that what libc keeps on either side of it (see runContainerInit())
+    // stays in memory of the container process. On x86_64, it has to point to itself.
+    args->threadPointer = mapping + mappingSize - pageSize / 2;
+    *(void**) args->threadPointer = args->threadPointer;
+    args->commandMemory = NULL;
+    args->commandMemorySize = 0;
+    const char** copies[3] = { &args->containerDir, &args->workDir, &args->hostname };
+    char* nextString = (char*) (args + 1);
+    for (int i = 0; i < 3; i++) {
+        *copies[i] = NULL;
+        if (strings[i] != NULL) {
+            size_t length = strlen(strings[i]) + 1;
+            memcpy(nextString, strings[i], length);
+            *copies[i] = nextString;
+            nextString += length;
+        }
+    }
+    return args;
+}
+
+void releaseContainerInitMemory(void* containerInitMemory) {
+    struct ContainerInitArgs *args = containerInitMemory;
+    if (args == NULL) {
+        return;
+    }
+    if (args->commandMemory != NULL) {
+        munmap(args->commandMemory, args->commandMemorySize);
+    }
+    munmap(args->mapping, args->mappingSize);
+}
+
+/// @brief Starts the container process directly inside its cgroup with clone3(CLONE_INTO_CGROUP).
+/// On kernels without it (before 5.7) or architectures without clone3WithStack(), falls back to plain clone().
+/// The caller then has to open a pidfd and move the process into the cgroup itself.
+/// Either way, the container process shares our memory (which is the library caller's) until its execve(), instead of getting a copy of its page tables,
+/// so that starting it costs the same no matter how much memory the library caller has. It gets its own thread pointer (CLONE_SETTLS), since the
+/// thread of the library caller keeps running (or exits) meanwhile. Without HAVE_RAW_SYSCALL, runContainerInit() would go through libc,
+/// so the container process gets a copy of our memory instead.
+/// @param args Arguments for the container init process, in its init memory
+/// @param cloneFlags CLONE_* flags for the container process (without an exit signal)
+/// @param cgroupFd FD of the container cgroup directory
+/// @param childPidFd Output: a pidfd of the container process, or -1 if clone() was used
+/// @param result Result object returned to the library caller
+/// @return PID of the container process on success, -1 on failure
+static int spawnContainerProcess(
+    struct ContainerInitArgs *args,
+    uint64_t cloneFlags,
+    int cgroupFd,
+    int *childPidFd,
+    struct tinyjailContainerResult *result
+) {
+    // The stack ends right below the arguments
+    char* stack = (char*) args - CONTAINER_INIT_STACK_SIZE;
+#ifdef HAVE_CLONE3_WITH_STACK
+    // The exit signal must be 0 together with CLONE_PARENT, the child inherits ours (SIGCHLD) in that case.
+    struct cloneArgs cloneArgs = {
+        .flags = cloneFlags | CLONE_VM | CLONE_SETTLS | CLONE_PIDFD | CLONE_INTO_CGROUP,
+        .pidfd = (uint64_t) (uintptr_t) childPidFd,
+        .exitSignal = 0,
+        .stack = (uint64_t) (uintptr_t) stack,
+        .stackSize = CONTAINER_INIT_STACK_SIZE,
+        .tls = (uint64_t) (uintptr_t) args->threadPointer,
+        .cgroup = cgroupFd
+    };
+    long childPid = clone3WithStack(&cloneArgs, sizeof(cloneArgs), (int (*)(void *)) runContainerInit, args);
+    if (childPid > 0) {
+        return childPid;
+    }
+    if (childPid != -ENOSYS && childPid != -E2BIG) {
+        snprintf(result->errorInfo, ERROR_INFO_SIZE, "clone3() failed: %s", strerror(-childPid));
         return -1;
     }
-    if (waitpid(childPid, &(result->containerExitStatus), __WALL) < 0) {
-        snprintf(result->errorInfo, ERROR_INFO_SIZE, "waitpid() failed: %s", strerror(errno));
+#else
+    long childPid;
+#endif
+
+#ifdef HAVE_RAW_SYSCALL
+    cloneFlags |= CLONE_VM | CLONE_SETTLS;
+#endif
+    childPid = clone((int (*)(void *)) runContainerInit, stack + CONTAINER_INIT_STACK_SIZE, cloneFlags | SIGCHLD, (void*) args,
+        NULL, args->threadPointer, NULL);
+    if (childPid < 0) {
+        snprintf(result->errorInfo, ERROR_INFO_SIZE, "clone() failed: %s", strerror(errno));
         return -1;
     }
-    return 0;
+    return childPid;
 }
 
-void launchContainer(
+static int prepareContainerProcess(
     const struct tinyjailContainerParams *containerParams, 
-    struct tinyjailContainerResult *result
+    int netNsFd,
+    const int outputFds[2],
+    const struct sock_fprog *seccompFilter,
+    struct launcherReport *report,
+    int reportFds[LAUNCHER_REPORT_FD_COUNT]
 ) {
-#define RETURN_WITH_ERROR(...) result->containerStartedStatus = -1; snprintf(result->errorInfo, ERROR_INFO_SIZE, __VA_ARGS__); return;
+    struct tinyjailContainerResult *result = &report->result;
+#define RETURN_WITH_ERROR(...) { result->containerStartedStatus = -1; snprintf(result->errorInfo, ERROR_INFO_SIZE, __VA_ARGS__); return -1; }
 
     // The container launcher already sets up the mounts for the container, so it runs in its own mount namespace.
     if (unshare(CLONE_NEWNS) != 0) {
@@ -150,8 +422,15 @@ void launchContainer(
     if (mount(NULL, "/", NULL, MS_PRIVATE | MS_REC, NULL) != 0) {
         RETURN_WITH_ERROR("Could not set all mounts to private: %s", strerror(errno));
     }
+    // Assemble an overlay root if requested. The container process inherits the mount when it is cloned into its own mount namespace.
+    if (setupContainerRootfs(containerParams, result) != 0) {
+        result->containerStartedStatus = -1;
+        return -1;
+    }
+    report->timings[TINYJAIL_PHASE_MOUNT_NAMESPACE_READY] = monotonicNanoseconds();
     
-    // Set up the sync pipe for signalling the child process to begin execution, and one for passing error messages back
+    // Set up the sync pipe for signalling the child process to begin execution, and one for passing error messages back.
+    // The ends that are handed over to the library caller are close-on-exec, so they do not leak into other containers.
     int syncPipe[2] = { -1, -1 };
     int errorPipe[2] = { -1, -1 };
     int pipeSuccess = (pipe(syncPipe) == 0 && pipe(errorPipe) == 0);
@@ -162,71 +441,259 @@ void launchContainer(
     if (!pipeSuccess) {
         RETURN_WITH_ERROR("pipe() failed: %s", strerror(errno));
     }
+    if (fcntl(syncPipeWrite, F_SETFD, FD_CLOEXEC) < 0 || fcntl(errorPipeRead, F_SETFD, FD_CLOEXEC) < 0) {
+        RETURN_WITH_ERROR("fcntl() on sync or error pipe failed: %s", strerror(errno));
+    }
 
-    // Set tinyjail itself as a subreaper, so that if the container init dies, we are the ones vacuuming up leftover children.
-    if (prctl(PR_SET_CHILD_SUBREAPER, 1) < 0) {
-        RETURN_WITH_ERROR("Could not set container init as subreaper: %s", strerror(errno));
+    // Create and configure the cgroup before the child process exists, so that the child can be started directly inside it.
+    // cgroupfs and procfs are only mounted detached (never on a path), and the mounts are used for the whole launch.
+    // Long-lived callers keep both mounts around across launches (see tinyjailInitLaunchResources()).
+    // The library caller keeps the cgroupfs mount to remove the container cgroup once the container exits.
+    RAII_FD cgroupfsFd = openSharedDetachedMount("cgroup2", result);
+    if (cgroupfsFd < 0) {
+        result->containerStartedStatus = -1;
+        return -1;
+    }
+    // The container cgroup is created in the cgroupfs root or in the requested parent cgroup. Everything after this
+    // (including the cleanup by the library caller) only needs the directory which holds the container cgroup, so it takes the place of the root.
+    int parentCgroupFd = openParentCgroup(cgroupfsFd, containerParams, result);
+    closep(&cgroupfsFd);
+    if (parentCgroupFd < 0) {
+        result->containerStartedStatus = -1;
+        return -1;
+    }
+    cgroupfsFd = parentCgroupFd;
+    report->timings[TINYJAIL_PHASE_CGROUPFS_MOUNTED] = monotonicNanoseconds();
+    RAII_FD cgroupFd = setupContainerCgroup(cgroupfsFd, containerParams, result);
+    if (cgroupFd < 0) {
+        result->containerStartedStatus = -1;
+        return -1;
     }
+    report->timings[TINYJAIL_PHASE_CGROUP_READY] = monotonicNanoseconds();
+    RAII_FD procfsFd = openSharedDetachedMount("proc", result);
+    if (procfsFd < 0) {
+        discardContainerCgroup(cgroupfsFd, containerParams);
+        result->containerStartedStatus = -1;
+        return -1;
+    }
+    report->timings[TINYJAIL_PHASE_PROCFS_MOUNTED] = monotonicNanoseconds();
 
     // Start the child process and close the read end of the sync pipe (it is for the child process only)
-    // Do not unshare the cgroup namespace just yet - the subprocess will do this, after we have moved it to the right cgroup. 
-    // Passing a pointer with local vars is safe here because we fork, so the child gets a copy of the parent's memory
-    // The child will never return from this function (actually it will use another stack entirely)
-    // and so the local memory allocated until now will never be freed in the child.
-    struct ContainerInitArgs args = {
-        .containerParams = containerParams,
+    // Do not unshare the cgroup namespace just yet - the subprocess will do this, once it is sure to be in the right cgroup. 
+    // The child shares the memory of the library caller until its execve(), which may be long after we are gone,
+    // so everything it uses is copied into its own init memory.
+    struct ContainerInitArgs argsTemplate = {
         .syncPipeRead = syncPipeRead,
         .syncPipeWrite = syncPipeWrite,
         .errorPipeRead = errorPipeRead,
-        .errorPipeWrite = errorPipeWrite
+        .errorPipeWrite = errorPipeWrite,
+        .outputFds = { outputFds[0], outputFds[1] },
+        .seccompFilter = seccompFilter
     };
-    int cloneFlags = (CLONE_NEWNS | CLONE_NEWIPC | CLONE_NEWPID | CLONE_NEWUTS | CLONE_NEWUSER | CLONE_NEWTIME | SIGCHLD);
-    // Only unshare the network namespace if useHostNetwork is not set
-    if (containerParams->useHostNetwork == 0) {
+    struct ContainerInitArgs *args = allocateContainerInitArgs(&argsTemplate, containerParams, result);
+    if (args == NULL) {
+        discardContainerCgroup(cgroupfsFd, containerParams);
+        result->containerStartedStatus = -1;
+        return -1;
+    }
+    // CLONE_PARENT makes the container process a child of the library caller rather than of the launcher.
+    // This way the launcher can exit as soon as the container is prepared, and the caller waits for the container directly.
+    uint64_t cloneFlags = (CLONE_NEWNS | CLONE_NEWIPC | CLONE_NEWPID | CLONE_NEWUTS | CLONE_NEWUSER | CLONE_NEWTIME | CLONE_PARENT);
+    // A ready-made network namespace is joined here, so that the container process inherits it.
+    // Otherwise, only unshare the network namespace if useHostNetwork is not set.
+    if (netNsFd >= 0) {
+        if (setns(netNsFd, CLONE_NEWNET) != 0) {
+            releaseContainerInitMemory(args);
+            discardContainerCgroup(cgroupfsFd, containerParams);
+            RETURN_WITH_ERROR("setns() to enter the pooled network namespace failed: %s", strerror(errno));
+        }
+    } else if (containerParams->useHostNetwork == 0) {
         cloneFlags |= CLONE_NEWNET;
     }
-    // The stack memory of the child is a local 4K buffer allocated in this function. 
-    // This should be enough, but in either case, the child has its own memory map so even if it overruns the buffer, it shouldn't cause problems for us.
-    int childPid = clone((int (*)(void *)) runContainerInit, (void*) (((char*) alloca(4096)) + 4095), cloneFlags, (void*) &args);
+    int childPidFdValue = -1;
+    int childPid = spawnContainerProcess(args, cloneFlags, cgroupFd, &childPidFdValue, result);
+    RAII_FD childPidFd = childPidFdValue;
     if (childPid < 0) {
-        RETURN_WITH_ERROR("clone() failed: %s", strerror(errno));
+        releaseContainerInitMemory(args);
+        discardContainerCgroup(cgroupfsFd, containerParams);
+        result->containerStartedStatus = -1;
+        return -1;
     }
+    // From here on, the library caller has to reap the child and release its init memory, even if we fail.
+    report->containerPid = childPid;
+    report->containerInitMemory = args;
     closep(&syncPipeRead); // closep() is idempotent because it also sets the FD variable to -1
     closep(&errorPipeWrite); // closep() is idempotent because it also sets the FD variable to -1
 
-    // Create a cgroup for the child process. Note that we run in our own network namespaces and we've set all mounts to private, so the host should not see this.
-    {
-        if (mount("none", containerParams->containerDir, "cgroup2", 0, NULL) != 0) {
-            RETURN_WITH_ERROR("Could not mount cgroupfs: %s", strerror(errno));
-        }
-        ALLOC_LOCAL_FORMAT_STRING(cgroupPath, "%s/%s", containerParams->containerDir, containerParams->containerId);
-        int mkdirResult = mkdir(cgroupPath, 0770);
-        int mkdirErrno = errno;
-        int umount2Result = umount2(containerParams->containerDir, MNT_DETACH);
-        int umount2Errno = errno;
-        if (mkdirResult != 0) {
-            RETURN_WITH_ERROR("Could not create cgroup: %s.", strerror(mkdirErrno));
+    // Without clone3(), the child was started outside of its cgroup and we have no pidfd for it yet.
+    if (childPidFd < 0) {
+        childPidFd = syscall(SYS_pidfd_open, childPid, 0);
+        if (childPidFd < 0) {
+            kill(childPid, SIGKILL);
+            discardContainerCgroup(cgroupfsFd, containerParams);
+            RETURN_WITH_ERROR("pidfd_open() on child PID failed: %s", strerror(errno));
         }
-        if (umount2Result!= 0) {
-            RETURN_WITH_ERROR("Could not umount temporary cgroupfs mount: %s", strerror(umount2Errno));
+        if (moveProcessToCgroup(cgroupFd, childPid, result) != 0) {
+            killContainerProcess(childPid, childPidFd);
+            discardContainerCgroup(cgroupfsFd, containerParams);
+            result->containerStartedStatus = -1;
+            return -1;
         }
     }
-    // There is only one return point from this point on, so we're sure we will delete the container cgroup before returning.
+    report->timings[TINYJAIL_PHASE_CLONED] = monotonicNanoseconds();
 
-    if (finishConfiguringAndAwaitContainerProcess(containerParams, result, childPid, syncPipeWrite, errorPipeRead) != 0) {
-        kill(childPid, SIGKILL);
+    if (finishConfiguringContainerProcess(containerParams, report, childPid, procfsFd, netNsFd >= 0) != 0) {
         // The subroutines should have set an error message already
+        killContainerProcess(childPid, childPidFd);
+        discardContainerCgroup(cgroupfsFd, containerParams);
         result->containerStartedStatus = -1;
+        return -1;
+    }
+
+    // Success. The container is parked on the sync pipe, the library caller takes over from here.
+    reportFds[LAUNCHER_REPORT_FD_PIDFD] = childPidFd;
+    reportFds[LAUNCHER_REPORT_FD_CGROUPFS] = cgroupfsFd;
+    reportFds[LAUNCHER_REPORT_FD_SYNC_PIPE] = syncPipeWrite;
+    reportFds[LAUNCHER_REPORT_FD_ERROR_PIPE] = errorPipeRead;
+    // The FDs are closed after the report is sent
+    childPidFd = -1;
+    cgroupfsFd = -1;
+    syncPipeWrite = -1;
+    errorPipeRead = -1;
+    return 0;
+
+#undef RETURN_WITH_ERROR
+}
+
+void launchContainer(
+    const struct tinyjailContainerParams *containerParams, 
+    int reportSocket,
+    int netNsFd,
+    const int outputFds[2],
+    const struct sock_fprog *seccompFilter
+) {
+    struct launcherReport report = { .containerPid = -1 };
+    report.timings[TINYJAIL_PHASE_LAUNCHER_STARTED] = monotonicNanoseconds();
+    int reportFds[LAUNCHER_REPORT_FD_COUNT] = { -1, -1, -1, -1 };
+    int fdCount = (prepareContainerProcess(containerParams, netNsFd, outputFds, seccompFilter, &report, reportFds) == 0) ? LAUNCHER_REPORT_FD_COUNT : 0;
+    sendWithFds(reportSocket, &report, sizeof(report), reportFds, fdCount);
+    for (int i = 0; i < LAUNCHER_REPORT_FD_COUNT; i++) {
+        closep(&reportFds[i]);
+    }
+}
+
+void formatChildError(const char* message, size_t messageSize, char errorInfo[ERROR_INFO_SIZE]) {
+    const char* messageEnd = memchr(message, '\0', messageSize);
+    int32_t errorNumber;
+    if (messageEnd != NULL && (size_t) (messageEnd + 1 + sizeof(errorNumber) - message) == messageSize) {
+        memcpy(&errorNumber, messageEnd + 1, sizeof(errorNumber));
+        snprintf(errorInfo, ERROR_INFO_SIZE, "%.*s: %s", (int) (messageEnd - message), message, strerror(errorNumber));
+    } else {
+        snprintf(errorInfo, ERROR_INFO_SIZE, "%.*s", (int) messageSize, message);
+    }
+}
+
+/// @brief Runs the exec process until its execve(). It has a copy of the memory of the library caller (like after fork()),
+/// and it is already in the container cgroup and in the mount, IPC, UTS, network and PID namespaces of the container.
+/// @return Nothing if it gets to execve()-ing the command, otherwise returns -1 on failure.
+static int runExecProcess(
+    int containerPidFd,
+    const struct sock_fprog *seccompFilter,
+    const char* workDir,
+    char** commandList,
+    char** environment,
+    int errorPipeWrite
+) {
+#define RETURN_WITH_ERROR(MESSAGE) { writeChildError(errorPipeWrite, MESSAGE, errno); return -1; }
+
+    // The supplementary groups of the library caller have no mapping in the container, so drop them while we still can
+    if (syscall(SYS_setgroups, 0, NULL) != 0) {
+        RETURN_WITH_ERROR("Exec process could not drop supplementary groups");
     }
+    // Only a process with memory of its own can join a user or time namespace
+    if (setns(containerPidFd, CLONE_NEWUSER | CLONE_NEWCGROUP | CLONE_NEWTIME) != 0) {
+        RETURN_WITH_ERROR("setns() to enter the container user namespace failed");
+    }
+    // Become root of the container, like the container init process
+    if (syscall(SYS_setresgid, 0, 0, 0) != 0 || syscall(SYS_setresuid, 0, 0, 0) != 0) {
+        RETURN_WITH_ERROR("Exec process could not switch UID or GID");
+    }
+    // setns() into the mount namespace left us in the container root
+    if (workDir != NULL && chdir(workDir) != 0) {
+        RETURN_WITH_ERROR("Exec process could not chdir to chosen workdir");
+    }
+    if (seccompFilter != NULL) {
+        int seccompResult = installSeccompFilter(seccompFilter);
+        if (seccompResult != 0) {
+            errno = -seccompResult;
+            RETURN_WITH_ERROR("Could not install seccomp filter");
+        }
+    }
+    execve(commandList[0], (commandList + 1), environment);
+    RETURN_WITH_ERROR("execve() failed");
 
-    // Success. Now attempt final cleanup...
-    // Make sure to vacuum up any leftover child processes
-    int tmp;
-    while (wait(&tmp) > 0) {}
-    // Make sure to remove the cgroup
-    cleanContainerCgroup(containerParams);
+#undef RETURN_WITH_ERROR
+}
 
-    return;
+int launchExec(
+    int containerPidFd,
+    int cgroupFd,
+    const struct sock_fprog *seccompFilter,
+    const char* workDir,
+    char** commandList,
+    char** environment,
+    struct tinyjailContainerResult *result
+) {
+#define RETURN_WITH_ERROR(...) { result->containerStartedStatus = -1; snprintf(result->errorInfo, ERROR_INFO_SIZE, __VA_ARGS__); return -1; }
+
+    // Joining a PID namespace only applies to the processes we start. The cgroup namespace is joined by the exec process,
+    // since CLONE_INTO_CGROUP only works for a cgroup inside of our own cgroup namespace.
+    if (setns(containerPidFd, CLONE_NEWNS | CLONE_NEWIPC | CLONE_NEWUTS | CLONE_NEWNET | CLONE_NEWPID) != 0) {
+        RETURN_WITH_ERROR("setns() to enter the container namespaces failed: %s", strerror(errno));
+    }
+    // The error pipe only exists in our FD table, so a container launched by another thread in the meantime cannot keep its write end open
+    int errorPipe[2] = { -1, -1 };
+    if (pipe2(errorPipe, O_CLOEXEC) != 0) {
+        RETURN_WITH_ERROR("pipe() failed: %s", strerror(errno));
+    }
+    RAII_FD errorPipeRead = errorPipe[0];
+    RAII_FD errorPipeWrite = errorPipe[1];
+
+    // Unlike the container process, the exec process gets a copy of our memory, since it has to join the user namespace.
+    // CLONE_PARENT makes it a child of the library caller. The exit signal must be 0 with it, the child inherits ours (SIGCHLD).
+    struct cloneArgs cloneArgs = {
+        .flags = CLONE_PARENT | CLONE_INTO_CGROUP,
+        .exitSignal = 0,
+        .cgroup = cgroupFd
+    };
+    long execPid = syscall(SYS_clone3, &cloneArgs, sizeof(cloneArgs));
+    if (execPid == 0) {
+        close(errorPipeRead);
+        _exit(runExecProcess(containerPidFd, seccompFilter, workDir, commandList, environment, errorPipeWrite));
+    }
+    if (execPid < 0) {
+        RETURN_WITH_ERROR("clone3() of the exec process failed: %s", strerror(errno));
+    }
+    closep(&errorPipeWrite);
+
+    // The error pipe is closed by a successful execve(). Otherwise, the exec process tells us what went wrong before it exits.
+    char message[ERROR_INFO_SIZE];
+    size_t messageSize = 0;
+    ssize_t bytesRead;
+    do {
+        bytesRead = read(errorPipeRead, message + messageSize, sizeof(message) - messageSize);
+        if (bytesRead > 0) {
+            messageSize += bytesRead;
+        }
+    } while ((bytesRead < 0 && errno == EINTR) || (bytesRead > 0 && messageSize < sizeof(message)));
+    if (bytesRead < 0) {
+        result->containerStartedStatus = -1;
+        snprintf(result->errorInfo, ERROR_INFO_SIZE, "Could not read() on error pipe: %s", strerror(errno));
+    } else if (messageSize != 0) {
+        result->containerStartedStatus = -1;
+        formatChildError(message, messageSize, result->errorInfo);
+    }
+    return execPid;
 
 #undef RETURN_WITH_ERROR
 }
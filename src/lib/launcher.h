@@ -2,12 +2,91 @@
 
 #pragma once
 
+#include <stdint.h>
+#include <linux/filter.h>
+
 #include "tinyjail.h"
 
+/// @brief FDs attached (in this order) to a successful launcher report
+#define LAUNCHER_REPORT_FD_PIDFD (0)
+#define LAUNCHER_REPORT_FD_CGROUPFS (1)
+#define LAUNCHER_REPORT_FD_SYNC_PIPE (2)
+#define LAUNCHER_REPORT_FD_ERROR_PIPE (3)
+#define LAUNCHER_REPORT_FD_COUNT (4)
+
+/// @brief Sent by the launcher to the library caller once it is done.
+/// If the container was prepared successfully, the report carries the LAUNCHER_REPORT_FD_* FDs:
+/// a pidfd of the container process, the directory of a detached cgroupfs mount which holds the container cgroup (for cleaning it up),
+/// the write end of the sync pipe the container is waiting on, and the read end of the pipe over which it reports errors.
+struct launcherReport {
+    /// @brief The result of preparing the container
+    struct tinyjailContainerResult result;
+    /// @brief PID of the container process, or -1 if it was not started. The container process is a child of the
+    /// library caller, which has to reap it - on failure, it has already been killed by the launcher.
+    int containerPid;
+    /// @brief Timestamps of the launcher phases (see enum tinyjailLaunchPhase), 0 for all other phases
+    uint64_t timings[TINYJAIL_LAUNCH_PHASE_COUNT];
+    /// @brief Memory the container process runs on until its execve(), or NULL if it was not started. The container process shares
+    /// the memory of the library caller until then, which has to release this with releaseContainerInitMemory() once the process has exec'd or exited.
+    void* containerInitMemory;
+};
+
+/// @brief Releases the memory of a container process which has exec'd or exited (see launcherReport). Does nothing for NULL.
+void releaseContainerInitMemory(void* containerInitMemory);
+
+/// @brief Marks the start of a childTimingRecord on the error pipe, so that it can be told apart from error messages.
+#define CHILD_TIMING_RECORD_MAGIC (0x73676e696d69544aULL)
+
+/// @brief Sent by the container process over the error pipe right before its execve().
+/// If the execve() fails, the error follows the record. Errors are sent as a NUL-terminated message followed by the int32_t errno,
+/// which the library caller turns into "<message>: <strerror(errno)>" - the container process does not format them itself,
+/// since strerror() may allocate memory, which the container process shares with the library caller.
+struct childTimingRecord {
+    uint64_t magic;
+    /// @brief Timestamps of the child phases (see enum tinyjailLaunchPhase), 0 for all other phases
+    uint64_t timings[TINYJAIL_LAUNCH_PHASE_COUNT];
+};
+
+/// @brief Turns an error sent over an error pipe (see childTimingRecord) into an error description for the library caller.
+/// @param message The error as it was read from the pipe
+/// @param messageSize Size of the error in bytes
+/// @param errorInfo Output: the description, e.g. "execve() failed: No such file or directory"
+void formatChildError(const char* message, size_t messageSize, char errorInfo[ERROR_INFO_SIZE]);
+
 /// @brief Runs the container launcher logic, in a separate subprocess.
+/// The launcher prepares the container up to the point where the container process waits for the go-ahead signal
+/// on the sync pipe, then hands the container over to the library caller and returns.
 /// @param containerParams Input arg: the parameters for launching the container
-/// @param result Output arg: the result of the launch is written here
+/// @param reportSocket Input arg: Unix socket over which the struct launcherReport (with FDs) is sent
+/// @param netNsFd Input arg: a ready-made network namespace for the container to join (see tinyjailNetworkPool), or -1
+/// @param outputFds Input arg: FDs the container process gets as stdout and stderr, -1 to keep the inherited ones
+/// @param seccompFilter Input arg: program the container process installs right before its execve(), or NULL
 void launchContainer(
     const struct tinyjailContainerParams *containerParams, 
+    int reportSocket,
+    int netNsFd,
+    const int outputFds[2],
+    const struct sock_fprog *seccompFilter
+);
+
+/// @brief Runs the exec launcher logic (see tinyjailExec()), in a separate subprocess which shares the memory of the library caller.
+/// The exec launcher joins the mount, IPC, UTS, network and PID namespaces of a running container, then starts the exec process,
+/// which joins the remaining namespaces and runs a command. The exec process is started directly inside the container cgroup, as a child
+/// of the library caller. The exec launcher waits until the exec process has executed its command (or failed to) and returns.
+/// @param containerPidFd Input arg: pidfd of the container init process
+/// @param cgroupFd Input arg: FD of the container cgroup directory
+/// @param seccompFilter Input arg: program the exec process installs right before its execve(), or NULL
+/// @param workDir Input arg: working directory of the command, or NULL for "/"
+/// @param commandList Input arg: the command, in the layout of tinyjailContainerParams.commandList
+/// @param environment Input arg: the environment of the command
+/// @param result Output: on failure, containerStartedStatus is nonzero and errorInfo describes the error
+/// @return PID of the exec process, which the library caller has to reap even if result reports a failure, or -1 if it was not started
+int launchExec(
+    int containerPidFd,
+    int cgroupFd,
+    const struct sock_fprog *seccompFilter,
+    const char* workDir,
+    char** commandList,
+    char** environment,
     struct tinyjailContainerResult *result
 );
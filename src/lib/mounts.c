@@ -0,0 +1,110 @@
+// SPDX-License-Identifier: MIT
+
+// _GNU_SOURCE is needed for setns() and the AT_* flags of the new mount API
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+// Only the kernel header is included here: depending on the libc version, <sys/mount.h> may clash with it.
+#include <linux/mount.h>
+
+#include "mounts.h"
+#include "utils.h"
+
+int openDetachedMount(const char* fsType, struct tinyjailContainerResult *result) {
+    RAII_FD fsFd = syscall(SYS_fsopen, fsType, FSOPEN_CLOEXEC);
+    if (fsFd < 0) {
+        snprintf(result->errorInfo, ERROR_INFO_SIZE, "fsopen() for %s failed: %s", fsType, strerror(errno));
+        return -1;
+    }
+    if (syscall(SYS_fsconfig, fsFd, FSCONFIG_CMD_CREATE, NULL, NULL, 0) != 0) {
+        snprintf(result->errorInfo, ERROR_INFO_SIZE, "Could not create %s superblock: %s", fsType, strerror(errno));
+        return -1;
+    }
+    int mountFd = syscall(SYS_fsmount, fsFd, FSMOUNT_CLOEXEC, MOUNT_ATTR_NOSUID | MOUNT_ATTR_NODEV | MOUNT_ATTR_NOEXEC);
+    if (mountFd < 0) {
+        snprintf(result->errorInfo, ERROR_INFO_SIZE, "fsmount() for %s failed: %s", fsType, strerror(errno));
+        return -1;
+    }
+    return mountFd;
+}
+
+int attachIdmappedContainerRoot(
+    int childPid,
+    int procfsFd,
+    const char* containerDir,
+    struct tinyjailContainerResult *result
+) {
+    ALLOC_LOCAL_FORMAT_STRING(userNsPath, "%d/ns/user", childPid);
+    ALLOC_LOCAL_FORMAT_STRING(mountNsPath, "%d/ns/mnt", childPid);
+    RAII_FD userNsFd = openat(procfsFd, userNsPath, O_RDONLY | O_CLOEXEC);
+    RAII_FD mountNsFd = openat(procfsFd, mountNsPath, O_RDONLY | O_CLOEXEC);
+    if (userNsFd < 0 || mountNsFd < 0) {
+        snprintf(result->errorInfo, ERROR_INFO_SIZE, "Could not open namespaces of child process: %s", strerror(errno));
+        return -1;
+    }
+    // Clone the container root (with everything mounted under it) into a detached tree, which can still be given an ID mapping
+    RAII_FD treeFd = syscall(SYS_open_tree, AT_FDCWD, containerDir, OPEN_TREE_CLONE | OPEN_TREE_CLOEXEC | AT_RECURSIVE);
+    if (treeFd < 0) {
+        snprintf(result->errorInfo, ERROR_INFO_SIZE, "open_tree() on container root failed: %s", strerror(errno));
+        return -1;
+    }
+    struct mount_attr idmapAttr = { .attr_set = MOUNT_ATTR_IDMAP, .userns_fd = userNsFd };
+    if (syscall(SYS_mount_setattr, treeFd, "", AT_EMPTY_PATH | AT_RECURSIVE, &idmapAttr, sizeof(idmapAttr)) != 0) {
+        snprintf(result->errorInfo, ERROR_INFO_SIZE, "Could not create idmapped mount of container root: %s", strerror(errno));
+        return -1;
+    }
+    // The child has its own copy of our mount namespace already, so the tree has to be attached in there
+    if (setns(mountNsFd, CLONE_NEWNS) != 0) {
+        snprintf(result->errorInfo, ERROR_INFO_SIZE, "setns() to enter the container mount namespace failed: %s", strerror(errno));
+        return -1;
+    }
+    if (syscall(SYS_move_mount, treeFd, "", AT_FDCWD, containerDir, MOVE_MOUNT_F_EMPTY_PATH) != 0) {
+        snprintf(result->errorInfo, ERROR_INFO_SIZE, "Could not attach idmapped container root: %s", strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+/// @brief Detached mounts kept open by keepDetachedMount(), -1 if not kept
+static int keptCgroupfsFd = -1;
+static int keptProcfsFd = -1;
+
+static int* keptMountFd(const char* fsType) {
+    if (strcmp(fsType, "cgroup2") == 0) {
+        return &keptCgroupfsFd;
+    } else if (strcmp(fsType, "proc") == 0) {
+        return &keptProcfsFd;
+    }
+    return NULL;
+}
+
+int keepDetachedMount(const char* fsType, struct tinyjailContainerResult *result) {
+    int *keptFd = keptMountFd(fsType);
+    if (keptFd == NULL) {
+        snprintf(result->errorInfo, ERROR_INFO_SIZE, "Mounts of type %s cannot be kept.", fsType);
+        return -1;
+    }
+    if (*keptFd >= 0) {
+        return 0;
+    }
+    *keptFd = openDetachedMount(fsType, result);
+    return (*keptFd >= 0) ? 0 : -1;
+}
+
+int openSharedDetachedMount(const char* fsType, struct tinyjailContainerResult *result) {
+    int *keptFd = keptMountFd(fsType);
+    if (keptFd == NULL || *keptFd < 0) {
+        return openDetachedMount(fsType, result);
+    }
+    // Every user closes its FD when it is done, the kept one stays open
+    int mountFd = fcntl(*keptFd, F_DUPFD_CLOEXEC, 0);
+    if (mountFd < 0) {
+        snprintf(result->errorInfo, ERROR_INFO_SIZE, "Could not duplicate %s mount FD: %s", fsType, strerror(errno));
+    }
+    return mountFd;
+}
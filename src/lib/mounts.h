@@ -0,0 +1,43 @@
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include "tinyjail.h"
+
+/// @brief Creates a new mount of a pseudo-filesystem (e.g. cgroup2 or proc) using the new mount API (fsopen()/fsmount()).
+/// The mount is never attached to the mount tree: it is only reachable through the returned FD (use openat() and friends),
+/// and it disappears once the FD is closed. This avoids taking the mount lock for a mount and an unmount on every use.
+/// @param fsType Filesystem type, e.g. "cgroup2"
+/// @param result Result object returned to the library caller
+/// @return Close-on-exec FD of the root directory of the mount on success, -1 on failure
+int openDetachedMount(const char* fsType, struct tinyjailContainerResult *result);
+
+/// @brief Mounts the container root over itself in the mount namespace of the container process, with an ID mapping to its
+/// user namespace (see idmapRootfs in tinyjailContainerParams). The container process has to be waiting for its command,
+/// with its ID maps already written. The calling process is left in the mount namespace of the container process.
+/// @param childPid PID of the container process
+/// @param procfsFd FD of the root directory of a procfs mount
+/// @param containerDir Absolute path of the container root
+/// @param result Result object returned to the library caller
+/// @return 0 on success, -1 on failure
+int attachIdmappedContainerRoot(
+    int childPid,
+    int procfsFd,
+    const char* containerDir,
+    struct tinyjailContainerResult *result
+);
+
+/// @brief Creates a detached mount with openDetachedMount() once and keeps it open for the rest of the process lifetime,
+/// so that later calls of openSharedDetachedMount() for the same filesystem type only need to duplicate the FD.
+/// Only "cgroup2" and "proc" mounts can be kept. Not thread-safe, call it before launching containers from several threads.
+/// @param fsType Filesystem type, "cgroup2" or "proc"
+/// @param result Result object returned to the library caller
+/// @return 0 on success (or if the mount is already kept), -1 on failure
+int keepDetachedMount(const char* fsType, struct tinyjailContainerResult *result);
+
+/// @brief Returns a detached mount of the given filesystem type: a duplicate of the FD kept by keepDetachedMount() if there is one,
+/// otherwise a new mount from openDetachedMount().
+/// @param fsType Filesystem type, e.g. "cgroup2"
+/// @param result Result object returned to the library caller
+/// @return Close-on-exec FD of the root directory of the mount on success, -1 on failure
+int openSharedDetachedMount(const char* fsType, struct tinyjailContainerResult *result);
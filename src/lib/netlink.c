@@ -0,0 +1,195 @@
+// SPDX-License-Identifier: MIT
+
+#include <errno.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+
+#include "netlink.h"
+#include "utils.h"
+
+int openNetlinkSocket(struct tinyjailContainerResult *result) {
+    RAII_FD netlinkSocket = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_ROUTE);
+    if (netlinkSocket < 0) {
+        snprintf(result->errorInfo, ERROR_INFO_SIZE, "RTNETLINK socket() failed: %s", strerror(errno));
+        return -1;
+    }
+    // Let the kernel pick the port ID, so that several sockets (in several namespaces or threads) never collide
+    struct sockaddr_nl bindInfo = {
+        .nl_family = AF_NETLINK,
+        .nl_pad = 0,
+        .nl_pid = 0,
+        .nl_groups = 0
+    };
+    if (bind(netlinkSocket, (struct sockaddr*) &bindInfo, sizeof(bindInfo)) != 0) {
+        snprintf(result->errorInfo, ERROR_INFO_SIZE, "RTNETLINK bind() failed: %s", strerror(errno));
+        return -1;
+    }
+    // Hand the FD over to the caller without the RAII cleanup closing it
+    int retval = netlinkSocket;
+    netlinkSocket = -1;
+    return retval;
+}
+
+void netlinkBatchInit(struct netlinkBatch *batch) {
+    batch->length = 0;
+    batch->messageStart = 0;
+    batch->messageCount = 0;
+    batch->nestDepth = 0;
+    batch->overflowed = 0;
+}
+
+/// @brief Reserves zeroed space at the end of the batch and extends the current request to cover it.
+/// @return Pointer to the reserved space, or NULL if the batch is full (in which case the batch is marked as overflowed)
+static void* netlinkReserve(struct netlinkBatch *batch, size_t size) {
+    size_t alignedSize = NLMSG_ALIGN(size);
+    if (batch->overflowed || batch->length + alignedSize > NETLINK_BATCH_SIZE) {
+        batch->overflowed = 1;
+        return NULL;
+    }
+    void *reserved = batch->buffer + batch->length;
+    memset(reserved, 0, alignedSize);
+    batch->length += alignedSize;
+    if (batch->messageCount > 0) {
+        struct nlmsghdr *header = (struct nlmsghdr*) (batch->buffer + batch->messageStart);
+        header->nlmsg_len = batch->length - batch->messageStart;
+    }
+    return reserved;
+}
+
+void netlinkBeginMessage(
+    struct netlinkBatch *batch,
+    unsigned short type,
+    unsigned short flags,
+    const void *header,
+    size_t headerSize,
+    const char *description
+) {
+    if (batch->messageCount >= NETLINK_BATCH_MAX_MESSAGES) {
+        batch->overflowed = 1;
+        return;
+    }
+    // Start the new request before reserving space for its header, so the previous request's length stays untouched
+    batch->messageStart = batch->length;
+    batch->messageCount++;
+    batch->nestDepth = 0;
+    struct nlmsghdr *netlinkHeader = netlinkReserve(batch, NLMSG_HDRLEN);
+    if (netlinkHeader == NULL) {
+        return;
+    }
+    netlinkHeader->nlmsg_type = type;
+    netlinkHeader->nlmsg_flags = NLM_F_REQUEST | NLM_F_ACK | flags;
+    // Sequence numbers start at 1 and identify the request an ACK belongs to
+    netlinkHeader->nlmsg_seq = batch->messageCount;
+    netlinkHeader->nlmsg_pid = 0;
+    snprintf(batch->descriptions[batch->messageCount - 1], NETLINK_DESCRIPTION_SIZE, "%s", description);
+    netlinkAddRaw(batch, header, headerSize);
+}
+
+void netlinkAddRaw(struct netlinkBatch *batch, const void *data, size_t size) {
+    void *reserved = netlinkReserve(batch, size);
+    if (reserved != NULL) {
+        memcpy(reserved, data, size);
+    }
+}
+
+void netlinkAddAttribute(struct netlinkBatch *batch, unsigned short type, const void *data, size_t size) {
+    struct rtattr *attribute = netlinkReserve(batch, RTA_LENGTH(size));
+    if (attribute == NULL) {
+        return;
+    }
+    attribute->rta_type = type;
+    attribute->rta_len = RTA_LENGTH(size);
+    memcpy(RTA_DATA(attribute), data, size);
+}
+
+void netlinkAddStringAttribute(struct netlinkBatch *batch, unsigned short type, const char *value) {
+    netlinkAddAttribute(batch, type, value, strlen(value) + 1);
+}
+
+void netlinkBeginNested(struct netlinkBatch *batch, unsigned short type) {
+    if (batch->nestDepth >= NETLINK_BATCH_MAX_NESTING) {
+        batch->overflowed = 1;
+        return;
+    }
+    size_t nestStart = batch->length;
+    struct rtattr *attribute = netlinkReserve(batch, RTA_LENGTH(0));
+    if (attribute == NULL) {
+        return;
+    }
+    attribute->rta_type = type;
+    batch->nestStarts[batch->nestDepth++] = nestStart;
+}
+
+void netlinkEndNested(struct netlinkBatch *batch) {
+    if (batch->overflowed || batch->nestDepth <= 0) {
+        return;
+    }
+    size_t nestStart = batch->nestStarts[--batch->nestDepth];
+    struct rtattr *attribute = (struct rtattr*) (batch->buffer + nestStart);
+    attribute->rta_len = batch->length - nestStart;
+}
+
+int netlinkSendBatch(int netlinkSocket, struct netlinkBatch *batch, struct tinyjailContainerResult *result) {
+    if (batch->overflowed) {
+        snprintf(result->errorInfo, ERROR_INFO_SIZE, "RTNETLINK request batch is too large.");
+        return -1;
+    }
+    if (batch->messageCount == 0) {
+        return 0;
+    }
+
+    struct sockaddr_nl kernelAddress = { .nl_family = AF_NETLINK };
+    struct iovec requestIov = { .iov_base = batch->buffer, .iov_len = batch->length };
+    struct msghdr request = {
+        .msg_name = &kernelAddress,
+        .msg_namelen = sizeof(kernelAddress),
+        .msg_iov = &requestIov,
+        .msg_iovlen = 1
+    };
+    if (sendmsg(netlinkSocket, &request, 0) < 0) {
+        snprintf(result->errorInfo, ERROR_INFO_SIZE, "RTNETLINK sendmsg() failed: %s", strerror(errno));
+        return -1;
+    }
+
+    // The kernel processes every request in the batch even if an earlier one fails, so collect all ACKs
+    // (to leave the socket clean) and report the first request that failed.
+    int ackCount = 0;
+    int firstFailedMessage = -1;
+    int firstFailedErrno = 0;
+    union {
+        struct nlmsghdr header;
+        char bytes[8192];
+    } response;
+    while (ackCount < batch->messageCount) {
+        ssize_t received = recv(netlinkSocket, &response, sizeof(response), 0);
+        if (received < 0 && errno == EINTR) {
+            continue;
+        }
+        if (received <= 0) {
+            snprintf(result->errorInfo, ERROR_INFO_SIZE, "RTNETLINK recv() failed: %s", received < 0 ? strerror(errno) : "connection closed");
+            return -1;
+        }
+        int remaining = received;
+        for (struct nlmsghdr *header = &response.header; NLMSG_OK(header, remaining); header = NLMSG_NEXT(header, remaining)) {
+            int messageIndex = header->nlmsg_seq - 1;
+            if (header->nlmsg_type != NLMSG_ERROR || messageIndex < 0 || messageIndex >= batch->messageCount) {
+                continue;
+            }
+            ackCount++;
+            struct nlmsgerr *error = NLMSG_DATA(header);
+            if (error->error != 0 && (firstFailedMessage < 0 || messageIndex < firstFailedMessage)) {
+                firstFailedMessage = messageIndex;
+                firstFailedErrno = -error->error;
+            }
+        }
+    }
+    if (firstFailedMessage >= 0) {
+        snprintf(result->errorInfo, ERROR_INFO_SIZE, "%s failed: %s", batch->descriptions[firstFailedMessage], strerror(firstFailedErrno));
+        return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,92 @@
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include <stddef.h>
+
+#include "tinyjail.h"
+
+#define NETLINK_BATCH_SIZE (4096)
+#define NETLINK_BATCH_MAX_MESSAGES (16)
+#define NETLINK_BATCH_MAX_NESTING (4)
+#define NETLINK_DESCRIPTION_SIZE (96)
+
+/// @brief A set of RTNETLINK requests that are built up front and then sent to the kernel in a single sendmsg().
+/// Every request asks for an ACK, so errors can be attributed to the request that caused them.
+struct netlinkBatch {
+    /// @brief The serialized requests
+    char buffer[NETLINK_BATCH_SIZE];
+    /// @brief Number of bytes used in the buffer
+    size_t length;
+    /// @brief Offset of the request currently being built
+    size_t messageStart;
+    /// @brief Number of requests in the batch
+    int messageCount;
+    /// @brief Offsets of the nested attributes which are currently open
+    size_t nestStarts[NETLINK_BATCH_MAX_NESTING];
+    int nestDepth;
+    /// @brief Set if any of the append functions ran out of space. Checked when the batch is sent.
+    int overflowed;
+    /// @brief Human-readable descriptions of each request, used for error messages.
+    char descriptions[NETLINK_BATCH_MAX_MESSAGES][NETLINK_DESCRIPTION_SIZE];
+};
+
+/// @brief Opens a RTNETLINK socket. The socket operates on the network namespace the calling thread is in at the time of the call.
+/// @param result Result object returned to the library caller
+/// @return The socket FD on success, -1 on failure
+int openNetlinkSocket(struct tinyjailContainerResult *result);
+
+/// @brief Resets a batch so that it holds no requests.
+/// @param batch The batch to reset
+void netlinkBatchInit(struct netlinkBatch *batch);
+
+/// @brief Starts a new request in the batch. NLM_F_REQUEST and NLM_F_ACK are always added to the flags.
+/// @param batch The batch to append to
+/// @param type Message type, e.g. RTM_NEWLINK
+/// @param flags Additional netlink flags, e.g. NLM_F_CREATE
+/// @param header The family-specific header (e.g. struct ifinfomsg) which follows the netlink header
+/// @param headerSize Size of the family-specific header
+/// @param description Short description of the request for error messages, e.g. "Creating vEth pair"
+void netlinkBeginMessage(
+    struct netlinkBatch *batch,
+    unsigned short type,
+    unsigned short flags,
+    const void *header,
+    size_t headerSize,
+    const char *description
+);
+
+/// @brief Appends an attribute to the current request (or the innermost open nested attribute).
+/// @param batch The batch to append to
+/// @param type Attribute type
+/// @param data Attribute payload
+/// @param size Size of the payload
+void netlinkAddAttribute(struct netlinkBatch *batch, unsigned short type, const void *data, size_t size);
+
+/// @brief Appends a NULL-terminated string attribute to the current request.
+/// @param batch The batch to append to
+/// @param type Attribute type
+/// @param value The string value
+void netlinkAddStringAttribute(struct netlinkBatch *batch, unsigned short type, const char *value);
+
+/// @brief Appends raw (aligned) bytes to the current request, e.g. a header embedded in a nested attribute.
+/// @param batch The batch to append to
+/// @param data The bytes to append
+/// @param size Number of bytes
+void netlinkAddRaw(struct netlinkBatch *batch, const void *data, size_t size);
+
+/// @brief Opens a nested attribute. Everything appended until the matching netlinkEndNested() call goes inside it.
+/// @param batch The batch to append to
+/// @param type Attribute type
+void netlinkBeginNested(struct netlinkBatch *batch, unsigned short type);
+
+/// @brief Closes the innermost open nested attribute.
+/// @param batch The batch to append to
+void netlinkEndNested(struct netlinkBatch *batch);
+
+/// @brief Sends all requests in the batch with one sendmsg() and collects the ACK for every one of them.
+/// @param netlinkSocket RTNETLINK socket, as returned by openNetlinkSocket()
+/// @param batch The batch to send. An empty batch is not sent at all.
+/// @param result Result object returned to the library caller. On failure, the description of the first failed request is written here.
+/// @return 0 if all requests succeeded, -1 otherwise
+int netlinkSendBatch(int netlinkSocket, struct netlinkBatch *batch, struct tinyjailContainerResult *result);
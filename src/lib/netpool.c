@@ -0,0 +1,189 @@
+// SPDX-License-Identifier: MIT
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/random.h>
+
+#include "netpool.h"
+#include "network.h"
+#include "utils.h"
+
+struct tinyjailNetworkPool {
+    /// @brief Network parameters every namespace is set up with
+    struct tinyjailContainerParams networkParams;
+    pthread_mutex_t lock;
+    /// @brief Idle namespaces, as a ring buffer. Namespaces are reused in the order they were returned,
+    /// which gives the processes of the previous container as much time as possible to finish dying.
+    int *netNsFds;
+    int capacity;
+    int head;
+    int count;
+    /// @brief Number of namespaces created so far. Namespace n gets networkIpAddr + n as its address.
+    int createdCount;
+};
+
+static int createNamespace(
+    struct tinyjailNetworkPool *pool,
+    struct tinyjailContainerResult *result
+) {
+    // Every namespace gets its own random ID, which names its vEth pair just like a container ID would
+    struct tinyjailContainerParams params = pool->networkParams;
+    uint64_t randInt = 0;
+    getrandom(&randInt, sizeof(randInt), 0);
+    ALLOC_LOCAL_FORMAT_STRING(namespaceId, "%lx", randInt & 0xffffffffffff);
+    params.containerId = namespaceId;
+    // Namespaces are never destroyed before the pool is, so each one keeps its address until then.
+    // The address of a namespace which could not be created is not handed out again.
+    pthread_mutex_lock(&pool->lock);
+    int namespaceIndex = pool->createdCount++;
+    pthread_mutex_unlock(&pool->lock);
+    char namespaceIpAddr[INET6_ADDRSTRLEN + 4];
+    if (params.networkIpAddr != NULL) {
+        if (offsetAddress(params.networkIpAddr, namespaceIndex, namespaceIpAddr, sizeof(namespaceIpAddr)) != 0) {
+            result->containerStartedStatus = -1;
+            snprintf(result->errorInfo, ERROR_INFO_SIZE, "Network pool ran out of addresses: %s + %d is not in the same prefix.", params.networkIpAddr, namespaceIndex);
+            return -1;
+        }
+        params.networkIpAddr = namespaceIpAddr;
+    }
+    return createPooledNetworkNamespace(&params, result);
+}
+
+/// @brief Adds an idle namespace to the ring buffer, growing it if needed. Must be called with the lock held.
+static int pushNamespace(struct tinyjailNetworkPool *pool, int netNsFd) {
+    if (pool->count == pool->capacity) {
+        int newCapacity = pool->capacity > 0 ? pool->capacity * 2 : 8;
+        int *newFds = malloc(newCapacity * sizeof(int));
+        if (newFds == NULL) {
+            return -1;
+        }
+        for (int i = 0; i < pool->count; i++) {
+            newFds[i] = pool->netNsFds[(pool->head + i) % pool->capacity];
+        }
+        free(pool->netNsFds);
+        pool->netNsFds = newFds;
+        pool->capacity = newCapacity;
+        pool->head = 0;
+    }
+    pool->netNsFds[(pool->head + pool->count) % pool->capacity] = netNsFd;
+    pool->count++;
+    return 0;
+}
+
+struct tinyjailNetworkPool* tinyjailCreateNetworkPool(
+    struct tinyjailContainerParams programArgs,
+    int size,
+    struct tinyjailContainerResult *result
+) {
+    memset(result, 0, sizeof(*result));
+#define RETURN_WITH_ERROR(...) { result->containerStartedStatus = -1; snprintf(result->errorInfo, ERROR_INFO_SIZE, __VA_ARGS__); return NULL; }
+    if (getuid() != 0) {
+        RETURN_WITH_ERROR("tinyjail requires root permissions to run.");
+    }
+    if (programArgs.useHostNetwork) {
+        RETURN_WITH_ERROR("A network pool cannot use the host network.");
+    }
+    if (programArgs.networkBridgeName && programArgs.networkPeerIpAddr) {
+        RETURN_WITH_ERROR("containerParams cannot have both networkBridgeName and networkPeerIPAddr set.");
+    }
+    if (programArgs.networkMode < 0 || programArgs.networkMode >= TINYJAIL_NETWORK_MODE_COUNT) {
+        RETURN_WITH_ERROR("Invalid networkMode: %d", programArgs.networkMode);
+    }
+    if ((programArgs.networkMode == TINYJAIL_NETWORK_VETH) != (programArgs.networkParentDevice == NULL)) {
+        RETURN_WITH_ERROR("containerParams must have networkParentDevice set if and only if networkMode is macvlan or ipvlan.");
+    }
+    if (programArgs.networkMode != TINYJAIL_NETWORK_VETH && (programArgs.networkBridgeName || programArgs.networkPeerIpAddr)) {
+        RETURN_WITH_ERROR("containerParams cannot have networkBridgeName or networkPeerIpAddr set for a macvlan or ipvlan interface.");
+    }
+    if (programArgs.networkQueueCount < 0 || programArgs.networkMtu < 0 || programArgs.networkTxQueueLength < 0) {
+        RETURN_WITH_ERROR("containerParams cannot have negative networkQueueCount, networkMtu or networkTxQueueLength.");
+    }
+    char firstIpAddr[INET6_ADDRSTRLEN + 4];
+    if (programArgs.networkIpAddr != NULL && offsetAddress(programArgs.networkIpAddr, 0, firstIpAddr, sizeof(firstIpAddr)) != 0) {
+        RETURN_WITH_ERROR("Invalid networkIpAddr: %s", programArgs.networkIpAddr);
+    }
+    // The host end of every vEth pair would need a subnet of its own, so a peer address only works for a single namespace
+    if (programArgs.networkPeerIpAddr != NULL && size != 1) {
+        RETURN_WITH_ERROR("A network pool with networkPeerIpAddr set must have size 1.");
+    }
+    struct tinyjailNetworkPool *pool = calloc(1, sizeof(struct tinyjailNetworkPool));
+    if (pool == NULL) {
+        RETURN_WITH_ERROR("calloc() failed.");
+    }
+    pool->networkParams = programArgs;
+    pthread_mutex_init(&pool->lock, NULL);
+    for (int i = 0; i < size; i++) {
+        int netNsFd = createNamespace(pool, result);
+        if (netNsFd < 0 || pushNamespace(pool, netNsFd) != 0) {
+            if (netNsFd >= 0) {
+                close(netNsFd);
+                snprintf(result->errorInfo, ERROR_INFO_SIZE, "malloc() failed.");
+            }
+            result->containerStartedStatus = -1;
+            tinyjailDestroyNetworkPool(pool);
+            return NULL;
+        }
+    }
+    return pool;
+#undef RETURN_WITH_ERROR
+}
+
+void tinyjailDestroyNetworkPool(
+    struct tinyjailNetworkPool *pool
+) {
+    // Closing the last reference to a namespace destroys it, and its vEth pair along with it
+    for (int i = 0; i < pool->count; i++) {
+        close(pool->netNsFds[(pool->head + i) % pool->capacity]);
+    }
+    free(pool->netNsFds);
+    pthread_mutex_destroy(&pool->lock);
+    free(pool);
+}
+
+int takePooledNetworkNamespace(
+    struct tinyjailNetworkPool *pool,
+    struct tinyjailContainerResult *result
+) {
+    pthread_mutex_lock(&pool->lock);
+    if (pool->count > 0) {
+        int netNsFd = pool->netNsFds[pool->head];
+        pool->head = (pool->head + 1) % pool->capacity;
+        pool->count--;
+        pthread_mutex_unlock(&pool->lock);
+        return netNsFd;
+    }
+    pthread_mutex_unlock(&pool->lock);
+    if (pool->networkParams.networkPeerIpAddr != NULL) {
+        result->containerStartedStatus = -1;
+        snprintf(result->errorInfo, ERROR_INFO_SIZE, "The namespace of the network pool is in use, a pool with networkPeerIpAddr set does not grow.");
+        return -1;
+    }
+    // More containers are running than the pool was sized for, so the pool grows
+    int netNsFd = createNamespace(pool, result);
+    if (netNsFd < 0) {
+        result->containerStartedStatus = -1;
+    }
+    return netNsFd;
+}
+
+void returnPooledNetworkNamespace(
+    struct tinyjailNetworkPool *pool,
+    int netNsFd
+) {
+    pthread_mutex_lock(&pool->lock);
+    if (pushNamespace(pool, netNsFd) != 0) {
+        close(netNsFd);
+    }
+    pthread_mutex_unlock(&pool->lock);
+}
+
+void releasePooledNetworkNamespace(struct pooledNetworkNamespace *pooledNamespace) {
+    if (pooledNamespace->netNsFd >= 0) {
+        returnPooledNetworkNamespace(pooledNamespace->pool, pooledNamespace->netNsFd);
+        pooledNamespace->netNsFd = -1;
+    }
+}
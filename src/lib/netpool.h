@@ -0,0 +1,34 @@
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include "tinyjail.h"
+
+/// @brief Takes a ready-made network namespace from the pool. If the pool is empty, a new namespace is created,
+/// which joins the pool once it is returned. A pool with networkPeerIpAddr set does not grow, so this fails instead.
+/// @param pool The pool
+/// @param result Result object passed back to the library caller
+/// @return FD of the network namespace on success, -1 on failure
+int takePooledNetworkNamespace(
+    struct tinyjailNetworkPool *pool,
+    struct tinyjailContainerResult *result
+);
+
+/// @brief Puts a network namespace taken with takePooledNetworkNamespace() back into the pool.
+/// @param pool The pool
+/// @param netNsFd FD of the namespace, the pool takes ownership of it
+void returnPooledNetworkNamespace(
+    struct tinyjailNetworkPool *pool,
+    int netNsFd
+);
+
+/// @brief A namespace taken from a pool, for use with releasePooledNetworkNamespace() as a cleanup function
+struct pooledNetworkNamespace {
+    struct tinyjailNetworkPool *pool;
+    /// @brief FD of the namespace, -1 if none was taken or it was handed on
+    int netNsFd;
+};
+
+/// @brief Puts the namespace back into its pool, unless it was handed on (netNsFd is -1).
+/// Use it as __attribute__((cleanup(releasePooledNetworkNamespace))), so that a failed launch does not use up a namespace and its address.
+void releasePooledNetworkNamespace(struct pooledNetworkNamespace *pooledNamespace);
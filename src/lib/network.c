@@ -1,6 +1,6 @@
 // SPDX-License-Identifier: MIT
 
-// _GNU_SOURCE is needed for CLONE_NEW* constants
+// _GNU_SOURCE is needed for CLONE_NEW* constants and setns()
 #define _GNU_SOURCE
 
 #include <errno.h>
@@ -8,142 +8,394 @@
 #include <sched.h>
 #include <stdlib.h>
 #include <string.h>
-#include <sys/mount.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
 #include <sys/syscall.h>
 #include <unistd.h>
-#include <sys/socket.h>
-#include <linux/netlink.h>
+#include <arpa/inet.h>
+#include <net/if.h>
+#include <linux/ethtool.h>
+#include <linux/rtnetlink.h>
+#include <linux/sockios.h>
+#include <linux/veth.h>
 
+#include "mounts.h"
+#include "netlink.h"
 #include "network.h"
 #include "utils.h"
 
-static int createVethPair(int netlinkSocket, char* if1, char* if2) {
-    // TODO: Do this without using the iproute2 tool (use rtnetlink directly?)
-    ALLOC_LOCAL_FORMAT_STRING(command, "ip link add dev %s type veth peer %s", if1, if2);
-    return system(command);
+/// @brief Parses an address in the form "<address>[/<prefix length>]". IPv4 and IPv6 are supported.
+static int parseAddress(const char* text, int* family, unsigned char* address, unsigned char* prefixLength) {
+    ALLOC_LOCAL_FORMAT_STRING(textCopy, "%s", text);
+    char* addressPart;
+    char* prefixPart;
+    int hasPrefix = (splitString(textCopy, &addressPart, &prefixPart, '/') == 0);
+    if (inet_pton(AF_INET, addressPart, address) == 1) {
+        *family = AF_INET;
+        *prefixLength = 32;
+    } else if (inet_pton(AF_INET6, addressPart, address) == 1) {
+        *family = AF_INET6;
+        *prefixLength = 128;
+    } else {
+        return -1;
+    }
+    if (hasPrefix) {
+        char *endptr = NULL;
+        long parsedPrefix = strtol(prefixPart, &endptr, 10);
+        if (*prefixPart == '\0' || *endptr != '\0' || parsedPrefix < 0 || parsedPrefix > *prefixLength) {
+            return -1;
+        }
+        *prefixLength = parsedPrefix;
+    }
+    return 0;
 }
 
-static int setMasterOfInterface(int netlinkSocket, char* interface, char* master) {
-    // TODO: Do this without using the iproute2 tool (use rtnetlink directly?)
-    ALLOC_LOCAL_FORMAT_STRING(command, "ip link set %s master %s", interface, master);
-    return system(command);
+int offsetAddress(const char* address, unsigned int offset, char* output, size_t outputSize) {
+    int family;
+    unsigned char addressBytes[16];
+    unsigned char prefixLength;
+    if (parseAddress(address, &family, addressBytes, &prefixLength) != 0) {
+        return -1;
+    }
+    // Add the offset to the address as a big-endian number, then make sure that the prefix did not change
+    unsigned char offsetBytes[16];
+    memcpy(offsetBytes, addressBytes, sizeof(offsetBytes));
+    int addressSize = (family == AF_INET) ? 4 : 16;
+    unsigned long carry = offset;
+    for (int i = addressSize - 1; i >= 0 && carry > 0; i--) {
+        carry += offsetBytes[i];
+        offsetBytes[i] = carry & 0xff;
+        carry >>= 8;
+    }
+    if (carry > 0) {
+        return -1;
+    }
+    for (int bit = 0; bit < prefixLength; bit++) {
+        unsigned char mask = 0x80 >> (bit % 8);
+        if ((addressBytes[bit / 8] & mask) != (offsetBytes[bit / 8] & mask)) {
+            return -1;
+        }
+    }
+    char addressText[INET6_ADDRSTRLEN];
+    if (inet_ntop(family, offsetBytes, addressText, sizeof(addressText)) == NULL) {
+        return -1;
+    }
+    int written = snprintf(output, outputSize, "%s/%d", addressText, prefixLength);
+    return (written < 0 || (size_t) written >= outputSize) ? -1 : 0;
+}
+
+/// @brief Adds the queue count, MTU and TX queue length from the container parameters to a link being created.
+/// Options which are not set are left out, so the kernel defaults apply.
+static void addVethTuningAttributes(struct netlinkBatch *batch, const struct tinyjailContainerParams *params) {
+    if (params->networkQueueCount > 0) {
+        unsigned int queueCount = params->networkQueueCount;
+        netlinkAddAttribute(batch, IFLA_NUM_TX_QUEUES, &queueCount, sizeof(queueCount));
+        netlinkAddAttribute(batch, IFLA_NUM_RX_QUEUES, &queueCount, sizeof(queueCount));
+    }
+    if (params->networkMtu > 0) {
+        unsigned int mtu = params->networkMtu;
+        netlinkAddAttribute(batch, IFLA_MTU, &mtu, sizeof(mtu));
+    }
+    if (params->networkTxQueueLength > 0) {
+        unsigned int txQueueLength = params->networkTxQueueLength;
+        netlinkAddAttribute(batch, IFLA_TXQLEN, &txQueueLength, sizeof(txQueueLength));
+    }
 }
 
-static int enableInterface(int netlinkSocket, char* interface) {
-    // TODO: Do this without using the iproute2 tool (use rtnetlink directly?)
-    ALLOC_LOCAL_FORMAT_STRING(command, "ip link set %s up", interface);
-    return system(command);
+static void createVethPair(
+    struct netlinkBatch *batch,
+    char* if1,
+    char* if2,
+    const struct tinyjailContainerParams *params
+) {
+    ALLOC_LOCAL_FORMAT_STRING(description, "Creating vEth pair %s-%s", if1, if2);
+    // The interface indices are left to the kernel. A new namespace can already hold fallback tunnel devices
+    // (e.g. with ipip or sit loaded and net.core.fb_tunnels_only_for_init_net=0), so no index is known to be free.
+    struct ifinfomsg if1Info = { .ifi_family = AF_UNSPEC };
+    struct ifinfomsg if2Info = { .ifi_family = AF_UNSPEC };
+    netlinkBeginMessage(batch, RTM_NEWLINK, NLM_F_CREATE | NLM_F_EXCL, &if1Info, sizeof(if1Info), description);
+    netlinkAddStringAttribute(batch, IFLA_IFNAME, if1);
+    addVethTuningAttributes(batch, params);
+    netlinkBeginNested(batch, IFLA_LINKINFO);
+    netlinkAddStringAttribute(batch, IFLA_INFO_KIND, "veth");
+    netlinkBeginNested(batch, IFLA_INFO_DATA);
+    netlinkBeginNested(batch, VETH_INFO_PEER);
+    netlinkAddRaw(batch, &if2Info, sizeof(if2Info));
+    netlinkAddStringAttribute(batch, IFLA_IFNAME, if2);
+    // The peer is created from the attributes in here only, it does not inherit those of the first interface
+    addVethTuningAttributes(batch, params);
+    netlinkEndNested(batch);
+    netlinkEndNested(batch);
+    netlinkEndNested(batch);
 }
 
-static int moveInterfaceToNamespaceByFd(int netlinkSocket, const char* procfsPath, char* interface, int fd) {
-    // TODO: Do this without using the iproute2 tool (use rtnetlink directly?)
-    ALLOC_LOCAL_FORMAT_STRING(command, "ip link set %s netns %s/self/fd/%d", interface, procfsPath, fd);
-    return system(command);
+/// @brief Turns on GRO for an interface. On a vEth, this also makes the receiving side run in NAPI mode,
+/// so packets are batched and aggregated instead of being handed up the stack one by one.
+/// There is no RTNETLINK attribute for it, so this uses the ethtool ioctl, which any socket in the namespace of the interface can issue.
+static int enableGro(int socketFd, const char* interface, struct tinyjailContainerResult *result) {
+    struct ethtool_value groValue = { .cmd = ETHTOOL_SGRO, .data = 1 };
+    struct ifreq request;
+    memset(&request, 0, sizeof(request));
+    snprintf(request.ifr_name, IFNAMSIZ, "%s", interface);
+    request.ifr_data = (void*) &groValue;
+    if (ioctl(socketFd, SIOCETHTOOL, &request) != 0) {
+        snprintf(result->errorInfo, ERROR_INFO_SIZE, "Enabling GRO on interface %s failed: %s", interface, strerror(errno));
+        return -1;
+    }
+    return 0;
 }
 
-static int addAddressToInterface(int netlinkSocket, char* interface, char* address) {
-    // TODO: Do this without using the iproute2 tool (use rtnetlink directly?)
-    ALLOC_LOCAL_FORMAT_STRING(command, "ip addr add %s dev %s", address, interface);
-    return system(command);
+/// @brief Creates a macvlan or ipvlan sub-interface of a device in the calling namespace directly in another network namespace.
+static void createSubInterface(
+    struct netlinkBatch *batch,
+    char* interface,
+    char* parent,
+    int parentIndex,
+    int netNsFd,
+    int networkMode
+) {
+    ALLOC_LOCAL_FORMAT_STRING(description, "Creating %s interface %s on %s", networkMode == TINYJAIL_NETWORK_MACVLAN ? "macvlan" : "ipvlan", interface, parent);
+    // The interface index is left to the kernel, a fixed one would be looked up in the calling namespace
+    struct ifinfomsg interfaceInfo = { .ifi_family = AF_UNSPEC };
+    unsigned int parentIndexAttr = parentIndex;
+    unsigned int netNsFdAttr = netNsFd;
+    netlinkBeginMessage(batch, RTM_NEWLINK, NLM_F_CREATE | NLM_F_EXCL, &interfaceInfo, sizeof(interfaceInfo), description);
+    netlinkAddStringAttribute(batch, IFLA_IFNAME, interface);
+    netlinkAddAttribute(batch, IFLA_LINK, &parentIndexAttr, sizeof(parentIndexAttr));
+    netlinkAddAttribute(batch, IFLA_NET_NS_FD, &netNsFdAttr, sizeof(netNsFdAttr));
+    netlinkBeginNested(batch, IFLA_LINKINFO);
+    if (networkMode == TINYJAIL_NETWORK_MACVLAN) {
+        // Bridge mode, so that containers on the same parent reach each other without going through the parent device
+        unsigned int macvlanMode = MACVLAN_MODE_BRIDGE;
+        netlinkAddStringAttribute(batch, IFLA_INFO_KIND, "macvlan");
+        netlinkBeginNested(batch, IFLA_INFO_DATA);
+        netlinkAddAttribute(batch, IFLA_MACVLAN_MODE, &macvlanMode, sizeof(macvlanMode));
+    } else {
+        unsigned short ipvlanMode = (networkMode == TINYJAIL_NETWORK_IPVLAN_L3) ? IPVLAN_MODE_L3 : IPVLAN_MODE_L2;
+        netlinkAddStringAttribute(batch, IFLA_INFO_KIND, "ipvlan");
+        netlinkBeginNested(batch, IFLA_INFO_DATA);
+        netlinkAddAttribute(batch, IFLA_IPVLAN_MODE, &ipvlanMode, sizeof(ipvlanMode));
+    }
+    netlinkEndNested(batch);
+    netlinkEndNested(batch);
 }
 
-static int addDefaultRouteToInterface(int netlinkSocket, char* targetAddress, char* targetInterface) {
-    // TODO: Do this without using the iproute2 tool (use rtnetlink directly?)
-    ALLOC_LOCAL_FORMAT_STRING(command, "ip route add default via %s dev %s", targetAddress, targetInterface);
-    return system(command);
+static void setMasterOfInterface(struct netlinkBatch *batch, char* interface, int interfaceIndex, char* master, int masterIndex) {
+    ALLOC_LOCAL_FORMAT_STRING(description, "Attaching interface %s to %s", interface, master);
+    struct ifinfomsg interfaceInfo = { .ifi_family = AF_UNSPEC, .ifi_index = interfaceIndex };
+    unsigned int masterIndexAttr = masterIndex;
+    netlinkBeginMessage(batch, RTM_SETLINK, 0, &interfaceInfo, sizeof(interfaceInfo), description);
+    netlinkAddAttribute(batch, IFLA_MASTER, &masterIndexAttr, sizeof(masterIndexAttr));
 }
 
+static void enableInterface(struct netlinkBatch *batch, char* interface, int interfaceIndex) {
+    ALLOC_LOCAL_FORMAT_STRING(description, "Enabling interface %s", interface);
+    struct ifinfomsg interfaceInfo = {
+        .ifi_family = AF_UNSPEC,
+        .ifi_index = interfaceIndex,
+        .ifi_flags = IFF_UP,
+        .ifi_change = IFF_UP
+    };
+    netlinkBeginMessage(batch, RTM_SETLINK, 0, &interfaceInfo, sizeof(interfaceInfo), description);
+}
+
+/// @brief Moves an interface to another network namespace. The interface is looked up by name, so this can be
+/// batched together with the request that creates it.
+static void moveInterfaceToNamespaceByFd(struct netlinkBatch *batch, char* interface, int fd) {
+    ALLOC_LOCAL_FORMAT_STRING(description, "Moving interface %s to another network namespace", interface);
+    struct ifinfomsg interfaceInfo = { .ifi_family = AF_UNSPEC };
+    unsigned int fdAttr = fd;
+    netlinkBeginMessage(batch, RTM_SETLINK, 0, &interfaceInfo, sizeof(interfaceInfo), description);
+    netlinkAddStringAttribute(batch, IFLA_IFNAME, interface);
+    netlinkAddAttribute(batch, IFLA_NET_NS_FD, &fdAttr, sizeof(fdAttr));
+}
+
+static int addAddressToInterface(struct netlinkBatch *batch, char* interface, int interfaceIndex, char* address) {
+    ALLOC_LOCAL_FORMAT_STRING(description, "Adding address %s to interface %s", address, interface);
+    int family;
+    unsigned char addressBytes[16];
+    unsigned char prefixLength;
+    if (parseAddress(address, &family, addressBytes, &prefixLength) != 0) {
+        return -1;
+    }
+    size_t addressSize = (family == AF_INET) ? 4 : 16;
+    struct ifaddrmsg addressInfo = {
+        .ifa_family = family,
+        .ifa_prefixlen = prefixLength,
+        .ifa_scope = RT_SCOPE_UNIVERSE,
+        .ifa_index = interfaceIndex
+    };
+    netlinkBeginMessage(batch, RTM_NEWADDR, NLM_F_CREATE | NLM_F_EXCL, &addressInfo, sizeof(addressInfo), description);
+    netlinkAddAttribute(batch, IFA_LOCAL, addressBytes, addressSize);
+    netlinkAddAttribute(batch, IFA_ADDRESS, addressBytes, addressSize);
+    return 0;
+}
+
+static int addDefaultRouteToInterface(struct netlinkBatch *batch, char* targetAddress, char* targetInterface, int targetInterfaceIndex) {
+    ALLOC_LOCAL_FORMAT_STRING(description, "Adding default route via %s to interface %s", targetAddress, targetInterface);
+    int family;
+    unsigned char addressBytes[16];
+    unsigned char prefixLength;
+    if (parseAddress(targetAddress, &family, addressBytes, &prefixLength) != 0) {
+        return -1;
+    }
+    struct rtmsg routeInfo = {
+        .rtm_family = family,
+        .rtm_dst_len = 0,
+        .rtm_table = RT_TABLE_MAIN,
+        .rtm_protocol = RTPROT_BOOT,
+        .rtm_scope = RT_SCOPE_UNIVERSE,
+        .rtm_type = RTN_UNICAST
+    };
+    unsigned int interfaceIndexAttr = targetInterfaceIndex;
+    netlinkBeginMessage(batch, RTM_NEWROUTE, NLM_F_CREATE | NLM_F_EXCL, &routeInfo, sizeof(routeInfo), description);
+    netlinkAddAttribute(batch, RTA_GATEWAY, addressBytes, (family == AF_INET) ? 4 : 16);
+    netlinkAddAttribute(batch, RTA_OIF, &interfaceIndexAttr, sizeof(interfaceIndexAttr));
+    return 0;
+}
+
+/// @brief Creates the network interface of a network namespace (see enum tinyjailNetworkMode) and configures it.
+/// For a vEth pair, this includes the outside end.
+/// @param targetNsFd The network namespace to configure, either as a namespace FD or as a pidfd of a process in it
+/// @param myNetNsFd Network namespace of the calling process, which is where the outside end of a vEth pair goes
 static int configureNetwork(
-    const char* procfsPath,
-    int childPidFd,
+    int targetNsFd,
     int myNetNsFd,
     const struct tinyjailContainerParams *params,
     struct tinyjailContainerResult *result
 ) {
-    // RTNETLINK socket created here and closed when exiting this function
-    RAII_FD netlinkSocket = socket(AF_NETLINK, SOCK_RAW, NETLINK_ROUTE);
-    if (netlinkSocket <= 0) {
-        netlinkSocket = -1;
-        snprintf(result->errorInfo, ERROR_INFO_SIZE, "RTNETLINK socket() failed: %s", strerror(errno));
-        return -1;
-    }
-    struct sockaddr_nl bindInfo = {
-        .nl_family = AF_NETLINK,
-        .nl_pad = 0,
-        .nl_pid = getpid(),
-        .nl_groups = 0
-    };
-    if (bind(netlinkSocket, (struct sockaddr*) &bindInfo, sizeof(bindInfo)) != 0) {
-        snprintf(result->errorInfo, ERROR_INFO_SIZE, "RTNETLINK bind() failed: %s", strerror(errno));
+    // RTNETLINK sockets act on the network namespace they were created in, so we need one on each side.
+    // Both are created here and closed when exiting this function.
+    RAII_FD hostNetlinkSocket = openNetlinkSocket(result);
+    if (hostNetlinkSocket < 0) {
         return -1;
     }
 
     // Create the vEth pair -inside- the container, then move it outside of it by using the parent PID as the namespace PID.
     // This saves us from having to delete the interface to clean up - when the container dies, the interface is automatically cleaned up.
-    ALLOC_LOCAL_FORMAT_STRING(vethNameInside, "i_%s", params->containerId);
+    ALLOC_LOCAL_FORMAT_STRING(interfaceNameInside, "i_%s", params->containerId);
     ALLOC_LOCAL_FORMAT_STRING(vethNameOutside, "o_%s", params->containerId);
+    int useVeth = (params->networkMode == TINYJAIL_NETWORK_VETH);
+
+    // A macvlan or ipvlan interface has no outside end, it is created on the parent device and goes straight into the container
+    int parentIndex = 0;
+    if (!useVeth) {
+        parentIndex = if_nametoindex(params->networkParentDevice);
+        if (parentIndex == 0) {
+            snprintf(result->errorInfo, ERROR_INFO_SIZE, "Could not find parent device %s: %s", params->networkParentDevice, strerror(errno));
+            return -1;
+        }
+    }
 
-    if (setns(childPidFd, CLONE_NEWNET) != 0) {
+    if (setns(targetNsFd, CLONE_NEWNET) != 0) {
         snprintf(result->errorInfo, ERROR_INFO_SIZE, "setns() to enter the container network namespace failed: %s", strerror(errno));
         return -1;
     }
-    if (createVethPair(netlinkSocket, vethNameInside, vethNameOutside) != 0) {
-        snprintf(result->errorInfo, ERROR_INFO_SIZE, "Failed to create vEth pair %s-%s.", vethNameOutside, vethNameInside);
+    RAII_FD containerNetlinkSocket = openNetlinkSocket(result);
+    if (containerNetlinkSocket < 0) {
         return -1;
     }
-    if (moveInterfaceToNamespaceByFd(netlinkSocket, procfsPath, vethNameOutside, myNetNsFd) != 0) {
-        snprintf(result->errorInfo, ERROR_INFO_SIZE, "Failed to move interface %s to outside network namespace.", vethNameOutside);
-        return -1;
+
+    struct netlinkBatch batch;
+    netlinkBatchInit(&batch);
+    if (useVeth) {
+        createVethPair(&batch, interfaceNameInside, vethNameOutside, params);
+        moveInterfaceToNamespaceByFd(&batch, vethNameOutside, myNetNsFd);
+        if (netlinkSendBatch(containerNetlinkSocket, &batch, result) != 0) {
+            return -1;
+        }
+    } else {
+        // The parent device is only visible to the host socket, which needs an FD of the container namespace to create the interface in
+        RAII_FD containerNetNsFd = ioctl(containerNetlinkSocket, SIOCGSKNS);
+        if (containerNetNsFd < 0) {
+            snprintf(result->errorInfo, ERROR_INFO_SIZE, "SIOCGSKNS on the container RTNETLINK socket failed: %s", strerror(errno));
+            return -1;
+        }
+        createSubInterface(&batch, interfaceNameInside, params->networkParentDevice, parentIndex, containerNetNsFd, params->networkMode);
+        if (netlinkSendBatch(hostNetlinkSocket, &batch, result) != 0) {
+            return -1;
+        }
     }
-    if (enableInterface(netlinkSocket, vethNameInside) != 0) {
-        snprintf(result->errorInfo, ERROR_INFO_SIZE, "Failed to enable inside interface %s.", vethNameInside);
+
+    // The kernel picked the index of the inside interface, and the requests below need it
+    int interfaceIndexInside = if_nametoindex(interfaceNameInside);
+    if (interfaceIndexInside == 0) {
+        snprintf(result->errorInfo, ERROR_INFO_SIZE, "Could not find inside interface %s: %s", interfaceNameInside, strerror(errno));
         return -1;
     }
+
+    // Everything else that happens inside the container network namespace goes out as one batch
+    netlinkBatchInit(&batch);
+    enableInterface(&batch, interfaceNameInside, interfaceIndexInside);
     if (params->networkIpAddr) {
-        if (addAddressToInterface(netlinkSocket, vethNameInside, params->networkIpAddr) != 0) {
-            snprintf(result->errorInfo, ERROR_INFO_SIZE, "Could not add address %s to inside interace %s.", params->networkIpAddr, vethNameInside);
+        if (addAddressToInterface(&batch, interfaceNameInside, interfaceIndexInside, params->networkIpAddr) != 0) {
+            snprintf(result->errorInfo, ERROR_INFO_SIZE, "Could not parse address %s for inside interace %s.", params->networkIpAddr, interfaceNameInside);
             return -1;
         }
     }
     if (params->networkDefaultRoute) {
-        if (addDefaultRouteToInterface(netlinkSocket, params->networkDefaultRoute, vethNameInside) != 0) {
-            snprintf(result->errorInfo, ERROR_INFO_SIZE, "Could not add default route %s to inside interace %s.", params->networkDefaultRoute, vethNameInside);
+        if (addDefaultRouteToInterface(&batch, params->networkDefaultRoute, interfaceNameInside, interfaceIndexInside) != 0) {
+            snprintf(result->errorInfo, ERROR_INFO_SIZE, "Could not parse default route %s for inside interace %s.", params->networkDefaultRoute, interfaceNameInside);
             return -1;
         }
     }
+    if (netlinkSendBatch(containerNetlinkSocket, &batch, result) != 0) {
+        return -1;
+    }
+    if (useVeth && params->networkGro && enableGro(containerNetlinkSocket, interfaceNameInside, result) != 0) {
+        return -1;
+    }
     if (setns(myNetNsFd, CLONE_NEWNET) != 0) {
         snprintf(result->errorInfo, ERROR_INFO_SIZE, "setns() to go back to the host network namespace failed: %s", strerror(errno));
         return -1;
     }
+    if (!useVeth) {
+        return 0;
+    }
+
+    // The outside interface may have been renumbered when it was moved, so look up its index in the host namespace.
+    int vethIndexOutside = if_nametoindex(vethNameOutside);
+    if (vethIndexOutside == 0) {
+        snprintf(result->errorInfo, ERROR_INFO_SIZE, "Could not find outside interface %s: %s", vethNameOutside, strerror(errno));
+        return -1;
+    }
+    if (params->networkGro && enableGro(hostNetlinkSocket, vethNameOutside, result) != 0) {
+        return -1;
+    }
 
+    // Everything that happens in the host network namespace goes out as a second batch
+    netlinkBatchInit(&batch);
     if (params->networkPeerIpAddr) {
-        if (addAddressToInterface(netlinkSocket, vethNameOutside, params->networkPeerIpAddr) != 0) {
-            snprintf(result->errorInfo, ERROR_INFO_SIZE, "Could not add address %s to outside interace %s.", params->networkPeerIpAddr, vethNameOutside);
+        if (addAddressToInterface(&batch, vethNameOutside, vethIndexOutside, params->networkPeerIpAddr) != 0) {
+            snprintf(result->errorInfo, ERROR_INFO_SIZE, "Could not parse address %s for outside interace %s.", params->networkPeerIpAddr, vethNameOutside);
             return -1;
         }
     }
     if (params->networkBridgeName) {
-        if (setMasterOfInterface(netlinkSocket, vethNameOutside, params->networkBridgeName) != 0) {
-            snprintf(result->errorInfo, ERROR_INFO_SIZE, "Could not attach outside interace %s to bridge %s.", vethNameOutside, params->networkBridgeName);
+        int bridgeIndex = if_nametoindex(params->networkBridgeName);
+        if (bridgeIndex == 0) {
+            snprintf(result->errorInfo, ERROR_INFO_SIZE, "Could not find bridge %s: %s", params->networkBridgeName, strerror(errno));
             return -1;
         }
+        setMasterOfInterface(&batch, vethNameOutside, vethIndexOutside, params->networkBridgeName, bridgeIndex);
     }
-    if (enableInterface(netlinkSocket, vethNameOutside) != 0) {
-        snprintf(result->errorInfo, ERROR_INFO_SIZE, "Failed to enable outside interface %s.", vethNameOutside);
-        return -1;
-    }
-    return 0;
+    enableInterface(&batch, vethNameOutside, vethIndexOutside);
+    return netlinkSendBatch(hostNetlinkSocket, &batch, result);
 }
 
-static int setupContainerNetworkInner(
-    const char* procfsPath,
+int setupContainerNetwork(
     int childPid, 
+    int procfsFd,
     const struct tinyjailContainerParams *params,
     struct tinyjailContainerResult *result
 ) {
-    ALLOC_LOCAL_FORMAT_STRING(myNetNsPath, "%s/self/ns/net", procfsPath);
+    // If we're using the host network namespace, skip network setup completely
+    if (params->useHostNetwork) {
+        return 0;
+    }
+
     // Get a handle on both the inside and outside network namespaces
-    RAII_FD myNetNsFd = open(myNetNsPath, O_RDONLY);
+    RAII_FD myNetNsFd = openat(procfsFd, "self/ns/net", O_RDONLY | O_CLOEXEC);
     if (myNetNsFd < 0) {
         snprintf(result->errorInfo, ERROR_INFO_SIZE, "Could not open network NS from procfs: %s", strerror(errno));
         return -1;
@@ -153,35 +405,109 @@ static int setupContainerNetworkInner(
         snprintf(result->errorInfo, ERROR_INFO_SIZE, "pidfd_open() on child PID failed: %s", strerror(errno));
         return -1;
     }
-    int retval = configureNetwork(params->containerDir, childPidFd, myNetNsFd, params, result);
+    int retval = configureNetwork(childPidFd, myNetNsFd, params, result);
     // Make sure we're in our own network namespace even if we failed
     setns(myNetNsFd, CLONE_NEWNET);
     return retval;
 }
 
-int setupContainerNetwork(
-    int childPid, 
+/// @brief Runs in the helper process of createPooledNetworkNamespace(): moves to a new network namespace and configures it.
+/// @return FD of the new network namespace on success, -1 on failure
+static int setupPooledNetworkNamespace(
+    int procfsFd,
     const struct tinyjailContainerParams *params,
     struct tinyjailContainerResult *result
 ) {
-    // If we're using the host network namespace, skip network setup completely
-    if (params->useHostNetwork) {
-        return 0;
+    RAII_FD hostNetNsFd = openat(procfsFd, "self/ns/net", O_RDONLY | O_CLOEXEC);
+    if (hostNetNsFd < 0) {
+        snprintf(result->errorInfo, ERROR_INFO_SIZE, "Could not open network NS from procfs: %s", strerror(errno));
+        return -1;
+    }
+    if (unshare(CLONE_NEWNET) != 0) {
+        snprintf(result->errorInfo, ERROR_INFO_SIZE, "Unsharing network namespace failed: %s", strerror(errno));
+        return -1;
+    }
+    RAII_FD netNsFd = openat(procfsFd, "self/ns/net", O_RDONLY | O_CLOEXEC);
+    if (netNsFd < 0) {
+        snprintf(result->errorInfo, ERROR_INFO_SIZE, "Could not open network NS from procfs: %s", strerror(errno));
+        return -1;
     }
-    
-    if (mount("proc", params->containerDir, "proc", 0, NULL) != 0) {
-        snprintf(result->errorInfo, ERROR_INFO_SIZE, "Could not mount temporary procfs: %s", strerror(errno));
+    // The namespace belongs to the host user namespace, so container root would lose the right to bind ports below 1024.
+    // Network sysctls act on the namespace of the process that opens them, i.e. the new one.
+    RAII_FD portStartFd = openat(procfsFd, "sys/net/ipv4/ip_unprivileged_port_start", O_WRONLY | O_CLOEXEC);
+    if (portStartFd < 0 || writeAll(portStartFd, "0", 1) != 0) {
+        snprintf(result->errorInfo, ERROR_INFO_SIZE, "Could not set ip_unprivileged_port_start: %s", strerror(errno));
         return -1;
     }
-    int configureUsernsResult = setupContainerNetworkInner(params->containerDir, childPid, params, result);
-    int umount2Result = umount2(params->containerDir, MNT_DETACH);
-    int umount2Errno = errno;
-    if (configureUsernsResult != 0) {
+    // configureNetwork() starts out in the host namespace, like for a container
+    if (setns(hostNetNsFd, CLONE_NEWNET) != 0) {
+        snprintf(result->errorInfo, ERROR_INFO_SIZE, "setns() to go back to the host network namespace failed: %s", strerror(errno));
         return -1;
     }
-    if (umount2Result != 0) {
-        snprintf(result->errorInfo, ERROR_INFO_SIZE, "Could not umount temporary procfs mount: %s", strerror(umount2Errno));
+    if (configureNetwork(netNsFd, hostNetNsFd, params, result) != 0) {
         return -1;
     }
+    int retval = netNsFd;
+    netNsFd = -1;
+    return retval;
+}
+
+/// @brief Arguments of runNetworkNamespaceHelper()
+struct networkNamespaceHelperArgs {
+    int procfsFd;
+    const struct tinyjailContainerParams *params;
+    int reportSocketRead;
+    int reportSocketWrite;
+};
+
+/// @brief Entry point of the helper process of createPooledNetworkNamespace(). It shares the memory of the caller.
+static int runNetworkNamespaceHelper(void* rawArgs) {
+    const struct networkNamespaceHelperArgs *args = rawArgs;
+    close(args->reportSocketRead);
+    struct tinyjailContainerResult helperResult = {0};
+    int netNsFd = setupPooledNetworkNamespace(args->procfsFd, args->params, &helperResult);
+    sendWithFds(args->reportSocketWrite, &helperResult, sizeof(helperResult), &netNsFd, netNsFd >= 0 ? 1 : 0);
     return 0;
 }
+
+int createPooledNetworkNamespace(
+    const struct tinyjailContainerParams *params,
+    struct tinyjailContainerResult *result
+) {
+    RAII_FD procfsFd = openSharedDetachedMount("proc", result);
+    if (procfsFd < 0) {
+        return -1;
+    }
+    // Unsharing the network namespace in the caller would move the calling thread, so this happens in a helper process
+    int reportSocket[2] = { -1, -1 };
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, reportSocket) != 0) {
+        snprintf(result->errorInfo, ERROR_INFO_SIZE, "socketpair() failed: %s", strerror(errno));
+        return -1;
+    }
+    RAII_FD reportSocketRead = reportSocket[0];
+    RAII_FD reportSocketWrite = reportSocket[1];
+    struct networkNamespaceHelperArgs helperArgs = {
+        .procfsFd = procfsFd,
+        .params = params,
+        .reportSocketRead = reportSocketRead,
+        .reportSocketWrite = reportSocketWrite
+    };
+    if (runInSharedMemoryProcess(runNetworkNamespaceHelper, &helperArgs) != 0) {
+        snprintf(result->errorInfo, ERROR_INFO_SIZE, "clone() of the network namespace helper failed: %s", strerror(errno));
+        return -1;
+    }
+    closep(&reportSocketWrite);
+    struct tinyjailContainerResult helperResult;
+    int netNsFd = -1;
+    int fdCount = receiveWithFds(reportSocketRead, &helperResult, sizeof(helperResult), &netNsFd, 1);
+    int receiveErrno = errno;
+    if (fdCount < 0) {
+        snprintf(result->errorInfo, ERROR_INFO_SIZE, "Could not read() result back from network namespace helper: %s", strerror(receiveErrno));
+        return -1;
+    }
+    if (fdCount != 1) {
+        memcpy(result->errorInfo, helperResult.errorInfo, ERROR_INFO_SIZE);
+        return -1;
+    }
+    return netNsFd;
+}
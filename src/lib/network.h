@@ -6,11 +6,32 @@
 
 /// @brief Sets up the network of the container.
 /// @param childPid PID of the container process
+/// @param procfsFd FD of the root directory of a procfs mount
 /// @param params Container parameters
 /// @param result Result object passed back to the library caller
-/// @return 
+/// @return 0 on success, -1 on failure
 int setupContainerNetwork(
     int childPid, 
+    int procfsFd,
+    const struct tinyjailContainerParams *params,
+    struct tinyjailContainerResult *result
+);
+
+/// @brief Adds an offset to an address in the form "<address>[/<prefix length>]", e.g. 10.0.0.2/24 with offset 3 gives 10.0.0.5/24.
+/// @param address The address, IPv4 or IPv6
+/// @param offset Number to add to the address
+/// @param output Output: the resulting address, with the same prefix length
+/// @param outputSize Size of output
+/// @return 0 on success, -1 if the address is invalid or the result would leave its prefix
+int offsetAddress(const char* address, unsigned int offset, char* output, size_t outputSize);
+
+/// @brief Creates a network namespace for a tinyjailNetworkPool, with the vEth pair set up from the network parameters
+/// (bridge, addresses, default route and vEth tuning) exactly like for a container. The outside end of the pair is named after params->containerId.
+/// The namespace belongs to the host user namespace, so containers which join it cannot change its configuration.
+/// @param params Network parameters, with containerId set
+/// @param result Result object passed back to the library caller
+/// @return FD of the network namespace on success, -1 on failure
+int createPooledNetworkNamespace(
     const struct tinyjailContainerParams *params,
     struct tinyjailContainerResult *result
 );
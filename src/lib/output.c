@@ -0,0 +1,168 @@
+// SPDX-License-Identifier: MIT
+
+// _GNU_SOURCE is needed for splice(), pipe2() and memfd_create()
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "output.h"
+#include "utils.h"
+
+// Ring buffer size if the container parameters do not set one
+#define DEFAULT_OUTPUT_RING_SIZE (1024 * 1024)
+
+static int openStream(
+    int mode,
+    const char* path,
+    const char* name,
+    struct containerOutput *output,
+    int stream,
+    struct tinyjailContainerResult *result
+) {
+#define RETURN_WITH_ERROR(...) { snprintf(result->errorInfo, ERROR_INFO_SIZE, __VA_ARGS__); return -1; }
+    switch (mode) {
+    case TINYJAIL_OUTPUT_INHERIT:
+        return 0;
+    case TINYJAIL_OUTPUT_FILE:
+        if (path == NULL) {
+            RETURN_WITH_ERROR("containerParams must set a path for the %s file.", name);
+        }
+        output->containerFds[stream] = open(path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+        if (output->containerFds[stream] < 0) {
+            RETURN_WITH_ERROR("Could not open %s file %s: %s", name, path, strerror(errno));
+        }
+        return 0;
+    case TINYJAIL_OUTPUT_MEMFD:
+        // The container writes straight into the memfd, so the data is never copied at all
+        output->captureFds[stream] = memfd_create(name, MFD_CLOEXEC);
+        if (output->captureFds[stream] < 0) {
+            RETURN_WITH_ERROR("memfd_create() for %s failed: %s", name, strerror(errno));
+        }
+        output->containerFds[stream] = fcntl(output->captureFds[stream], F_DUPFD_CLOEXEC, 0);
+        if (output->containerFds[stream] < 0) {
+            RETURN_WITH_ERROR("Could not duplicate %s memfd: %s", name, strerror(errno));
+        }
+        return 0;
+    case TINYJAIL_OUTPUT_RING: {
+        output->captureFds[stream] = memfd_create(name, MFD_CLOEXEC);
+        if (output->captureFds[stream] < 0) {
+            RETURN_WITH_ERROR("memfd_create() for %s failed: %s", name, strerror(errno));
+        }
+        int outputPipe[2] = { -1, -1 };
+        if (pipe2(outputPipe, O_CLOEXEC) != 0) {
+            RETURN_WITH_ERROR("pipe() for %s failed: %s", name, strerror(errno));
+        }
+        output->pipeFds[stream] = outputPipe[0];
+        output->containerFds[stream] = outputPipe[1];
+        output->ringBuffered[stream] = 1;
+        return 0;
+    }
+    default:
+        RETURN_WITH_ERROR("Unknown output mode %d for %s.", mode, name);
+    }
+#undef RETURN_WITH_ERROR
+}
+
+int openContainerOutput(
+    const struct tinyjailContainerParams *containerParams,
+    struct containerOutput *output,
+    struct tinyjailContainerResult *result
+) {
+    memset(output, 0, sizeof(*output));
+    for (int stream = 0; stream < OUTPUT_STREAM_COUNT; stream++) {
+        output->containerFds[stream] = -1;
+        output->captureFds[stream] = -1;
+        output->pipeFds[stream] = -1;
+    }
+    output->ringSize = containerParams->outputRingSize > 0 ? containerParams->outputRingSize : DEFAULT_OUTPUT_RING_SIZE;
+    if (openStream(containerParams->stdoutMode, containerParams->stdoutPath, "stdout", output, OUTPUT_STREAM_STDOUT, result) != 0) {
+        releaseContainerOutput(output);
+        return -1;
+    }
+    if (containerParams->stderrMode == TINYJAIL_OUTPUT_STDOUT) {
+        // Both streams share the destination, and the output is only captured once
+        if (containerParams->stdoutMode != TINYJAIL_OUTPUT_INHERIT) {
+            output->containerFds[OUTPUT_STREAM_STDERR] = fcntl(output->containerFds[OUTPUT_STREAM_STDOUT], F_DUPFD_CLOEXEC, 0);
+            if (output->containerFds[OUTPUT_STREAM_STDERR] < 0) {
+                snprintf(result->errorInfo, ERROR_INFO_SIZE, "Could not duplicate stdout FD: %s", strerror(errno));
+                releaseContainerOutput(output);
+                return -1;
+            }
+        }
+        return 0;
+    }
+    if (openStream(containerParams->stderrMode, containerParams->stderrPath, "stderr", output, OUTPUT_STREAM_STDERR, result) != 0) {
+        releaseContainerOutput(output);
+        return -1;
+    }
+    return 0;
+}
+
+int drainContainerOutput(struct containerOutput *output, int stream) {
+    while (output->pipeFds[stream] >= 0) {
+        // Fill the ring buffer up to its end, then wrap around to the start and overwrite the oldest output
+        off_t offset = output->ringWritten[stream] % output->ringSize;
+        ssize_t moved = splice(
+            output->pipeFds[stream], NULL,
+            output->captureFds[stream], &offset,
+            output->ringSize - offset,
+            SPLICE_F_MOVE | SPLICE_F_NONBLOCK
+        );
+        if (moved > 0) {
+            output->ringWritten[stream] += moved;
+        } else if (moved < 0 && errno == EINTR) {
+            continue;
+        } else if (moved < 0 && errno == EAGAIN) {
+            return 0;
+        } else {
+            // End of the stream, or an error we cannot do anything about
+            return 1;
+        }
+    }
+    return 1;
+}
+
+void finishContainerOutput(struct containerOutput *output, int stream, struct tinyjailCapturedOutput *captured) {
+    memset(captured, 0, sizeof(*captured));
+    captured->fd = -1;
+    if (output->captureFds[stream] < 0) {
+        return;
+    }
+    if (output->ringBuffered[stream]) {
+        drainContainerOutput(output, stream);
+        closep(&output->pipeFds[stream]);
+        uint64_t written = output->ringWritten[stream];
+        captured->size = written < output->ringSize ? written : output->ringSize;
+        captured->offset = written > 0 ? written % captured->size : 0;
+        captured->droppedBytes = written - captured->size;
+    } else {
+        struct stat captureStat;
+        if (fstat(output->captureFds[stream], &captureStat) == 0) {
+            captured->size = captureStat.st_size;
+        }
+    }
+    captured->fd = output->captureFds[stream];
+    output->captureFds[stream] = -1;
+}
+
+void moveContainerOutput(struct containerOutput *to, struct containerOutput *from) {
+    *to = *from;
+    for (int stream = 0; stream < OUTPUT_STREAM_COUNT; stream++) {
+        from->containerFds[stream] = -1;
+        from->captureFds[stream] = -1;
+        from->pipeFds[stream] = -1;
+    }
+}
+
+void releaseContainerOutput(struct containerOutput *output) {
+    for (int stream = 0; stream < OUTPUT_STREAM_COUNT; stream++) {
+        closep(&output->containerFds[stream]);
+        closep(&output->captureFds[stream]);
+        closep(&output->pipeFds[stream]);
+    }
+}
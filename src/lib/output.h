@@ -0,0 +1,59 @@
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include <stdint.h>
+
+#include "tinyjail.h"
+
+#define OUTPUT_STREAM_STDOUT (0)
+#define OUTPUT_STREAM_STDERR (1)
+#define OUTPUT_STREAM_COUNT (2)
+
+/// @brief Output routing of a container, set up by the library caller when the container is prepared.
+struct containerOutput {
+    /// @brief FDs the container process gets as stdout and stderr, -1 to inherit the caller's.
+    /// They are only needed until the launcher is forked.
+    int containerFds[OUTPUT_STREAM_COUNT];
+    /// @brief memfds which keep the captured output (TINYJAIL_OUTPUT_MEMFD and TINYJAIL_OUTPUT_RING), -1 otherwise
+    int captureFds[OUTPUT_STREAM_COUNT];
+    /// @brief Read ends of the pipes which feed the ring buffers (TINYJAIL_OUTPUT_RING), -1 otherwise or once the pipe is drained
+    int pipeFds[OUTPUT_STREAM_COUNT];
+    /// @brief Set for the streams which go to a ring buffer
+    int ringBuffered[OUTPUT_STREAM_COUNT];
+    /// @brief Size of the ring buffers
+    uint64_t ringSize;
+    /// @brief Total number of bytes moved into each ring buffer
+    uint64_t ringWritten[OUTPUT_STREAM_COUNT];
+};
+
+/// @brief Opens the files, memfds and pipes the container parameters ask for.
+/// @param containerParams Container parameters
+/// @param output Output: the output routing. It must be released with releaseContainerOutput().
+/// @param result Result object passed back to the library caller
+/// @return 0 on success, -1 on failure
+int openContainerOutput(
+    const struct tinyjailContainerParams *containerParams,
+    struct containerOutput *output,
+    struct tinyjailContainerResult *result
+);
+
+/// @brief Moves everything that is currently in a ring buffer pipe into the ring buffer, without blocking.
+/// The data is moved with splice(), so it never passes through a userspace buffer.
+/// @param output The output routing
+/// @param stream OUTPUT_STREAM_STDOUT or OUTPUT_STREAM_STDERR
+/// @return 1 if the pipe has no writers left (or the stream has no pipe), 0 otherwise
+int drainContainerOutput(struct containerOutput *output, int stream);
+
+/// @brief Drains the ring buffer pipes one last time and describes the captured output of a stream.
+/// The memfd of the stream is handed over to captured (it is no longer owned by output).
+/// @param output The output routing
+/// @param stream OUTPUT_STREAM_STDOUT or OUTPUT_STREAM_STDERR
+/// @param captured Output: the captured output of the stream, with fd set to -1 if nothing was captured
+void finishContainerOutput(struct containerOutput *output, int stream, struct tinyjailCapturedOutput *captured);
+
+/// @brief Closes all FDs of the output routing. Safe to call more than once.
+void releaseContainerOutput(struct containerOutput *output);
+
+/// @brief Hands the FDs of an output routing over to another one. Afterwards, releasing the source does nothing.
+void moveContainerOutput(struct containerOutput *to, struct containerOutput *from);
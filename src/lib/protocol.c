@@ -0,0 +1,358 @@
+// SPDX-License-Identifier: MIT
+
+#include <errno.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "protocol.h"
+#include "utils.h"
+
+// Tags the start of every request and response, so that a client speaking something else is noticed right away
+#define DAEMON_PROTOCOL_MAGIC (0x64696a74)
+// Upper bound for the size of the strings of a request, so a corrupt header cannot make the daemon allocate huge amounts of memory
+#define MAX_REQUEST_STRINGS_SIZE (16 * 1024 * 1024)
+
+/// @brief The optional string fields of tinyjailContainerParams, in the order they are sent in
+static const size_t stringFieldOffsets[] = {
+    offsetof(struct tinyjailContainerParams, containerId),
+    offsetof(struct tinyjailContainerParams, containerDir),
+    offsetof(struct tinyjailContainerParams, workDir),
+    offsetof(struct tinyjailContainerParams, networkBridgeName),
+    offsetof(struct tinyjailContainerParams, networkIpAddr),
+    offsetof(struct tinyjailContainerParams, networkPeerIpAddr),
+    offsetof(struct tinyjailContainerParams, networkDefaultRoute),
+    offsetof(struct tinyjailContainerParams, networkParentDevice),
+    offsetof(struct tinyjailContainerParams, hostname),
+    offsetof(struct tinyjailContainerParams, rootfsUpperDir),
+    offsetof(struct tinyjailContainerParams, rootfsWorkDir),
+    offsetof(struct tinyjailContainerParams, stdoutPath),
+    offsetof(struct tinyjailContainerParams, stderrPath),
+    offsetof(struct tinyjailContainerParams, parentCgroup),
+};
+#define STRING_FIELD_COUNT (sizeof(stringFieldOffsets) / sizeof(stringFieldOffsets[0]))
+
+/// @brief The NULL-terminated string list fields of tinyjailContainerParams, in the order they are sent in
+static const size_t listFieldOffsets[] = {
+    offsetof(struct tinyjailContainerParams, commandList),
+    offsetof(struct tinyjailContainerParams, environment),
+    offsetof(struct tinyjailContainerParams, cgroupOptions),
+    offsetof(struct tinyjailContainerParams, rootfsLowerDirs),
+    offsetof(struct tinyjailContainerParams, parentCgroupOptions),
+};
+#define LIST_FIELD_COUNT (sizeof(listFieldOffsets) / sizeof(listFieldOffsets[0]))
+
+#define PARAMS_FIELD(PARAMS, OFFSET, TYPE) (*(TYPE*) (((char*) (PARAMS)) + (OFFSET)))
+
+/// @brief Precedes the strings of a request. The strings follow back-to-back, each NULL-terminated:
+/// first the present string fields, then the entries of each list.
+struct daemonRequestHeader {
+    uint32_t magic;
+    uint32_t stringsSize;
+    uint64_t requestId;
+    int64_t uid;
+    int64_t gid;
+    int64_t timeoutMilliseconds;
+    int64_t cpuCount;
+    int32_t useHostNetwork;
+    int32_t stdoutMode;
+    int32_t stderrMode;
+    int64_t outputRingSize;
+    int32_t seccompProfile;
+    int32_t idmapRootfs;
+    int32_t networkMode;
+    int32_t networkQueueCount;
+    int32_t networkMtu;
+    int32_t networkTxQueueLength;
+    int32_t networkGro;
+    /// @brief pressureTriggers, as stall time, window and full flag of each resource. The daemon only counts how often they fire.
+    int64_t pressureTriggers[TINYJAIL_PRESSURE_RESOURCE_COUNT][3];
+    /// @brief Bit i is set if the i-th string field is not NULL
+    uint32_t presentStrings;
+    uint32_t listLengths[LIST_FIELD_COUNT];
+};
+
+/// @brief Sent back for every request. The memfds of captured output (if any) are passed along with it, stdout first.
+struct daemonResponse {
+    uint32_t magic;
+    uint32_t reserved;
+    uint64_t requestId;
+    struct tinyjailContainerResultEx resultEx;
+};
+
+int tinyjailDaemonConnect(
+    const char* socketPath,
+    struct tinyjailContainerResult *result
+) {
+#define RETURN_WITH_ERROR(...) { result->containerStartedStatus = -1; snprintf(result->errorInfo, ERROR_INFO_SIZE, __VA_ARGS__); return -1; }
+    struct sockaddr_un address = { .sun_family = AF_UNIX };
+    if (strlen(socketPath) >= sizeof(address.sun_path)) {
+        RETURN_WITH_ERROR("Daemon socket path %s is too long.", socketPath);
+    }
+    strcpy(address.sun_path, socketPath);
+    RAII_FD daemonFd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (daemonFd < 0) {
+        RETURN_WITH_ERROR("socket() failed: %s", strerror(errno));
+    }
+    if (connect(daemonFd, (struct sockaddr*) &address, sizeof(address)) != 0) {
+        RETURN_WITH_ERROR("Could not connect to daemon at %s: %s", socketPath, strerror(errno));
+    }
+    int connectedFd = daemonFd;
+    daemonFd = -1;
+    return connectedFd;
+#undef RETURN_WITH_ERROR
+}
+
+int tinyjailDaemonSubmit(
+    int daemonFd,
+    uint64_t requestId,
+    struct tinyjailContainerParams programArgs
+) {
+    // The daemon could only sample into an FD of its own
+    if (programArgs.telemetryIntervalMilliseconds > 0) {
+        errno = ENOTSUP;
+        return -1;
+    }
+    struct daemonRequestHeader header = {
+        .magic = DAEMON_PROTOCOL_MAGIC,
+        .requestId = requestId,
+        .uid = programArgs.uid,
+        .gid = programArgs.gid,
+        .timeoutMilliseconds = programArgs.timeoutMilliseconds,
+        .cpuCount = programArgs.cpuCount,
+        .useHostNetwork = programArgs.useHostNetwork,
+        .stdoutMode = programArgs.stdoutMode,
+        .stderrMode = programArgs.stderrMode,
+        .outputRingSize = programArgs.outputRingSize,
+        .seccompProfile = programArgs.seccompProfile,
+        .idmapRootfs = programArgs.idmapRootfs,
+        .networkMode = programArgs.networkMode,
+        .networkQueueCount = programArgs.networkQueueCount,
+        .networkMtu = programArgs.networkMtu,
+        .networkTxQueueLength = programArgs.networkTxQueueLength,
+        .networkGro = programArgs.networkGro
+    };
+    for (int resource = 0; resource < TINYJAIL_PRESSURE_RESOURCE_COUNT; resource++) {
+        header.pressureTriggers[resource][0] = programArgs.pressureTriggers[resource].stallMicroseconds;
+        header.pressureTriggers[resource][1] = programArgs.pressureTriggers[resource].windowMicroseconds;
+        header.pressureTriggers[resource][2] = programArgs.pressureTriggers[resource].full;
+    }
+    size_t stringsSize = 0;
+    for (size_t i = 0; i < STRING_FIELD_COUNT; i++) {
+        char* string = PARAMS_FIELD(&programArgs, stringFieldOffsets[i], char*);
+        if (string != NULL) {
+            header.presentStrings |= (1u << i);
+            stringsSize += strlen(string) + 1;
+        }
+    }
+    for (size_t i = 0; i < LIST_FIELD_COUNT; i++) {
+        char** list = PARAMS_FIELD(&programArgs, listFieldOffsets[i], char**);
+        for (; list != NULL && list[header.listLengths[i]] != NULL; header.listLengths[i]++) {
+            stringsSize += strlen(list[header.listLengths[i]]) + 1;
+        }
+    }
+    if (stringsSize > MAX_REQUEST_STRINGS_SIZE) {
+        errno = E2BIG;
+        return -1;
+    }
+    header.stringsSize = stringsSize;
+
+    // Assemble the whole request first, so that it goes out in as few writes as possible
+    char* message = malloc(sizeof(header) + stringsSize);
+    if (message == NULL) {
+        return -1;
+    }
+    memcpy(message, &header, sizeof(header));
+    char* current = message + sizeof(header);
+    for (size_t i = 0; i < STRING_FIELD_COUNT; i++) {
+        char* string = PARAMS_FIELD(&programArgs, stringFieldOffsets[i], char*);
+        if (string != NULL) {
+            current = stpcpy(current, string) + 1;
+        }
+    }
+    for (size_t i = 0; i < LIST_FIELD_COUNT; i++) {
+        char** list = PARAMS_FIELD(&programArgs, listFieldOffsets[i], char**);
+        for (uint32_t j = 0; j < header.listLengths[i]; j++) {
+            current = stpcpy(current, list[j]) + 1;
+        }
+    }
+    int retval = writeAll(daemonFd, message, sizeof(header) + stringsSize);
+    free(message);
+    return retval;
+}
+
+int tinyjailDaemonReceive(
+    int daemonFd,
+    uint64_t *requestId,
+    struct tinyjailContainerResultEx *resultEx
+) {
+    struct daemonResponse response;
+    int capturedFds[2] = { -1, -1 };
+    int fdCount = receiveWithFds(daemonFd, &response, sizeof(response), capturedFds, 2);
+    if (fdCount < 0) {
+        return -1;
+    }
+    // The FD numbers in the response are the daemon's, replace them with the received FDs
+    int expectedFdCount = (response.resultEx.capturedStdout.fd >= 0) + (response.resultEx.capturedStderr.fd >= 0);
+    if (response.magic != DAEMON_PROTOCOL_MAGIC || fdCount != expectedFdCount) {
+        for (int i = 0; i < fdCount; i++) {
+            closep(&capturedFds[i]);
+        }
+        errno = EPROTO;
+        return -1;
+    }
+    int nextFd = 0;
+    if (response.resultEx.capturedStdout.fd >= 0) {
+        response.resultEx.capturedStdout.fd = capturedFds[nextFd++];
+    }
+    if (response.resultEx.capturedStderr.fd >= 0) {
+        response.resultEx.capturedStderr.fd = capturedFds[nextFd++];
+    }
+    *requestId = response.requestId;
+    // Only copy the fields which exist in the caller's version of the struct
+    if (resultEx->version > TINYJAIL_RESULT_EX_VERSION) {
+        resultEx->version = TINYJAIL_RESULT_EX_VERSION;
+    }
+    resultEx->resourceUsageAvailable = response.resultEx.resourceUsageAvailable;
+    resultEx->result = response.resultEx.result;
+    resultEx->resourceUsage = response.resultEx.resourceUsage;
+    if (resultEx->version >= 2) {
+        memcpy(resultEx->launchTimings, response.resultEx.launchTimings, sizeof(resultEx->launchTimings));
+    }
+    if (resultEx->version >= 3) {
+        resultEx->timedOut = response.resultEx.timedOut;
+    }
+    if (resultEx->version >= 4) {
+        resultEx->capturedStdout = response.resultEx.capturedStdout;
+        resultEx->capturedStderr = response.resultEx.capturedStderr;
+    } else {
+        for (int i = 0; i < fdCount; i++) {
+            closep(&capturedFds[i]);
+        }
+    }
+    if (resultEx->version >= 5) {
+        resultEx->pressureAvailable = response.resultEx.pressureAvailable;
+        memcpy(resultEx->pressure, response.resultEx.pressure, sizeof(resultEx->pressure));
+        memcpy(resultEx->pressureTriggerEvents, response.resultEx.pressureTriggerEvents, sizeof(resultEx->pressureTriggerEvents));
+    }
+    return 0;
+}
+
+/// @brief Returns the string at current and moves current past it, or NULL if there are no strings left.
+static char* nextString(char** current, char* end) {
+    if (*current >= end) {
+        return NULL;
+    }
+    char* string = *current;
+    *current += strlen(string) + 1;
+    return string;
+}
+
+int readDaemonRequest(int fd, struct daemonRequest *request) {
+    struct daemonRequestHeader header;
+    if (readAll(fd, &header, sizeof(header)) != 0) {
+        return -1;
+    }
+    if (header.magic != DAEMON_PROTOCOL_MAGIC || header.stringsSize > MAX_REQUEST_STRINGS_SIZE) {
+        errno = EPROTO;
+        return -1;
+    }
+    // Every string takes up at least its NULL terminator, which also bounds the number of list pointers
+    uint64_t listEntries = 0;
+    for (size_t i = 0; i < LIST_FIELD_COUNT; i++) {
+        listEntries += header.listLengths[i];
+    }
+    if (listEntries > header.stringsSize) {
+        errno = EPROTO;
+        return -1;
+    }
+    size_t pointersSize = (listEntries + LIST_FIELD_COUNT) * sizeof(char*);
+    // The buffer is one byte longer than the strings and that byte is 0, so walking the strings cannot run off the end
+    char* storage = malloc(pointersSize + header.stringsSize + 1);
+    if (storage == NULL) {
+        return -1;
+    }
+    char* strings = storage + pointersSize;
+    strings[header.stringsSize] = '\0';
+    if (readAll(fd, strings, header.stringsSize) != 0) {
+        free(storage);
+        return -1;
+    }
+
+    memset(request, 0, sizeof(*request));
+    request->requestId = header.requestId;
+    request->storage = storage;
+    request->params.uid = header.uid;
+    request->params.gid = header.gid;
+    request->params.timeoutMilliseconds = header.timeoutMilliseconds;
+    request->params.cpuCount = header.cpuCount;
+    request->params.useHostNetwork = header.useHostNetwork;
+    request->params.stdoutMode = header.stdoutMode;
+    request->params.stderrMode = header.stderrMode;
+    request->params.outputRingSize = header.outputRingSize;
+    request->params.seccompProfile = header.seccompProfile;
+    request->params.idmapRootfs = header.idmapRootfs;
+    request->params.networkMode = header.networkMode;
+    request->params.networkQueueCount = header.networkQueueCount;
+    request->params.networkMtu = header.networkMtu;
+    request->params.networkTxQueueLength = header.networkTxQueueLength;
+    request->params.networkGro = header.networkGro;
+    for (int resource = 0; resource < TINYJAIL_PRESSURE_RESOURCE_COUNT; resource++) {
+        request->params.pressureTriggers[resource].stallMicroseconds = header.pressureTriggers[resource][0];
+        request->params.pressureTriggers[resource].windowMicroseconds = header.pressureTriggers[resource][1];
+        request->params.pressureTriggers[resource].full = header.pressureTriggers[resource][2];
+    }
+    char* current = strings;
+    char* end = strings + header.stringsSize;
+    int missingStrings = 0;
+    for (size_t i = 0; i < STRING_FIELD_COUNT; i++) {
+        if ((header.presentStrings & (1u << i)) != 0) {
+            char* string = nextString(&current, end);
+            missingStrings |= (string == NULL);
+            PARAMS_FIELD(&request->params, stringFieldOffsets[i], char*) = string;
+        }
+    }
+    char** pointers = (char**) storage;
+    for (size_t i = 0; i < LIST_FIELD_COUNT; i++) {
+        PARAMS_FIELD(&request->params, listFieldOffsets[i], char**) = pointers;
+        for (uint32_t j = 0; j < header.listLengths[i]; j++) {
+            char* string = nextString(&current, end);
+            missingStrings |= (string == NULL);
+            *(pointers++) = string;
+        }
+        *(pointers++) = NULL;
+    }
+    // Make sure there are exactly as many strings as the header says.
+    // If the last string is not terminated, it runs into the extra 0 byte and current ends up past the end.
+    if (missingStrings || current != end) {
+        freeDaemonRequest(request);
+        errno = EPROTO;
+        return -1;
+    }
+    return 0;
+}
+
+void freeDaemonRequest(struct daemonRequest *request) {
+    free(request->storage);
+    request->storage = NULL;
+}
+
+int writeDaemonResponse(int fd, uint64_t requestId, const struct tinyjailContainerResultEx *resultEx) {
+    struct daemonResponse response;
+    memset(&response, 0, sizeof(response));
+    response.magic = DAEMON_PROTOCOL_MAGIC;
+    response.requestId = requestId;
+    response.resultEx = *resultEx;
+    int capturedFds[2];
+    int fdCount = 0;
+    if (resultEx->capturedStdout.fd >= 0) {
+        capturedFds[fdCount++] = resultEx->capturedStdout.fd;
+    }
+    if (resultEx->capturedStderr.fd >= 0) {
+        capturedFds[fdCount++] = resultEx->capturedStderr.fd;
+    }
+    return sendWithFds(fd, &response, sizeof(response), capturedFds, fdCount);
+}
@@ -0,0 +1,34 @@
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include <stdint.h>
+
+#include "tinyjail.h"
+
+/// @brief A launch request received by the daemon (see tinyjailDaemonSubmit()).
+struct daemonRequest {
+    /// @brief Chosen by the client, sent back with the result
+    uint64_t requestId;
+    /// @brief The container parameters. All strings and lists point into storage.
+    struct tinyjailContainerParams params;
+    /// @brief Memory holding the strings and lists of params
+    char* storage;
+};
+
+/// @brief Reads a launch request sent with tinyjailDaemonSubmit().
+/// @param fd The connection to read from
+/// @param request Output: the request. On success, it must be freed with freeDaemonRequest().
+/// @return 0 on success, -1 on failure or if the connection was closed (errno is set to EPIPE in that case)
+int readDaemonRequest(int fd, struct daemonRequest *request);
+
+/// @brief Frees the memory held by a request read with readDaemonRequest().
+void freeDaemonRequest(struct daemonRequest *request);
+
+/// @brief Sends the result of a launch request back to the client, to be read with tinyjailDaemonReceive().
+/// The memfds of captured output are passed along, the caller still has to close its copies.
+/// @param fd The connection to write to
+/// @param requestId ID of the request the result belongs to
+/// @param resultEx The result, in version TINYJAIL_RESULT_EX_VERSION
+/// @return 0 on success, -1 on failure (errno is set)
+int writeDaemonResponse(int fd, uint64_t requestId, const struct tinyjailContainerResultEx *resultEx);
@@ -0,0 +1,105 @@
+// SPDX-License-Identifier: MIT
+
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "reaper.h"
+#include "cgroup.h"
+#include "utils.h"
+
+/// @brief Request sent to the reaper, together with a cgroupfs FD
+struct reaperRequest {
+    char containerId[13];
+};
+
+/// @brief Our end of the socket to the reaper thread, -1 if the reaper is not running
+static int reaperSocket = -1;
+/// @brief The reaper thread's end of the socket
+static int reaperThreadSocket = -1;
+static pthread_t reaperThread;
+/// @brief The process which started the reaper thread. A process forked from it shares the socket, but not the thread.
+static pid_t reaperProcess;
+static pthread_mutex_t reaperLock = PTHREAD_MUTEX_INITIALIZER;
+
+/// @brief Main loop of the reaper thread. Returns once stopCgroupReaper() has shut down the socket and all queued requests are done.
+static void* runCgroupReaper(void* arg) {
+    (void) arg;
+    struct reaperRequest request;
+    int cgroupfsFd;
+    int fdCount;
+    // Requests which are still queued when the socket is shut down are read before the end of the stream is reported
+    while ((fdCount = receiveWithFds(reaperThreadSocket, &request, sizeof(request), &cgroupfsFd, 1)) >= 0) {
+        if (fdCount == 1) {
+            request.containerId[sizeof(request.containerId) - 1] = '\0';
+            cleanContainerCgroup(cgroupfsFd, request.containerId);
+            closep(&cgroupfsFd);
+        }
+    }
+    return NULL;
+}
+
+/// @brief Exit handler which removes the cgroups that are still queued before the process exits.
+static void stopCgroupReaper(void) {
+    pthread_mutex_lock(&reaperLock);
+    // Requests sent from here on are removed synchronously by reapContainerCgroup()
+    if (reaperSocket >= 0 && reaperProcess == getpid()) {
+        shutdown(reaperSocket, SHUT_WR);
+        pthread_join(reaperThread, NULL);
+    }
+    pthread_mutex_unlock(&reaperLock);
+}
+
+void startCgroupReaper(void) {
+    pthread_mutex_lock(&reaperLock);
+    if (reaperSocket >= 0) {
+        pthread_mutex_unlock(&reaperLock);
+        return;
+    }
+    // SOCK_SEQPACKET keeps requests apart, so several threads can send them without additional locking
+    int sockets[2] = { -1, -1 };
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, sockets) != 0) {
+        pthread_mutex_unlock(&reaperLock);
+        return;
+    }
+    RAII_FD callerSocket = sockets[0];
+    RAII_FD reaperEnd = sockets[1];
+    // The reaper is a thread of the library caller, so it costs nothing but its stack. It blocks all signals,
+    // so that signals meant for the library caller's threads (e.g. to interrupt a wait()) are never handled by it.
+    sigset_t allSignals;
+    sigset_t callerSignalMask;
+    sigfillset(&allSignals);
+    pthread_sigmask(SIG_SETMASK, &allSignals, &callerSignalMask);
+    reaperThreadSocket = reaperEnd;
+    int threadStarted = (pthread_create(&reaperThread, NULL, runCgroupReaper, NULL) == 0);
+    pthread_sigmask(SIG_SETMASK, &callerSignalMask, NULL);
+    // Without the exit handler, the cgroups which are still queued on exit would be left behind
+    if (threadStarted && atexit(stopCgroupReaper) == 0) {
+        reaperProcess = getpid();
+        reaperEnd = -1;
+        __atomic_store_n(&reaperSocket, callerSocket, __ATOMIC_RELEASE);
+        callerSocket = -1;
+    } else if (threadStarted) {
+        shutdown(callerSocket, SHUT_WR);
+        pthread_join(reaperThread, NULL);
+    }
+    pthread_mutex_unlock(&reaperLock);
+}
+
+void reapContainerCgroup(
+    int cgroupfsFd,
+    const char* containerId
+) {
+    struct reaperRequest request;
+    memset(&request, 0, sizeof(request));
+    snprintf(request.containerId, sizeof(request.containerId), "%s", containerId);
+    // The reaper socket is only ever set once, so it can be read without the lock
+    int socket = __atomic_load_n(&reaperSocket, __ATOMIC_ACQUIRE);
+    if (cgroupfsFd < 0 || socket < 0 || sendWithFds(socket, &request, sizeof(request), &cgroupfsFd, 1) != 0) {
+        cleanContainerCgroup(cgroupfsFd, containerId);
+    }
+}
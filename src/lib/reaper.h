@@ -0,0 +1,18 @@
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+/// @brief Starts the cgroup reaper thread, unless it is already running.
+/// The reaper removes container cgroups in the background, so that removing them is not on the critical path of collecting a container.
+/// It runs until the process exits, and an exit handler waits for the cgroups which are still queued at that point.
+/// Starting it is best-effort: if it cannot be started, cgroups are removed synchronously instead.
+void startCgroupReaper(void);
+
+/// @brief Hands a container cgroup over to the cgroup reaper, which waits for the cgroup to become empty and removes it.
+/// If the reaper is not running, the cgroup is removed synchronously.
+/// @param cgroupfsFd FD of the cgroupfs directory which holds the container cgroup (see openParentCgroup()). The reaper gets its own copy, the caller may close the FD right away.
+/// @param containerId ID of the container, which is also the name of its cgroup
+void reapContainerCgroup(
+    int cgroupfsFd,
+    const char* containerId
+);
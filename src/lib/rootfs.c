@@ -0,0 +1,88 @@
+// SPDX-License-Identifier: MIT
+
+#include <errno.h>
+#include <string.h>
+#include <sys/mount.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "rootfs.h"
+#include "utils.h"
+
+// The kernel accepts at most one page of mount options
+#define OVERLAY_OPTIONS_SIZE (4096)
+
+/// @brief Appends a directory to the overlayfs mount options.
+/// @return 0 on success, -1 if the directory cannot be used (overlayfs uses ',' and ':' as separators) or the options are too long
+static int appendOverlayOption(
+    char* options,
+    size_t* optionsLength,
+    const char* prefix,
+    const char* directory,
+    struct tinyjailContainerResult *result
+) {
+    if (strpbrk(directory, ",:") != NULL) {
+        snprintf(result->errorInfo, ERROR_INFO_SIZE, "Overlay directory %s cannot contain ',' or ':'.", directory);
+        return -1;
+    }
+    size_t remaining = OVERLAY_OPTIONS_SIZE - *optionsLength;
+    int appended = snprintf(options + *optionsLength, remaining, "%s%s", prefix, directory);
+    if (appended < 0 || (size_t) appended >= remaining) {
+        snprintf(result->errorInfo, ERROR_INFO_SIZE, "Overlay directories are too long for the mount options.");
+        return -1;
+    }
+    *optionsLength += appended;
+    return 0;
+}
+
+int setupContainerRootfs(
+    const struct tinyjailContainerParams* containerParams,
+    struct tinyjailContainerResult *result
+) {
+    if (containerParams->rootfsLowerDirs == NULL || containerParams->rootfsLowerDirs[0] == NULL) {
+        return 0;
+    }
+
+    // Without an upper directory, the container's changes go to a tmpfs mounted over containerDir (the overlay then hides it).
+    // Mounts in the launcher's mount namespace go away with the container, so nothing has to be cleaned up on failure.
+    const char* upperDir = containerParams->rootfsUpperDir;
+    const char* workDir = containerParams->rootfsWorkDir;
+    ALLOC_LOCAL_FORMAT_STRING(tmpfsUpperDir, "%s/upper", containerParams->containerDir);
+    ALLOC_LOCAL_FORMAT_STRING(tmpfsWorkDir, "%s/work", containerParams->containerDir);
+    if (upperDir == NULL) {
+        if (mount("tmpfs", containerParams->containerDir, "tmpfs", MS_NOSUID | MS_NODEV, "mode=0755") != 0) {
+            snprintf(result->errorInfo, ERROR_INFO_SIZE, "Could not mount tmpfs for the container root: %s", strerror(errno));
+            return -1;
+        }
+        // overlayfs takes the owner of the container root from the upper directory
+        if (mkdir(tmpfsUpperDir, 0755) != 0 || chown(tmpfsUpperDir, containerParams->uid, containerParams->gid) != 0) {
+            snprintf(result->errorInfo, ERROR_INFO_SIZE, "Could not create overlay upper directory: %s", strerror(errno));
+            return -1;
+        }
+        if (mkdir(tmpfsWorkDir, 0700) != 0) {
+            snprintf(result->errorInfo, ERROR_INFO_SIZE, "Could not create overlay work directory: %s", strerror(errno));
+            return -1;
+        }
+        upperDir = tmpfsUpperDir;
+        workDir = tmpfsWorkDir;
+    }
+
+    // The lower directories are given top-most first, which is also the order overlayfs expects
+    char options[OVERLAY_OPTIONS_SIZE] = "";
+    size_t optionsLength = 0;
+    for (char** lowerDir = containerParams->rootfsLowerDirs; *lowerDir != NULL; lowerDir++) {
+        const char* prefix = (lowerDir == containerParams->rootfsLowerDirs) ? "lowerdir=" : ":";
+        if (appendOverlayOption(options, &optionsLength, prefix, *lowerDir, result) != 0) {
+            return -1;
+        }
+    }
+    if (appendOverlayOption(options, &optionsLength, ",upperdir=", upperDir, result) != 0
+        || appendOverlayOption(options, &optionsLength, ",workdir=", workDir, result) != 0) {
+        return -1;
+    }
+    if (mount("overlay", containerParams->containerDir, "overlay", 0, options) != 0) {
+        snprintf(result->errorInfo, ERROR_INFO_SIZE, "Could not mount overlay container root: %s", strerror(errno));
+        return -1;
+    }
+    return 0;
+}
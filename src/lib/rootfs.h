@@ -0,0 +1,16 @@
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include "tinyjail.h"
+
+/// @brief Assembles the container root from read-only lower directories with overlayfs, if the container parameters ask for it.
+/// The overlay is mounted over containerDir in the calling process's mount namespace, so this has to run in the launcher
+/// (which has a private mount namespace) before the container process is cloned.
+/// @param containerParams Container parameters
+/// @param result Result object returned to the library caller
+/// @return 0 on success (or if no overlay is needed), -1 on failure
+int setupContainerRootfs(
+    const struct tinyjailContainerParams* containerParams,
+    struct tinyjailContainerResult *result
+);
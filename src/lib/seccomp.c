@@ -0,0 +1,285 @@
+// SPDX-License-Identifier: MIT
+
+#include <errno.h>
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <linux/audit.h>
+#include <linux/seccomp.h>
+#include <sys/prctl.h>
+#include <sys/syscall.h>
+
+#include "seccomp.h"
+#include "utils.h"
+
+#if defined(__x86_64__) && !defined(__ILP32__)
+#define FILTER_AUDIT_ARCH AUDIT_ARCH_X86_64
+// x32 system calls share the x86_64 audit arch, but have this bit set in their number
+#define FILTER_X32_SYSCALL_BIT (0x40000000)
+#elif defined(__i386__)
+#define FILTER_AUDIT_ARCH AUDIT_ARCH_I386
+#elif defined(__aarch64__)
+#define FILTER_AUDIT_ARCH AUDIT_ARCH_AARCH64
+#elif defined(__riscv) && __riscv_xlen == 64
+#define FILTER_AUDIT_ARCH AUDIT_ARCH_RISCV64
+#endif
+
+#ifndef SECCOMP_RET_KILL_PROCESS
+#define SECCOMP_RET_KILL_PROCESS SECCOMP_RET_KILL
+#endif
+
+/// @brief Blocked system calls fail with EPERM, so that programs which probe for them can handle it
+#define FILTER_ACTION_DENY (SECCOMP_RET_ERRNO | (EPERM & SECCOMP_RET_DATA))
+#define FILTER_ACTION_ALLOW (SECCOMP_RET_ALLOW)
+
+/// @brief Upper bound on the size of a compiled program, far more than any of the profiles needs
+#define MAX_FILTER_INSTRUCTIONS (512)
+#define MAX_FILTER_SYSCALLS (128)
+
+/// @brief System calls which act on the whole host rather than on the container: kernel modules, kexec, reboot,
+/// clocks, swap, accounting, keyrings, bpf(), perf events, io_uring and a few obsolete ones. Blocked by TINYJAIL_SECCOMP_DEFAULT.
+static const long hostSyscalls[] = {
+    SYS_acct, SYS_add_key, SYS_bpf, SYS_clock_adjtime, SYS_clock_settime, SYS_delete_module, SYS_finit_module,
+    SYS_init_module, SYS_kcmp, SYS_kexec_load, SYS_keyctl, SYS_lookup_dcookie, SYS_open_by_handle_at,
+    SYS_perf_event_open, SYS_quotactl, SYS_reboot, SYS_request_key, SYS_settimeofday, SYS_swapoff, SYS_swapon,
+    SYS_syslog, SYS_userfaultfd,
+#ifdef SYS_kexec_file_load
+    SYS_kexec_file_load,
+#endif
+#ifdef SYS_io_uring_setup
+    SYS_io_uring_setup, SYS_io_uring_enter, SYS_io_uring_register,
+#endif
+#ifdef SYS_create_module
+    SYS_create_module, SYS_get_kernel_syms, SYS_query_module,
+#endif
+#ifdef SYS_iopl
+    SYS_iopl, SYS_ioperm,
+#endif
+#ifdef SYS_nfsservctl
+    SYS_nfsservctl,
+#endif
+#ifdef SYS__sysctl
+    SYS__sysctl,
+#endif
+#ifdef SYS_sysfs
+    SYS_sysfs,
+#endif
+#ifdef SYS_uselib
+    SYS_uselib,
+#endif
+#ifdef SYS_ustat
+    SYS_ustat,
+#endif
+#ifdef SYS_stime
+    SYS_stime,
+#endif
+#ifdef SYS_vm86
+    SYS_vm86,
+#endif
+#ifdef SYS_vm86old
+    SYS_vm86old,
+#endif
+};
+
+/// @brief System calls with which the container could rearrange its own sandbox: mounts, namespaces, its root,
+/// its hostname, and access to other processes. Blocked in addition to hostSyscalls by TINYJAIL_SECCOMP_STRICT.
+static const long isolationSyscalls[] = {
+    SYS_chroot, SYS_mount, SYS_name_to_handle_at, SYS_pivot_root, SYS_process_vm_readv, SYS_process_vm_writev,
+    SYS_ptrace, SYS_setdomainname, SYS_sethostname, SYS_setns, SYS_umount2, SYS_unshare,
+#ifdef SYS_umount
+    SYS_umount,
+#endif
+#ifdef SYS_fsopen
+    SYS_fsopen, SYS_fsconfig, SYS_fsmount, SYS_fspick, SYS_move_mount, SYS_open_tree,
+#endif
+#ifdef SYS_mount_setattr
+    SYS_mount_setattr,
+#endif
+};
+
+/// @brief The most frequent system calls of typical workloads, most frequent first. The ones a profile allows are
+/// checked with a single comparison each before the binary search, so they skip it entirely.
+static const long hotSyscalls[] = {
+    SYS_read, SYS_write, SYS_futex,
+#ifdef SYS_epoll_wait
+    SYS_epoll_wait,
+#endif
+    SYS_epoll_pwait, SYS_recvfrom, SYS_sendto,
+#ifdef SYS_poll
+    SYS_poll,
+#endif
+};
+
+#define ARRAY_SIZE(ARRAY) (sizeof(ARRAY) / sizeof(ARRAY[0]))
+
+/// @brief A run of consecutive system call numbers with the same action, which ends where the next one starts
+struct syscallRange {
+    uint32_t first;
+    uint32_t action;
+};
+
+struct filterProgram {
+    struct sock_filter instructions[MAX_FILTER_INSTRUCTIONS];
+    int length;
+};
+
+static const struct sock_fprog *filterCache[TINYJAIL_SECCOMP_PROFILE_COUNT];
+static pthread_mutex_t filterCacheLock = PTHREAD_MUTEX_INITIALIZER;
+
+static int compareSyscalls(const void* a, const void* b) {
+    long first = *(const long*) a;
+    long second = *(const long*) b;
+    return (first > second) - (first < second);
+}
+
+/// @brief Appends an instruction to the program, returns its index or -1 if the program is full.
+static int emit(struct filterProgram *program, uint16_t code, uint32_t k, uint8_t jt, uint8_t jf) {
+    if (program->length >= MAX_FILTER_INSTRUCTIONS) {
+        return -1;
+    }
+    program->instructions[program->length] = (struct sock_filter) BPF_JUMP(code, k, jt, jf);
+    return program->length++;
+}
+
+/// @brief Emits a balanced binary search over the given ranges, which ends in the action of the range the system call number is in.
+/// Every system call is decided after at most log2(rangeCount) comparisons, no matter how long the list of blocked ones is.
+static int emitRangeSearch(struct filterProgram *program, const struct syscallRange *ranges, int rangeCount) {
+    if (rangeCount == 1) {
+        return emit(program, BPF_RET | BPF_K, ranges[0].action, 0, 0) < 0 ? -1 : 0;
+    }
+    // Numbers below the first range of the upper half fall through to the lower half, the others jump over it
+    int middle = rangeCount / 2;
+    int node = emit(program, BPF_JMP | BPF_JGE | BPF_K, ranges[middle].first, 0, 0);
+    if (node < 0 || emitRangeSearch(program, ranges, middle) != 0) {
+        return -1;
+    }
+    int jumpOffset = program->length - node - 1;
+    if (jumpOffset > UINT8_MAX) {
+        return -1;
+    }
+    program->instructions[node].jt = jumpOffset;
+    return emitRangeSearch(program, ranges + middle, rangeCount - middle);
+}
+
+/// @brief Compiles a list of blocked system calls into a BPF program: an architecture check,
+/// a shortcut for the allowed hot system calls, and a binary search for everything else.
+static int compileFilter(const long *blockedSyscalls, int blockedCount, struct filterProgram *program) {
+#ifndef FILTER_AUDIT_ARCH
+    (void) blockedSyscalls;
+    (void) blockedCount;
+    (void) program;
+    errno = ENOTSUP;
+    return -1;
+#else
+    long blocked[MAX_FILTER_SYSCALLS];
+    memcpy(blocked, blockedSyscalls, blockedCount * sizeof(long));
+    qsort(blocked, blockedCount, sizeof(long), compareSyscalls);
+
+    // Merge neighbouring blocked numbers, so that the search only has to tell allowed and blocked runs apart
+    struct syscallRange ranges[2 * MAX_FILTER_SYSCALLS + 2];
+    int rangeCount = 0;
+    uint32_t nextUncovered = 0;
+    for (int i = 0; i < blockedCount; i++) {
+        uint32_t syscallNumber = blocked[i];
+        if (syscallNumber < nextUncovered) {
+            // Listed twice
+            continue;
+        }
+        if (syscallNumber > nextUncovered) {
+            ranges[rangeCount++] = (struct syscallRange) { .first = nextUncovered, .action = FILTER_ACTION_ALLOW };
+        }
+        if (rangeCount == 0 || ranges[rangeCount - 1].action != FILTER_ACTION_DENY) {
+            ranges[rangeCount++] = (struct syscallRange) { .first = syscallNumber, .action = FILTER_ACTION_DENY };
+        }
+        nextUncovered = syscallNumber + 1;
+    }
+    ranges[rangeCount++] = (struct syscallRange) { .first = nextUncovered, .action = FILTER_ACTION_ALLOW };
+#ifdef FILTER_X32_SYSCALL_BIT
+    ranges[rangeCount++] = (struct syscallRange) { .first = FILTER_X32_SYSCALL_BIT, .action = FILTER_ACTION_DENY };
+#endif
+
+    // A process of another architecture would have other system call numbers, so it is killed outright
+    program->length = 0;
+    emit(program, BPF_LD | BPF_W | BPF_ABS, offsetof(struct seccomp_data, arch), 0, 0);
+    emit(program, BPF_JMP | BPF_JEQ | BPF_K, FILTER_AUDIT_ARCH, 1, 0);
+    emit(program, BPF_RET | BPF_K, SECCOMP_RET_KILL_PROCESS, 0, 0);
+    emit(program, BPF_LD | BPF_W | BPF_ABS, offsetof(struct seccomp_data, nr), 0, 0);
+
+    long allowedHotSyscalls[ARRAY_SIZE(hotSyscalls)];
+    int allowedHotCount = 0;
+    for (size_t i = 0; i < ARRAY_SIZE(hotSyscalls); i++) {
+        if (bsearch(&hotSyscalls[i], blocked, blockedCount, sizeof(long), compareSyscalls) == NULL) {
+            allowedHotSyscalls[allowedHotCount++] = hotSyscalls[i];
+        }
+    }
+    if (allowedHotCount > 0) {
+        // Each hot system call jumps to the ALLOW right behind the shortcut, everything else skips over it
+        for (int i = 0; i < allowedHotCount; i++) {
+            emit(program, BPF_JMP | BPF_JEQ | BPF_K, allowedHotSyscalls[i], allowedHotCount - i, 0);
+        }
+        emit(program, BPF_JMP | BPF_JA, 1, 0, 0);
+        emit(program, BPF_RET | BPF_K, FILTER_ACTION_ALLOW, 0, 0);
+    }
+    if (emitRangeSearch(program, ranges, rangeCount) != 0) {
+        errno = E2BIG;
+        return -1;
+    }
+    return 0;
+#endif
+}
+
+int loadSeccompFilter(
+    int profile,
+    const struct sock_fprog **filter,
+    struct tinyjailContainerResult *result
+) {
+#define RETURN_WITH_ERROR(...) { result->containerStartedStatus = -1; snprintf(result->errorInfo, ERROR_INFO_SIZE, __VA_ARGS__); return -1; }
+    if (profile < 0 || profile >= TINYJAIL_SECCOMP_PROFILE_COUNT) {
+        RETURN_WITH_ERROR("Unknown seccomp profile %d.", profile);
+    }
+    *filter = NULL;
+    if (profile == TINYJAIL_SECCOMP_NONE) {
+        return 0;
+    }
+
+    pthread_mutex_lock(&filterCacheLock);
+    if (filterCache[profile] != NULL) {
+        *filter = filterCache[profile];
+        pthread_mutex_unlock(&filterCacheLock);
+        return 0;
+    }
+    long blocked[MAX_FILTER_SYSCALLS];
+    int blockedCount = 0;
+    memcpy(blocked, hostSyscalls, sizeof(hostSyscalls));
+    blockedCount += ARRAY_SIZE(hostSyscalls);
+    if (profile == TINYJAIL_SECCOMP_STRICT) {
+        memcpy(blocked + blockedCount, isolationSyscalls, sizeof(isolationSyscalls));
+        blockedCount += ARRAY_SIZE(isolationSyscalls);
+    }
+    struct filterProgram program;
+    if (compileFilter(blocked, blockedCount, &program) != 0) {
+        pthread_mutex_unlock(&filterCacheLock);
+        RETURN_WITH_ERROR("Could not compile seccomp profile %d: %s", profile, strerror(errno));
+    }
+    // The program is kept until the process exits, every container launched with this profile uses it
+    struct sock_fprog *compiled = malloc(sizeof(struct sock_fprog) + program.length * sizeof(struct sock_filter));
+    if (compiled == NULL) {
+        pthread_mutex_unlock(&filterCacheLock);
+        RETURN_WITH_ERROR("malloc() failed.");
+    }
+    compiled->len = program.length;
+    compiled->filter = (struct sock_filter*) (compiled + 1);
+    memcpy(compiled->filter, program.instructions, program.length * sizeof(struct sock_filter));
+    filterCache[profile] = compiled;
+    *filter = compiled;
+    pthread_mutex_unlock(&filterCacheLock);
+    return 0;
+#undef RETURN_WITH_ERROR
+}
+
+int installSeccompFilter(const struct sock_fprog *filter) {
+    return rawSyscall(SYS_prctl, PR_SET_SECCOMP, SECCOMP_MODE_FILTER, (long) filter, 0, 0, 0);
+}
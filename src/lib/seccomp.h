@@ -0,0 +1,26 @@
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include <linux/filter.h>
+
+#include "tinyjail.h"
+
+/// @brief Gets the BPF program of a seccomp profile (see enum tinyjailSeccompProfile).
+/// Each profile is compiled the first time it is used and then served from a cache for the lifetime of the process,
+/// so every later launch (and every launcher forked from this process) gets it for free.
+/// @param profile The profile
+/// @param filter Output: the program, or NULL for TINYJAIL_SECCOMP_NONE. It must not be modified or freed.
+/// @param result Result object passed back to the library caller
+/// @return 0 on success, -1 on failure
+int loadSeccompFilter(
+    int profile,
+    const struct sock_fprog **filter,
+    struct tinyjailContainerResult *result
+);
+
+/// @brief Installs a program from loadSeccompFilter() on the calling process.
+/// The caller needs CAP_SYS_ADMIN in its user namespace, or has to have set PR_SET_NO_NEW_PRIVS.
+/// It only uses rawSyscall(), so the container process can call it while it shares the memory of the library caller.
+/// @return 0 on success, -errno on failure (errno itself is left alone)
+int installSeccompFilter(const struct sock_fprog *filter);
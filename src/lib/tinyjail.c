@@ -1,27 +1,343 @@
 // SPDX-License-Identifier: MIT
 
-// SPDX-License-Identifier: MIT
+// _GNU_SOURCE is needed for pipe2()
+#define _GNU_SOURCE
 
 #include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/prctl.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
 #include <sys/stat.h>
 #include <sys/random.h>
+#include <sys/timerfd.h>
 #include <sys/wait.h>
 #include <unistd.h>
 
 #include "tinyjail.h"
+#include "cgroup.h"
 #include "launcher.h"
+#include "mounts.h"
+#include "netpool.h"
+#include "output.h"
+#include "reaper.h"
+#include "seccomp.h"
 #include "utils.h"
 #include <linux/limits.h>
 
-struct tinyjailContainerResult tinyjailLaunchContainer(
-    struct tinyjailContainerParams containerParams
+struct tinyjailContainerHandle {
+    /// @brief PID of the container init process. It is a child of the library caller.
+    int containerPid;
+    /// @brief Memory the container process runs on until its execve() (see launcherReport), NULL once it is released
+    void* containerInitMemory;
+    /// @brief pidfd of the container init process, it becomes readable once the container exits.
+    int containerPidFd;
+    /// @brief Directory of a detached cgroupfs mount which holds the container cgroup (the root or the parent cgroup),
+    /// used to remove the container cgroup after the container exits.
+    int cgroupfsFd;
+    /// @brief Write end of the sync pipe the container process waits on. Set to -1 once the container is started.
+    int syncPipeWrite;
+    /// @brief Read end of the pipe over which the container process reports errors before its execve().
+    int errorPipeRead;
+    /// @brief ID of the container, which is also the name of its cgroup
+    char containerId[13];
+    /// @brief Set if the container was placed on CPUs (see cpuCount), which are released when it is collected
+    int cpusPlaced;
+    /// @brief Working directory (NULL for "/") and syscall filter of the container command, which commands run by tinyjailExec() get too
+    char* workDir;
+    const struct sock_fprog *seccompFilter;
+    /// @brief Timestamps of the launch phases reached so far (see enum tinyjailLaunchPhase)
+    uint64_t timings[TINYJAIL_LAUNCH_PHASE_COUNT];
+    /// @brief epoll FD over everything that is supervised while the container runs: its pidfd, its deadline timer and its cgroup events
+    int epollFd;
+    /// @brief timerfd which expires at the container deadline, -1 if the container has no timeout
+    int deadlineTimerFd;
+    long timeoutMilliseconds;
+    /// @brief cgroup.events and memory.events of the container cgroup, -1 if not available
+    int cgroupEventsFd;
+    int memoryEventsFd;
+    /// @brief Set once the container init has exited (it still needs to be reaped)
+    int exited;
+    /// @brief Set if the container was killed because of its deadline
+    int timedOut;
+    /// @brief Number of processes killed by the OOM killer, as last read from memory.events
+    uint64_t oomKillEvents;
+    /// @brief The pool the network namespace of the container comes from, and the namespace itself. NULL and -1 if not pooled.
+    struct tinyjailNetworkPool *networkPool;
+    int netNsFd;
+    /// @brief Files, memfds and pipes the output of the container goes to
+    struct containerOutput output;
+    /// @brief PSI triggers of the container, indexed by enum tinyjailPressureResource, -1 for resources without a trigger
+    int pressureTriggerFds[TINYJAIL_PRESSURE_RESOURCE_COUNT];
+    /// @brief Number of times each trigger fired
+    uint64_t pressureTriggerEvents[TINYJAIL_PRESSURE_RESOURCE_COUNT];
+    void (*pressureCallback)(void* context, int resource);
+    void* pressureCallbackContext;
+    /// @brief timerfd which expires at every telemetry sample, -1 if the container is not sampled (any more)
+    int telemetryTimerFd;
+    long telemetryIntervalMilliseconds;
+    /// @brief The caller's FD the records go to, and the cgroup files they are read from
+    int telemetryFd;
+    struct cgroupTelemetryFiles telemetryFiles;
+    uint32_t telemetrySequence;
+};
+
+/// @brief Identifies the FD an event in the supervision epoll set comes from
+enum supervisionEventSource {
+    SUPERVISION_CONTAINER_EXIT,
+    SUPERVISION_DEADLINE,
+    SUPERVISION_CGROUP_EVENTS,
+    SUPERVISION_MEMORY_EVENTS,
+    SUPERVISION_ERROR_PIPE,
+    /// @brief Ring buffer pipes of stdout and stderr, in the order of OUTPUT_STREAM_*
+    SUPERVISION_OUTPUT_STDOUT,
+    SUPERVISION_OUTPUT_STDERR,
+    /// @brief PSI triggers, in the order of enum tinyjailPressureResource
+    SUPERVISION_PRESSURE_CPU,
+    SUPERVISION_PRESSURE_MEMORY,
+    SUPERVISION_PRESSURE_IO,
+    SUPERVISION_TELEMETRY
+};
+
+static int addSupervisedFd(int epollFd, int fd, uint32_t events, enum supervisionEventSource source) {
+    struct epoll_event event = { .events = events, .data.u32 = source };
+    return epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event);
+}
+
+/// @brief Sets up the epoll set which supervises a prepared container once it is started.
+/// @return 0 on success, -1 on failure (the error is written to result)
+static int initContainerSupervision(
+    struct tinyjailContainerHandle *handle,
+    const struct tinyjailContainerParams *containerParams,
+    struct tinyjailContainerResult *result
+) {
+    long timeoutMilliseconds = containerParams->timeoutMilliseconds;
+    handle->epollFd = epoll_create1(EPOLL_CLOEXEC);
+    if (handle->epollFd < 0 || addSupervisedFd(handle->epollFd, handle->containerPidFd, EPOLLIN, SUPERVISION_CONTAINER_EXIT) != 0) {
+        snprintf(result->errorInfo, ERROR_INFO_SIZE, "Could not set up container supervision: %s", strerror(errno));
+        return -1;
+    }
+    handle->timeoutMilliseconds = timeoutMilliseconds;
+    if (timeoutMilliseconds > 0) {
+        handle->deadlineTimerFd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+        if (handle->deadlineTimerFd < 0 || addSupervisedFd(handle->epollFd, handle->deadlineTimerFd, EPOLLIN, SUPERVISION_DEADLINE) != 0) {
+            snprintf(result->errorInfo, ERROR_INFO_SIZE, "Could not set up container deadline timer: %s", strerror(errno));
+            return -1;
+        }
+    }
+    // The cgroup event files signal changes with EPOLLPRI. memory.events only exists if the memory controller is enabled for the container.
+    handle->cgroupEventsFd = openContainerCgroupFile(handle->cgroupfsFd, handle->containerId, "cgroup.events");
+    if (handle->cgroupEventsFd >= 0) {
+        addSupervisedFd(handle->epollFd, handle->cgroupEventsFd, EPOLLPRI, SUPERVISION_CGROUP_EVENTS);
+    }
+    handle->memoryEventsFd = openContainerCgroupFile(handle->cgroupfsFd, handle->containerId, "memory.events");
+    if (handle->memoryEventsFd >= 0) {
+        addSupervisedFd(handle->epollFd, handle->memoryEventsFd, EPOLLPRI, SUPERVISION_MEMORY_EVENTS);
+    }
+    // Ring buffers are fed whenever their pipe has data, otherwise the container would block once the pipe is full
+    for (int stream = 0; stream < OUTPUT_STREAM_COUNT; stream++) {
+        if (handle->output.pipeFds[stream] >= 0 &&
+            addSupervisedFd(handle->epollFd, handle->output.pipeFds[stream], EPOLLIN, SUPERVISION_OUTPUT_STDOUT + stream) != 0) {
+            snprintf(result->errorInfo, ERROR_INFO_SIZE, "Could not set up output supervision: %s", strerror(errno));
+            return -1;
+        }
+    }
+    // Like the cgroup event files, PSI triggers signal with EPOLLPRI
+    handle->pressureCallback = containerParams->pressureCallback;
+    handle->pressureCallbackContext = containerParams->pressureCallbackContext;
+    for (int resource = 0; resource < TINYJAIL_PRESSURE_RESOURCE_COUNT; resource++) {
+        const struct tinyjailPressureTrigger *trigger = &containerParams->pressureTriggers[resource];
+        if (trigger->stallMicroseconds <= 0) {
+            continue;
+        }
+        handle->pressureTriggerFds[resource] = openContainerPressureTrigger(handle->cgroupfsFd, handle->containerId, resource, trigger);
+        if (handle->pressureTriggerFds[resource] < 0 ||
+            addSupervisedFd(handle->epollFd, handle->pressureTriggerFds[resource], EPOLLPRI, SUPERVISION_PRESSURE_CPU + resource) != 0) {
+            snprintf(result->errorInfo, ERROR_INFO_SIZE, "Could not set up pressure trigger: %s", strerror(errno));
+            return -1;
+        }
+    }
+    // The sample timer is only armed once the container command is started
+    handle->telemetryIntervalMilliseconds = containerParams->telemetryIntervalMilliseconds;
+    handle->telemetryFd = containerParams->telemetryFd;
+    if (handle->telemetryIntervalMilliseconds > 0) {
+        handle->telemetryTimerFd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+        if (handle->telemetryTimerFd < 0 ||
+            openCgroupTelemetryFiles(handle->cgroupfsFd, handle->containerId, &handle->telemetryFiles) != 0 ||
+            addSupervisedFd(handle->epollFd, handle->telemetryTimerFd, EPOLLIN, SUPERVISION_TELEMETRY) != 0) {
+            snprintf(result->errorInfo, ERROR_INFO_SIZE, "Could not set up container telemetry: %s", strerror(errno));
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/// @brief Samples the container cgroup and writes a telemetry record to the caller's FD.
+/// If the FD is broken, sampling is stopped for good.
+/// @param final Set if the container has exited, which makes this the last record
+static void writeTelemetryRecord(struct tinyjailContainerHandle *handle, int final) {
+    struct tinyjailTelemetryRecord record = {
+        .timestampNanoseconds = monotonicNanoseconds(),
+        .sequence = handle->telemetrySequence++,
+        .final = final
+    };
+    memcpy(record.containerId, handle->containerId, sizeof(handle->containerId));
+    sampleCgroupTelemetry(&handle->telemetryFiles, &record);
+    ssize_t bytesWritten;
+    do {
+        bytesWritten = write(handle->telemetryFd, &record, sizeof(record));
+    } while (bytesWritten < 0 && errno == EINTR);
+    // A full non-blocking FD only costs this record. Nothing else can be done about a short write either, since the next record must not be mixed into this one.
+    if (bytesWritten < 0 && errno != EAGAIN) {
+        epoll_ctl(handle->epollFd, EPOLL_CTL_DEL, handle->telemetryTimerFd, NULL);
+        closep(&handle->telemetryTimerFd);
+    }
+}
+
+/// @brief Waits for events of a container and handles them.
+/// @param handle The container
+/// @param timeoutMilliseconds -1 to block until there is at least one event, 0 to only handle pending events
+/// @param errorPipeReadable Output: set to 1 if the error pipe is readable (it is only supervised while the container is started). Can be NULL.
+/// @return 0 on success, -1 if the container cannot be supervised
+static int handleContainerEvents(
+    struct tinyjailContainerHandle *handle,
+    int timeoutMilliseconds,
+    int *errorPipeReadable
+) {
+    if (handle->epollFd < 0) {
+        return -1;
+    }
+    struct epoll_event events[8];
+    int eventCount = epoll_wait(handle->epollFd, events, 8, timeoutMilliseconds);
+    if (eventCount < 0) {
+        return (errno == EINTR) ? 0 : -1;
+    }
+    int deadlineExpired = 0;
+    for (int i = 0; i < eventCount; i++) {
+        switch (events[i].data.u32) {
+        case SUPERVISION_CONTAINER_EXIT:
+            handle->exited = 1;
+            break;
+        case SUPERVISION_DEADLINE: {
+            uint64_t expirations;
+            read(handle->deadlineTimerFd, &expirations, sizeof(expirations));
+            deadlineExpired = 1;
+            break;
+        }
+        case SUPERVISION_CGROUP_EVENTS: {
+            // Reading the file re-arms the notification. An empty cgroup means the container is gone as well.
+            uint64_t populated = 1;
+            if (readCgroupEventCounter(handle->cgroupEventsFd, "populated", &populated) == 0 && populated == 0) {
+                handle->exited = 1;
+            }
+            break;
+        }
+        case SUPERVISION_MEMORY_EVENTS:
+            readCgroupEventCounter(handle->memoryEventsFd, "oom_kill", &handle->oomKillEvents);
+            break;
+        case SUPERVISION_OUTPUT_STDOUT:
+        case SUPERVISION_OUTPUT_STDERR: {
+            int stream = events[i].data.u32 - SUPERVISION_OUTPUT_STDOUT;
+            if (drainContainerOutput(&handle->output, stream)) {
+                // All writers are gone. The pipe would otherwise keep reporting that.
+                epoll_ctl(handle->epollFd, EPOLL_CTL_DEL, handle->output.pipeFds[stream], NULL);
+                closep(&handle->output.pipeFds[stream]);
+            }
+            break;
+        }
+        case SUPERVISION_PRESSURE_CPU:
+        case SUPERVISION_PRESSURE_MEMORY:
+        case SUPERVISION_PRESSURE_IO: {
+            int resource = events[i].data.u32 - SUPERVISION_PRESSURE_CPU;
+            if (events[i].events & EPOLLERR) {
+                // The cgroup is gone, so the trigger will never fire again
+                epoll_ctl(handle->epollFd, EPOLL_CTL_DEL, handle->pressureTriggerFds[resource], NULL);
+                closep(&handle->pressureTriggerFds[resource]);
+                break;
+            }
+            handle->pressureTriggerEvents[resource]++;
+            if (handle->pressureCallback != NULL) {
+                handle->pressureCallback(handle->pressureCallbackContext, resource);
+            }
+            break;
+        }
+        case SUPERVISION_TELEMETRY: {
+            // Samples which were missed while the caller did not supervise the container are skipped, not made up for
+            uint64_t expirations;
+            read(handle->telemetryTimerFd, &expirations, sizeof(expirations));
+            writeTelemetryRecord(handle, 0);
+            break;
+        }
+        case SUPERVISION_ERROR_PIPE:
+            if (errorPipeReadable != NULL) {
+                *errorPipeReadable = 1;
+            }
+            break;
+        }
+    }
+    // A container which exited right at its deadline did not time out
+    if (deadlineExpired && !handle->exited) {
+        handle->timedOut = 1;
+        // Kill everything in the container cgroup at once. Killing the init takes down the PID namespace too, in case cgroup.kill is not supported.
+        killContainerCgroup(handle->cgroupfsFd, handle->containerId);
+        kill(handle->containerPid, SIGKILL);
+    }
+    return 0;
+}
+
+/// @brief Arguments of runLauncher()
+struct launcherArgs {
+    const struct tinyjailContainerParams *containerParams;
+    int reportSocketRead;
+    int reportSocketWrite;
+    int netNsFd;
+    const int *outputFds;
+    const struct sock_fprog *seccompFilter;
+};
+
+/// @brief Entry point of the launcher process. It shares the memory of the library caller, so it only closes its own copies of the FDs.
+static int runLauncher(void* rawArgs) {
+    const struct launcherArgs *args = rawArgs;
+    close(args->reportSocketRead);
+    launchContainer(args->containerParams, args->reportSocketWrite, args->netNsFd, args->outputFds, args->seccompFilter);
+    close(args->reportSocketWrite);
+    return 0;
+}
+
+struct tinyjailContainerPool {
+    /// @brief Parameters used for every container in the pool.
+    struct tinyjailContainerParams containerParams;
+    /// @brief Number of slots in the pool.
+    int size;
+    /// @brief Protects everything below. The refill thread does not hold it while it prepares a container.
+    pthread_mutex_t lock;
+    /// @brief Signalled when a slot is emptied or the pool is destroyed.
+    pthread_cond_t slotEmptied;
+    /// @brief Thread which prepares a new container for every empty slot.
+    pthread_t refillThread;
+    /// @brief Set once preparing a container failed. Refilling resumes with the next launch, instead of retrying right away.
+    int refillFailed;
+    /// @brief Set when the pool is destroyed, the refill thread exits.
+    int stopping;
+    /// @brief Slot at which the next launch starts looking for a prepared container, so that all slots are used in turn.
+    int nextSlot;
+    /// @brief Prepared containers. A slot is NULL while its container is being prepared (or preparing it failed).
+    struct tinyjailContainerHandle *handles[];
+};
+
+struct tinyjailContainerHandle* tinyjailPrepareContainer(
+    struct tinyjailContainerParams containerParams,
+    struct tinyjailContainerResult *resultOut
 ) {
     struct tinyjailContainerResult result = {0};
+    uint64_t prepareStartTime = monotonicNanoseconds();
 
-#define RETURN_WITH_ERROR(...) result.containerStartedStatus = -1; snprintf(result.errorInfo, ERROR_INFO_SIZE, __VA_ARGS__); return result;
+#define RETURN_WITH_ERROR(...) result.containerStartedStatus = -1; snprintf(result.errorInfo, ERROR_INFO_SIZE, __VA_ARGS__); *resultOut = result; return NULL;
 
     // Preliminary check - we should be root
     if (getuid() != 0) {
@@ -36,6 +352,9 @@ struct tinyjailContainerResult tinyjailLaunchContainer(
     }
 
     // Resolve the container root path to an absolute one
+    if (!containerParams.containerDir) {
+        RETURN_WITH_ERROR("containerParams missing required parameter: containerDir.");
+    }
     char resolvedRootPath[(PATH_MAX + 1) * sizeof(char)];
     memset(resolvedRootPath, 0, sizeof(resolvedRootPath));
     if (realpath(containerParams.containerDir, resolvedRootPath) == NULL) {
@@ -46,7 +365,11 @@ struct tinyjailContainerResult tinyjailLaunchContainer(
     }
     containerParams.containerDir = resolvedRootPath;
 
-    // Determine the UID and GID for the container as the owner of the container directory
+    // Determine the UID and GID for the container as the owner of the container directory.
+    // An idmapped root is typically owned by root, so there is no sensible default for it.
+    if (containerParams.idmapRootfs && (containerParams.uid < 0 || containerParams.gid < 0)) {
+        RETURN_WITH_ERROR("containerParams must have uid and gid set if idmapRootfs is set.");
+    }
     struct stat containerDirStat;
     if (stat(containerParams.containerDir, &containerDirStat) != 0) {
         RETURN_WITH_ERROR("Could not stat %s: %s", containerParams.containerDir, strerror(errno));
@@ -67,54 +390,779 @@ struct tinyjailContainerResult tinyjailLaunchContainer(
     if (containerParams.containerId && strlen(containerParams.containerId) > 12) {
         RETURN_WITH_ERROR("containerId can be at most 12 characters long.");
     }
-    if (!containerParams.commandList) {
-        RETURN_WITH_ERROR("containerParams missing required parameter: commandList.");
+    if (containerParams.networkBridgeName && containerParams.networkPeerIpAddr) {
+        RETURN_WITH_ERROR("containerParams cannot have both networkBridgeName and networkPeerIPAddr set.");
     }
-    if (!containerParams.containerDir) {
-        RETURN_WITH_ERROR("containerParams missing required parameter: containerDir.");
+    if (containerParams.networkMode < 0 || containerParams.networkMode >= TINYJAIL_NETWORK_MODE_COUNT) {
+        RETURN_WITH_ERROR("Invalid networkMode: %d", containerParams.networkMode);
     }
-    if (!containerParams.environment) {
-        RETURN_WITH_ERROR("containerParams missing required parameter: environment.");
+    if ((containerParams.networkMode == TINYJAIL_NETWORK_VETH) != (containerParams.networkParentDevice == NULL)) {
+        RETURN_WITH_ERROR("containerParams must have networkParentDevice set if and only if networkMode is macvlan or ipvlan.");
     }
-    if (containerParams.networkBridgeName && containerParams.networkPeerIpAddr) {
-        RETURN_WITH_ERROR("containerParams cannot have both networkBridgeName and networkPeerIPAddr set.");
+    if (containerParams.networkMode != TINYJAIL_NETWORK_VETH && (containerParams.networkBridgeName || containerParams.networkPeerIpAddr)) {
+        RETURN_WITH_ERROR("containerParams cannot have networkBridgeName or networkPeerIpAddr set for a macvlan or ipvlan interface.");
+    }
+    if (containerParams.networkQueueCount < 0 || containerParams.networkMtu < 0 || containerParams.networkTxQueueLength < 0) {
+        RETURN_WITH_ERROR("containerParams cannot have negative networkQueueCount, networkMtu or networkTxQueueLength.");
+    }
+    if ((containerParams.rootfsUpperDir == NULL) != (containerParams.rootfsWorkDir == NULL)) {
+        RETURN_WITH_ERROR("containerParams must have either both or none of rootfsUpperDir and rootfsWorkDir set.");
+    }
+    if (containerParams.rootfsUpperDir && (containerParams.rootfsLowerDirs == NULL || containerParams.rootfsLowerDirs[0] == NULL)) {
+        RETURN_WITH_ERROR("containerParams cannot have rootfsUpperDir set without rootfsLowerDirs.");
+    }
+    if (containerParams.idmapRootfs && containerParams.rootfsLowerDirs != NULL && containerParams.rootfsLowerDirs[0] != NULL) {
+        RETURN_WITH_ERROR("containerParams cannot have both idmapRootfs and rootfsLowerDirs set, overlayfs does not support idmapped mounts.");
+    }
+    // The filter is compiled only once per process, all launchers share it
+    const struct sock_fprog *seccompFilter = NULL;
+    if (loadSeccompFilter(containerParams.seccompProfile, &seccompFilter, &result) != 0) {
+        *resultOut = result;
+        return NULL;
     }
 
-    // Since we'll pipe in the result of the container launch, set up the pipe first
-    int resultPipe[2] = { -1, -1 };
-    if (pipe(resultPipe) != 0) {
-        RETURN_WITH_ERROR("pipe() failed: %s", strerror(errno));
-    }
-    RAII_FD resultPipeRead = resultPipe[0];
-    RAII_FD resultPipeWrite = resultPipe[1];
-
-    // Now run the container launch function in a subprocess.
-    int launcherPid = fork();
-    if (launcherPid < 0) {
-        RETURN_WITH_ERROR("fork() failed: %s", strerror(errno));
-    } else if (launcherPid == 0) {
-        // Child process logic goes here
-        closep(&resultPipeRead);
-        launchContainer(&containerParams, &result);
-        write(resultPipeWrite, &result, sizeof(result));
-        closep(&resultPipeWrite);
-        exit(0);
+    // Make sure container cgroups can be removed off the critical path once the container exits
+    startCgroupReaper();
+
+    // Take a ready-made network namespace if there is a pool. If the launch fails, the namespace goes back into the pool.
+    // The container process cannot have changed its configuration, since the namespace belongs to the host user namespace.
+    __attribute__((cleanup(releasePooledNetworkNamespace))) struct pooledNetworkNamespace pooledNetNs = { containerParams.networkPool, -1 };
+    if (containerParams.networkPool != NULL) {
+        pooledNetNs.netNsFd = takePooledNetworkNamespace(containerParams.networkPool, &result);
+        if (pooledNetNs.netNsFd < 0) {
+            *resultOut = result;
+            return NULL;
+        }
+    }
+
+    // Open the destinations of the container output. The launcher passes them on to the container process.
+    __attribute__((cleanup(releaseContainerOutput))) struct containerOutput output;
+    if (openContainerOutput(&containerParams, &output, &result) != 0) {
+        result.containerStartedStatus = -1;
+        *resultOut = result;
+        return NULL;
+    }
+
+    // Set up the socket over which the launcher reports back first.
+    // It is close-on-exec so that the container process does not inherit it.
+    int reportSocket[2] = { -1, -1 };
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, reportSocket) != 0) {
+        RETURN_WITH_ERROR("socketpair() failed: %s", strerror(errno));
+    }
+    RAII_FD reportSocketRead = reportSocket[0];
+    RAII_FD reportSocketWrite = reportSocket[1];
+
+    // Now run the container launch function in a subprocess. It shares our memory instead of getting a copy of it, and we only continue
+    // once it has exited, so its report is waiting in the socket by then. Several threads can launch containers at once.
+    struct launcherArgs launcherArgs = {
+        .containerParams = &containerParams,
+        .reportSocketRead = reportSocketRead,
+        .reportSocketWrite = reportSocketWrite,
+        .netNsFd = pooledNetNs.netNsFd,
+        .outputFds = output.containerFds,
+        .seccompFilter = seccompFilter
+    };
+    if (runInSharedMemoryProcess(runLauncher, &launcherArgs) != 0) {
+        RETURN_WITH_ERROR("clone() of the launcher failed: %s", strerror(errno));
     } else {
-        closep(&resultPipeWrite);
-        size_t readResult = read(resultPipeRead, &result, sizeof(result));
-        int readResultErrno = errno;
-        closep(&resultPipeRead);
-        int launcherExitCode;
-        int launcherWaitpid = waitpid(launcherPid, &launcherExitCode, __WALL);
-        int launcherWaitpidErrno = errno;
-        if (readResult != sizeof(result)) {
-            RETURN_WITH_ERROR("Could not read() result back from launcher: %s", strerror(readResultErrno));
-        } else if (launcherWaitpid < 0) {
-            RETURN_WITH_ERROR("Could not waitpid() on launcher: %s", strerror(launcherWaitpidErrno));
+        closep(&reportSocketWrite);
+        // Only the container process writes to its output. E.g. a ring buffer pipe must see EOF once the container is gone.
+        for (int stream = 0; stream < OUTPUT_STREAM_COUNT; stream++) {
+            closep(&output.containerFds[stream]);
+        }
+        // The launcher has exited after sending its report. The container process (if any) is our child from now on.
+        struct launcherReport report;
+        int reportFds[LAUNCHER_REPORT_FD_COUNT];
+        int fdCount = receiveWithFds(reportSocketRead, &report, sizeof(report), reportFds, LAUNCHER_REPORT_FD_COUNT);
+        int receiveErrno = errno;
+        if (fdCount < 0) {
+            RETURN_WITH_ERROR("Could not read() result back from launcher: %s", strerror(receiveErrno));
+        }
+        result = report.result;
+        if (result.containerStartedStatus != 0 || fdCount != LAUNCHER_REPORT_FD_COUNT) {
+            for (int i = 0; i < fdCount; i++) {
+                closep(&reportFds[i]);
+            }
+            // The launcher has already killed the container process and removed its cgroup, it only needs to be reaped.
+            if (report.containerPid > 0) {
+                int containerExitCode;
+                waitpid(report.containerPid, &containerExitCode, __WALL);
+                releaseContainerInitMemory(report.containerInitMemory);
+            }
+            if (result.containerStartedStatus == 0) {
+                RETURN_WITH_ERROR("Launcher did not pass back the container FDs.");
+            }
+            *resultOut = result;
+            return NULL;
+        }
+        struct tinyjailContainerHandle *handle = malloc(sizeof(struct tinyjailContainerHandle));
+        if (handle == NULL) {
+            // Closing the sync pipe makes the container process exit without running anything
+            for (int i = 0; i < fdCount; i++) {
+                closep(&reportFds[i]);
+            }
+            int containerExitCode;
+            waitpid(report.containerPid, &containerExitCode, __WALL);
+            releaseContainerInitMemory(report.containerInitMemory);
+            RETURN_WITH_ERROR("malloc() failed.");
+        }
+        handle->containerPid = report.containerPid;
+        handle->containerInitMemory = report.containerInitMemory;
+        handle->containerPidFd = reportFds[LAUNCHER_REPORT_FD_PIDFD];
+        handle->cgroupfsFd = reportFds[LAUNCHER_REPORT_FD_CGROUPFS];
+        handle->syncPipeWrite = reportFds[LAUNCHER_REPORT_FD_SYNC_PIPE];
+        handle->errorPipeRead = reportFds[LAUNCHER_REPORT_FD_ERROR_PIPE];
+        snprintf(handle->containerId, sizeof(handle->containerId), "%s", containerParams.containerId);
+        handle->cpusPlaced = (containerParams.cpuCount > 0);
+        handle->workDir = (containerParams.workDir != NULL) ? strdup(containerParams.workDir) : NULL;
+        handle->seccompFilter = seccompFilter;
+        memcpy(handle->timings, report.timings, sizeof(handle->timings));
+        handle->timings[TINYJAIL_PHASE_PREPARE_START] = prepareStartTime;
+        handle->epollFd = -1;
+        handle->deadlineTimerFd = -1;
+        handle->cgroupEventsFd = -1;
+        handle->memoryEventsFd = -1;
+        handle->exited = 0;
+        handle->timedOut = 0;
+        handle->oomKillEvents = 0;
+        for (int resource = 0; resource < TINYJAIL_PRESSURE_RESOURCE_COUNT; resource++) {
+            handle->pressureTriggerFds[resource] = -1;
+            handle->pressureTriggerEvents[resource] = 0;
+        }
+        handle->telemetryTimerFd = -1;
+        handle->telemetryFiles = (struct cgroupTelemetryFiles) { -1, -1, -1, -1, -1 };
+        handle->telemetrySequence = 0;
+        handle->networkPool = containerParams.networkPool;
+        handle->netNsFd = pooledNetNs.netNsFd;
+        pooledNetNs.netNsFd = -1;
+        moveContainerOutput(&handle->output, &output);
+        if (containerParams.workDir != NULL && handle->workDir == NULL) {
+            tinyjailReleasePrepared(handle);
+            RETURN_WITH_ERROR("strdup() failed.");
+        }
+        if (initContainerSupervision(handle, &containerParams, &result) != 0) {
+            tinyjailReleasePrepared(handle);
+            result.containerStartedStatus = -1;
+            *resultOut = result;
+            return NULL;
+        }
+        handle->timings[TINYJAIL_PHASE_PREPARED] = monotonicNanoseconds();
+        *resultOut = result;
+        return handle;
+    }
+
+#undef RETURN_WITH_ERROR
+}
+
+/// @brief Checks that a command can be passed to a prepared container.
+/// @return 0 if the command is valid, -1 otherwise (in which case the error is written to result)
+static int validateCommand(
+    char** commandList,
+    char** environment,
+    struct tinyjailContainerResult *result
+) {
+    if (!commandList || !commandList[0]) {
+        result->containerStartedStatus = -1;
+        snprintf(result->errorInfo, ERROR_INFO_SIZE, "containerParams missing required parameter: commandList.");
+        return -1;
+    }
+    if (!environment) {
+        result->containerStartedStatus = -1;
+        snprintf(result->errorInfo, ERROR_INFO_SIZE, "containerParams missing required parameter: environment.");
+        return -1;
+    }
+    return 0;
+}
+
+int tinyjailStartPreparedAsync(
+    struct tinyjailContainerHandle *handle,
+    char** commandList,
+    char** environment,
+    struct tinyjailContainerResult *result
+) {
+    memset(result, 0, sizeof(*result));
+    if (validateCommand(commandList, environment, result) != 0) {
+        tinyjailReleasePrepared(handle);
+        return -1;
+    }
+    handle->timings[TINYJAIL_PHASE_START] = monotonicNanoseconds();
+    // The deadline counts from here, so it also covers a container that hangs before its execve()
+    if (handle->deadlineTimerFd >= 0) {
+        struct itimerspec deadline = {
+            .it_value = {
+                .tv_sec = handle->timeoutMilliseconds / 1000,
+                .tv_nsec = (handle->timeoutMilliseconds % 1000) * 1000000
+            }
+        };
+        timerfd_settime(handle->deadlineTimerFd, 0, &deadline, NULL);
+    }
+    if (handle->telemetryTimerFd >= 0) {
+        struct timespec interval = {
+            .tv_sec = handle->telemetryIntervalMilliseconds / 1000,
+            .tv_nsec = (handle->telemetryIntervalMilliseconds % 1000) * 1000000
+        };
+        struct itimerspec samples = { .it_interval = interval, .it_value = interval };
+        timerfd_settime(handle->telemetryTimerFd, 0, &samples, NULL);
+    }
+    // Give the container process the go-ahead signal, together with the command it should run
+    if (writeAll(handle->syncPipeWrite, "OK", 2) != 0 || writeCommand(handle->syncPipeWrite, commandList, environment) != 0) {
+        int sendErrno = errno;
+        tinyjailReleasePrepared(handle);
+        result->containerStartedStatus = -1;
+        snprintf(result->errorInfo, ERROR_INFO_SIZE, "Could not pass command to the container process: %s", strerror(sendErrno));
+        return -1;
+    }
+    closep(&handle->syncPipeWrite);
+    // The error pipe is closed by a successful execve(). Right before the execve(), the container process sends its timestamps.
+    // If anything goes wrong, it tells us what (after the timestamps, if it got that far) before it exits.
+    // Wait for the pipe while supervising the container, so that its deadline is enforced in the meantime.
+    int errorPipeReadable = 0;
+    if (addSupervisedFd(handle->epollFd, handle->errorPipeRead, EPOLLIN, SUPERVISION_ERROR_PIPE) == 0) {
+        while (!errorPipeReadable && handleContainerEvents(handle, -1, &errorPipeReadable) == 0) {}
+    }
+    char childMessage[sizeof(struct childTimingRecord) + ERROR_INFO_SIZE];
+    size_t messageSize = 0;
+    ssize_t bytesRead;
+    do {
+        bytesRead = read(handle->errorPipeRead, childMessage + messageSize, sizeof(childMessage) - 1 - messageSize);
+        if (bytesRead > 0) {
+            messageSize += bytesRead;
+        }
+    } while ((bytesRead < 0 && errno == EINTR) || (bytesRead > 0 && messageSize < sizeof(childMessage) - 1));
+    int readErrno = errno;
+    closep(&handle->errorPipeRead);
+    // The error pipe is closed once the container process has exec'd or exited, so it is done with its init memory
+    if (bytesRead == 0) {
+        releaseContainerInitMemory(handle->containerInitMemory);
+        handle->containerInitMemory = NULL;
+    }
+    char* errorMessage = childMessage;
+    struct childTimingRecord timingRecord;
+    if (messageSize >= sizeof(timingRecord)) {
+        memcpy(&timingRecord, childMessage, sizeof(timingRecord));
+        if (timingRecord.magic == CHILD_TIMING_RECORD_MAGIC) {
+            for (int phase = 0; phase < TINYJAIL_LAUNCH_PHASE_COUNT; phase++) {
+                if (timingRecord.timings[phase] != 0) {
+                    handle->timings[phase] = timingRecord.timings[phase];
+                }
+            }
+            errorMessage += sizeof(timingRecord);
+            messageSize -= sizeof(timingRecord);
+        }
+    }
+    if (bytesRead < 0 || messageSize != 0) {
+        tinyjailReleasePrepared(handle);
+        result->containerStartedStatus = -1;
+        if (bytesRead < 0) {
+            snprintf(result->errorInfo, ERROR_INFO_SIZE, "Could not read() on error pipe: %s", strerror(readErrno));
         } else {
-            return result;
+            formatChildError(errorMessage, messageSize, result->errorInfo);
         }
+        return -1;
     }
+    handle->timings[TINYJAIL_PHASE_STARTED] = monotonicNanoseconds();
+    return 0;
+}
+
+struct tinyjailContainerResult tinyjailStartPrepared(
+    struct tinyjailContainerHandle *handle,
+    char** commandList,
+    char** environment
+) {
+    struct tinyjailContainerResult result;
+    if (tinyjailStartPreparedAsync(handle, commandList, environment, &result) != 0) {
+        return result;
+    }
+    return tinyjailCollect(handle);
+}
+
+int tinyjailContainerFd(
+    struct tinyjailContainerHandle *handle
+) {
+    return handle->epollFd;
+}
+
+int tinyjailHandleEvents(
+    struct tinyjailContainerHandle *handle
+) {
+    handleContainerEvents(handle, 0, NULL);
+    return handle->exited;
+}
+
+/// @brief Waits for the container to exit, removes its cgroup and frees the handle.
+/// @param handle The container
+/// @param resultEx Output: if not NULL, the fields of the extended result (up to its version) are filled in,
+/// e.g. the resource usage of the container is read from its cgroup before the cgroup is removed
+/// @return The result of the container run
+static struct tinyjailContainerResult collectContainer(
+    struct tinyjailContainerHandle *handle,
+    struct tinyjailContainerResultEx *resultEx
+) {
+    struct tinyjailContainerResult result = {0};
+    // If the container was never started, closing the sync pipe makes it exit without running anything
+    closep(&handle->syncPipeWrite);
+    closep(&handle->errorPipeRead);
+    // Keep supervising the container (e.g. enforce its deadline) until it exits
+    while (!handle->exited && handleContainerEvents(handle, -1, NULL) == 0) {}
+    int waitpidResult;
+    do {
+        waitpidResult = waitpid(handle->containerPid, &(result.containerExitStatus), __WALL);
+    } while (waitpidResult < 0 && errno == EINTR);
+    if (waitpidResult < 0) {
+        result.containerStartedStatus = -1;
+        snprintf(result.errorInfo, ERROR_INFO_SIZE, "waitpid() failed: %s", strerror(errno));
+    } else {
+        // A container which was never started still runs on its init memory until it is gone.
+        // If it could not be reaped, the memory is leaked rather than pulled from under it.
+        releaseContainerInitMemory(handle->containerInitMemory);
+        handle->containerInitMemory = NULL;
+        handle->timings[TINYJAIL_PHASE_EXITED] = monotonicNanoseconds();
+        if (handle->timedOut) {
+            snprintf(result.errorInfo, ERROR_INFO_SIZE, "Container was killed after exceeding its timeout of %ld ms.", handle->timeoutMilliseconds);
+        } else if (handle->memoryEventsFd >= 0 && readCgroupEventCounter(handle->memoryEventsFd, "oom_kill", &handle->oomKillEvents) == 0 && handle->oomKillEvents > 0) {
+            snprintf(result.errorInfo, ERROR_INFO_SIZE, "%llu container processes were killed by the OOM killer.", (unsigned long long) handle->oomKillEvents);
+        }
+    }
+    // All processes in the container PID namespace are gone with its init. Kill anything else left in the container cgroup.
+    killContainerCgroup(handle->cgroupfsFd, handle->containerId);
+    // The last record has the final counters. Containers which were never started have no time series to finish.
+    if (handle->telemetryTimerFd >= 0 && handle->timings[TINYJAIL_PHASE_STARTED] != 0) {
+        writeTelemetryRecord(handle, 1);
+    }
+    // The container cannot have changed the configuration of a pooled network namespace, so it can be reused right away
+    if (handle->networkPool != NULL) {
+        returnPooledNetworkNamespace(handle->networkPool, handle->netNsFd);
+        handle->netNsFd = -1;
+    }
+    if (resultEx != NULL) {
+        // The kernel's accounting for the container is gone with its cgroup, so this is the last chance to read it
+        resultEx->resourceUsageAvailable = (readContainerCgroupUsage(handle->cgroupfsFd, handle->containerId, &resultEx->resourceUsage) == 0);
+        // Fields added in later versions are only written if the caller's struct has them
+        if (resultEx->version >= 2) {
+            memcpy(resultEx->launchTimings, handle->timings, sizeof(handle->timings));
+        }
+        if (resultEx->version >= 3) {
+            resultEx->timedOut = handle->timedOut;
+        }
+        if (resultEx->version >= 4) {
+            finishContainerOutput(&handle->output, OUTPUT_STREAM_STDOUT, &resultEx->capturedStdout);
+            finishContainerOutput(&handle->output, OUTPUT_STREAM_STDERR, &resultEx->capturedStderr);
+        }
+        if (resultEx->version >= 5) {
+            resultEx->pressureAvailable = (readContainerCgroupPressure(handle->cgroupfsFd, handle->containerId, resultEx->pressure) == 0);
+            memcpy(resultEx->pressureTriggerEvents, handle->pressureTriggerEvents, sizeof(handle->pressureTriggerEvents));
+        }
+    }
+    // The container is done with its CPUs, even if its cgroup takes a while to go away
+    if (handle->cpusPlaced) {
+        releaseContainerCpus(handle->cgroupfsFd, handle->containerId);
+    }
+    // Waiting for the cgroup to become empty and removing it happens in the background, the result is ready already
+    reapContainerCgroup(handle->cgroupfsFd, handle->containerId);
+    releaseContainerOutput(&handle->output);
+    for (int resource = 0; resource < TINYJAIL_PRESSURE_RESOURCE_COUNT; resource++) {
+        closep(&handle->pressureTriggerFds[resource]);
+    }
+    closeCgroupTelemetryFiles(&handle->telemetryFiles);
+    closep(&handle->telemetryTimerFd);
+    closep(&handle->memoryEventsFd);
+    closep(&handle->cgroupEventsFd);
+    closep(&handle->deadlineTimerFd);
+    closep(&handle->epollFd);
+    closep(&handle->cgroupfsFd);
+    closep(&handle->containerPidFd);
+    free(handle->workDir);
+    free(handle);
+    return result;
+}
+
+struct tinyjailContainerResult tinyjailCollect(
+    struct tinyjailContainerHandle *handle
+) {
+    return collectContainer(handle, NULL);
+}
+
+void tinyjailCollectEx(
+    struct tinyjailContainerHandle *handle,
+    struct tinyjailContainerResultEx *resultEx
+) {
+    if (resultEx->version > TINYJAIL_RESULT_EX_VERSION) {
+        resultEx->version = TINYJAIL_RESULT_EX_VERSION;
+    }
+    resultEx->result = collectContainer(handle, resultEx);
+}
+
+/// @brief Arguments of the exec launcher. It shares our memory, so the results are simply written back here.
+struct execLauncherArgs {
+    int containerPidFd;
+    int cgroupFd;
+    const struct sock_fprog *seccompFilter;
+    const char* workDir;
+    char** commandList;
+    char** environment;
+    struct tinyjailContainerResult *result;
+    int execPid;
+};
+
+static int runExecLauncher(void* rawArgs) {
+    struct execLauncherArgs *args = rawArgs;
+    args->execPid = launchExec(
+        args->containerPidFd, args->cgroupFd, args->seccompFilter, args->workDir, args->commandList, args->environment, args->result
+    );
+    return 0;
+}
+
+/// @brief Runs a command in a running container (see tinyjailExec()) and waits until it exits.
+/// @param containerPidFd pidfd of the container init process
+/// @param cgroupFd FD of the container cgroup directory
+/// @return The result of the command
+static struct tinyjailContainerResult execInContainer(
+    int containerPidFd,
+    int cgroupFd,
+    const struct sock_fprog *seccompFilter,
+    const char* workDir,
+    char** commandList,
+    char** environment
+) {
+    struct tinyjailContainerResult result = {0};
+    if (validateCommand(commandList, environment, &result) != 0) {
+        return result;
+    }
+    // Like the container launcher, the exec launcher shares our memory instead of getting a copy of it
+    struct execLauncherArgs execLauncherArgs = {
+        .containerPidFd = containerPidFd,
+        .cgroupFd = cgroupFd,
+        .seccompFilter = seccompFilter,
+        .workDir = workDir,
+        .commandList = commandList,
+        .environment = environment,
+        .result = &result,
+        .execPid = -1
+    };
+    if (runInSharedMemoryProcess(runExecLauncher, &execLauncherArgs) != 0) {
+        result.containerStartedStatus = -1;
+        snprintf(result.errorInfo, ERROR_INFO_SIZE, "clone() of the exec launcher failed: %s", strerror(errno));
+        return result;
+    }
+    if (execLauncherArgs.execPid < 0) {
+        return result;
+    }
+    // The exec process is our child, even if it failed before its execve()
+    int exitStatus;
+    int waitpidResult;
+    do {
+        waitpidResult = waitpid(execLauncherArgs.execPid, &exitStatus, __WALL);
+    } while (waitpidResult < 0 && errno == EINTR);
+    if (result.containerStartedStatus != 0) {
+        return result;
+    }
+    if (waitpidResult < 0) {
+        result.containerStartedStatus = -1;
+        snprintf(result.errorInfo, ERROR_INFO_SIZE, "waitpid() failed: %s", strerror(errno));
+        return result;
+    }
+    result.containerExitStatus = exitStatus;
+    return result;
+}
+
+struct tinyjailContainerResult tinyjailExec(
+    struct tinyjailContainerHandle *handle,
+    char** commandList,
+    char** environment
+) {
+    struct tinyjailContainerResult result = {0};
+    // The container init could still be waiting for its own command, it has not joined its cgroup namespace nor pivoted into its root yet
+    if (handle->syncPipeWrite >= 0) {
+        result.containerStartedStatus = -1;
+        snprintf(result.errorInfo, ERROR_INFO_SIZE, "The container has not been started.");
+        return result;
+    }
+    RAII_FD cgroupFd = openat(handle->cgroupfsFd, handle->containerId, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (cgroupFd < 0) {
+        result.containerStartedStatus = -1;
+        snprintf(result.errorInfo, ERROR_INFO_SIZE, "Could not open container cgroup: %s", strerror(errno));
+        return result;
+    }
+    return execInContainer(handle->containerPidFd, cgroupFd, handle->seccompFilter, handle->workDir, commandList, environment);
+}
+
+struct tinyjailContainerResult tinyjailExecById(
+    struct tinyjailContainerParams containerParams
+) {
+    struct tinyjailContainerResult result = {0};
+
+#define RETURN_WITH_ERROR(...) { result.containerStartedStatus = -1; snprintf(result.errorInfo, ERROR_INFO_SIZE, __VA_ARGS__); return result; }
+
+    if (getuid() != 0) {
+        RETURN_WITH_ERROR("tinyjail requires root permissions to run.");
+    }
+    if (containerParams.containerId == NULL) {
+        RETURN_WITH_ERROR("containerParams missing required parameter: containerId.");
+    }
+    if (strlen(containerParams.containerId) > 12 || !stringIsRegularFilename(containerParams.containerId)) {
+        RETURN_WITH_ERROR("Invalid containerId: %s", containerParams.containerId);
+    }
+    const struct sock_fprog *seccompFilter = NULL;
+    if (loadSeccompFilter(containerParams.seccompProfile, &seccompFilter, &result) != 0) {
+        result.containerStartedStatus = -1;
+        return result;
+    }
+    RAII_FD cgroupfsFd = openSharedDetachedMount("cgroup2", &result);
+    if (cgroupfsFd < 0) {
+        result.containerStartedStatus = -1;
+        return result;
+    }
+    ALLOC_LOCAL_FORMAT_STRING(
+        cgroupPath, "%s%s%s",
+        (containerParams.parentCgroup != NULL) ? containerParams.parentCgroup : "",
+        (containerParams.parentCgroup != NULL) ? "/" : "",
+        containerParams.containerId
+    );
+    RAII_FD cgroupFd = openat(cgroupfsFd, cgroupPath, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (cgroupFd < 0) {
+        RETURN_WITH_ERROR("Could not open cgroup of container %s: %s", containerParams.containerId, strerror(errno));
+    }
+    RAII_FD procfsFd = openSharedDetachedMount("proc", &result);
+    if (procfsFd < 0) {
+        result.containerStartedStatus = -1;
+        return result;
+    }
+    RAII_FD containerPidFd = openContainerInitPidFd(cgroupFd, procfsFd, &result);
+    if (containerPidFd < 0) {
+        result.containerStartedStatus = -1;
+        return result;
+    }
+    return execInContainer(containerPidFd, cgroupFd, seccompFilter, containerParams.workDir, containerParams.commandList, containerParams.environment);
 
 #undef RETURN_WITH_ERROR
 }
+
+void tinyjailReleasePrepared(
+    struct tinyjailContainerHandle *handle
+) {
+    kill(handle->containerPid, SIGKILL);
+    tinyjailCollect(handle);
+}
+
+int tinyjailInitLaunchResources(
+    struct tinyjailContainerResult *result
+) {
+    memset(result, 0, sizeof(*result));
+    if (getuid() != 0) {
+        result->containerStartedStatus = -1;
+        snprintf(result->errorInfo, ERROR_INFO_SIZE, "tinyjail requires root permissions to run.");
+        return -1;
+    }
+    startCgroupReaper();
+    // The launchers get a copy of our FD table, so they inherit the kept mounts
+    if (keepDetachedMount("cgroup2", result) != 0 || keepDetachedMount("proc", result) != 0) {
+        result->containerStartedStatus = -1;
+        return -1;
+    }
+    return 0;
+}
+
+struct tinyjailContainerResult tinyjailLaunchContainer(
+    struct tinyjailContainerParams containerParams
+) {
+    struct tinyjailContainerResult result = {0};
+    struct tinyjailContainerHandle *handle = tinyjailLaunchContainerAsync(containerParams, &result);
+    if (handle == NULL) {
+        return result;
+    }
+    return tinyjailCollect(handle);
+}
+
+void tinyjailLaunchContainerEx(
+    struct tinyjailContainerParams containerParams,
+    struct tinyjailContainerResultEx *resultEx
+) {
+    struct tinyjailContainerHandle *handle = tinyjailLaunchContainerAsync(containerParams, &resultEx->result);
+    if (handle == NULL) {
+        if (resultEx->version > TINYJAIL_RESULT_EX_VERSION) {
+            resultEx->version = TINYJAIL_RESULT_EX_VERSION;
+        }
+        resultEx->resourceUsageAvailable = 0;
+        memset(&resultEx->resourceUsage, 0, sizeof(resultEx->resourceUsage));
+        if (resultEx->version >= 2) {
+            memset(resultEx->launchTimings, 0, sizeof(resultEx->launchTimings));
+        }
+        if (resultEx->version >= 3) {
+            resultEx->timedOut = 0;
+        }
+        if (resultEx->version >= 4) {
+            memset(&resultEx->capturedStdout, 0, sizeof(resultEx->capturedStdout));
+            memset(&resultEx->capturedStderr, 0, sizeof(resultEx->capturedStderr));
+            resultEx->capturedStdout.fd = -1;
+            resultEx->capturedStderr.fd = -1;
+        }
+        if (resultEx->version >= 5) {
+            resultEx->pressureAvailable = 0;
+            memset(resultEx->pressure, 0, sizeof(resultEx->pressure));
+            memset(resultEx->pressureTriggerEvents, 0, sizeof(resultEx->pressureTriggerEvents));
+        }
+        return;
+    }
+    tinyjailCollectEx(handle, resultEx);
+}
+
+struct tinyjailContainerHandle* tinyjailLaunchContainerAsync(
+    struct tinyjailContainerParams containerParams,
+    struct tinyjailContainerResult *result
+) {
+    memset(result, 0, sizeof(*result));
+    if (validateCommand(containerParams.commandList, containerParams.environment, result) != 0) {
+        return NULL;
+    }
+    struct tinyjailContainerHandle *handle = tinyjailPrepareContainer(containerParams, result);
+    if (handle == NULL) {
+        return NULL;
+    }
+    if (tinyjailStartPreparedAsync(handle, containerParams.commandList, containerParams.environment, result) != 0) {
+        return NULL;
+    }
+    return handle;
+}
+
+/// @brief Main loop of the refill thread of a pool. Prepares containers for empty slots until the pool is destroyed.
+static void* runPoolRefill(void* rawPool) {
+    struct tinyjailContainerPool *pool = rawPool;
+    pthread_mutex_lock(&pool->lock);
+    while (!pool->stopping) {
+        int slot = 0;
+        while (slot < pool->size && pool->handles[slot] != NULL) {
+            slot++;
+        }
+        if (slot == pool->size || pool->refillFailed) {
+            pthread_cond_wait(&pool->slotEmptied, &pool->lock);
+            continue;
+        }
+        // Launches never touch an empty slot, so the slot stays ours while we prepare its container
+        pthread_mutex_unlock(&pool->lock);
+        struct tinyjailContainerResult refillResult;
+        struct tinyjailContainerHandle *handle = tinyjailPrepareContainer(pool->containerParams, &refillResult);
+        pthread_mutex_lock(&pool->lock);
+        pool->handles[slot] = handle;
+        pool->refillFailed = (handle == NULL);
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+struct tinyjailContainerPool* tinyjailCreatePool(
+    struct tinyjailContainerParams containerParams,
+    int size,
+    struct tinyjailContainerResult *result
+) {
+    memset(result, 0, sizeof(*result));
+    if (size <= 0) {
+        result->containerStartedStatus = -1;
+        snprintf(result->errorInfo, ERROR_INFO_SIZE, "Container pool size must be positive.");
+        return NULL;
+    }
+    // Every prepared container needs its own cgroup and interface names, so the IDs must be generated.
+    if (containerParams.containerId != NULL) {
+        result->containerStartedStatus = -1;
+        snprintf(result->errorInfo, ERROR_INFO_SIZE, "Containers in a pool cannot have an explicit containerId.");
+        return NULL;
+    }
+    // Containers are prepared while others from the same pool run, so they would all get the same addresses.
+    // A network pool hands out a namespace which is addressed already, the addresses in the parameters are not used then.
+    if (containerParams.networkPool == NULL && (containerParams.networkIpAddr != NULL || containerParams.networkPeerIpAddr != NULL)) {
+        result->containerStartedStatus = -1;
+        snprintf(result->errorInfo, ERROR_INFO_SIZE, "Containers in a pool cannot have networkIpAddr or networkPeerIpAddr set, use a network pool instead.");
+        return NULL;
+    }
+    struct tinyjailContainerPool *pool = calloc(1, sizeof(struct tinyjailContainerPool) + size * sizeof(struct tinyjailContainerHandle*));
+    if (pool == NULL) {
+        result->containerStartedStatus = -1;
+        snprintf(result->errorInfo, ERROR_INFO_SIZE, "calloc() failed.");
+        return NULL;
+    }
+    pool->containerParams = containerParams;
+    pool->size = size;
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->slotEmptied, NULL);
+    for (int i = 0; i < size; i++) {
+        pool->handles[i] = tinyjailPrepareContainer(containerParams, result);
+        if (pool->handles[i] == NULL) {
+            for (int j = 0; j < i; j++) {
+                tinyjailReleasePrepared(pool->handles[j]);
+            }
+            free(pool);
+            return NULL;
+        }
+    }
+    // The refill thread blocks all signals, so that signals meant for the library caller's threads are never handled by it
+    sigset_t allSignals;
+    sigset_t callerSignalMask;
+    sigfillset(&allSignals);
+    pthread_sigmask(SIG_SETMASK, &allSignals, &callerSignalMask);
+    int threadError = pthread_create(&pool->refillThread, NULL, runPoolRefill, pool);
+    pthread_sigmask(SIG_SETMASK, &callerSignalMask, NULL);
+    if (threadError != 0) {
+        for (int i = 0; i < size; i++) {
+            tinyjailReleasePrepared(pool->handles[i]);
+        }
+        free(pool);
+        result->containerStartedStatus = -1;
+        snprintf(result->errorInfo, ERROR_INFO_SIZE, "Could not start pool refill thread: %s", strerror(threadError));
+        return NULL;
+    }
+    return pool;
+}
+
+struct tinyjailContainerResult tinyjailPoolLaunch(
+    struct tinyjailContainerPool *pool,
+    char** commandList,
+    char** environment
+) {
+    struct tinyjailContainerResult result = {0};
+    if (validateCommand(commandList, environment, &result) != 0) {
+        return result;
+    }
+    // Take the next prepared container and have the refill thread replace it in the background.
+    // If no slot holds one (they are all still being refilled, or refilling failed), prepare one on the spot.
+    struct tinyjailContainerHandle *handle = NULL;
+    pthread_mutex_lock(&pool->lock);
+    for (int i = 0; i < pool->size && handle == NULL; i++) {
+        int slot = (pool->nextSlot + i) % pool->size;
+        if (pool->handles[slot] != NULL) {
+            handle = pool->handles[slot];
+            pool->handles[slot] = NULL;
+            pool->nextSlot = (slot + 1) % pool->size;
+        }
+    }
+    pool->refillFailed = 0;
+    pthread_cond_signal(&pool->slotEmptied);
+    pthread_mutex_unlock(&pool->lock);
+    if (handle == NULL) {
+        handle = tinyjailPrepareContainer(pool->containerParams, &result);
+        if (handle == NULL) {
+            return result;
+        }
+    }
+    if (tinyjailStartPreparedAsync(handle, commandList, environment, &result) != 0) {
+        return result;
+    }
+    return tinyjailCollect(handle);
+}
+
+void tinyjailDestroyPool(
+    struct tinyjailContainerPool *pool
+) {
+    // Wait for the refill thread, it may be in the middle of preparing a container
+    pthread_mutex_lock(&pool->lock);
+    pool->stopping = 1;
+    pthread_cond_signal(&pool->slotEmptied);
+    pthread_mutex_unlock(&pool->lock);
+    pthread_join(pool->refillThread, NULL);
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->slotEmptied);
+    for (int i = 0; i < pool->size; i++) {
+        if (pool->handles[i] != NULL) {
+            tinyjailReleasePrepared(pool->handles[i]);
+        }
+    }
+    free(pool);
+}
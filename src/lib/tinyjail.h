@@ -2,6 +2,43 @@
 
 #pragma once
 
+#include <stdint.h>
+
+/// @brief Resources whose pressure stall information (PSI) is tracked for a container, in the order of its arrays
+enum tinyjailPressureResource {
+    /// @brief cpu.pressure of the container cgroup
+    TINYJAIL_PRESSURE_CPU,
+    /// @brief memory.pressure of the container cgroup
+    TINYJAIL_PRESSURE_MEMORY,
+    /// @brief io.pressure of the container cgroup
+    TINYJAIL_PRESSURE_IO,
+    TINYJAIL_PRESSURE_RESOURCE_COUNT
+};
+
+/// @brief A PSI trigger, which fires when the tasks of a container were stalled on a resource for stallMicroseconds within windowMicroseconds.
+struct tinyjailPressureTrigger {
+    /// @brief Stall time which fires the trigger. 0 for no trigger.
+    long stallMicroseconds;
+    /// @brief Time window the stall time is measured in, between 500 ms and 10 s. If 0, it is 2 s.
+    /// Without CAP_SYS_RESOURCE in the initial user namespace, the kernel only accepts multiples of 2 s.
+    long windowMicroseconds;
+    /// @brief If nonzero, only count the time in which all tasks were stalled at once ("full"), otherwise any task ("some")
+    int full;
+};
+
+/// @brief The kinds of network interface a container with its own network namespace can get
+enum tinyjailNetworkMode {
+    /// @brief A vEth pair, whose outside end is optionally attached to networkBridgeName
+    TINYJAIL_NETWORK_VETH,
+    /// @brief A macvlan interface (in bridge mode) on networkParentDevice, with a MAC address of its own
+    TINYJAIL_NETWORK_MACVLAN,
+    /// @brief An ipvlan interface in L2 mode on networkParentDevice, which shares the MAC address of the parent
+    TINYJAIL_NETWORK_IPVLAN_L2,
+    /// @brief An ipvlan interface in L3 mode on networkParentDevice, where the parent routes packets instead of switching them
+    TINYJAIL_NETWORK_IPVLAN_L3,
+    TINYJAIL_NETWORK_MODE_COUNT
+};
+
 /// @brief Encapsulates all parameters used to run a container process.
 struct tinyjailContainerParams {
     /// @brief Optional explicit ID for the container. If left at NULL, a random ID is generated.
@@ -21,12 +58,39 @@ struct tinyjailContainerParams {
     long uid;
     /// @brief Host GID for the container to run as. If -1 is specified, the owner of the container root directory is used.
     long gid;
+    /// @brief If nonzero, the container root is mounted with an ID mapping (an idmapped mount) to the user namespace of the container:
+    /// files owned by host root show up as owned by uid and gid on the host, and thus by root inside the container, without changing
+    /// anything on disk. This way one root directory (e.g. owned by root:root) can be shared by containers with different UIDs.
+    /// Files owned by other IDs show up as owned by nobody. uid and gid have to be set, and all filesystems mounted at or under
+    /// the container root have to support idmapped mounts, which overlayfs does not: it cannot be combined with rootfsLowerDirs.
+    int idmapRootfs;
 
     /// @brief NULL-terminated list of "filename=value" strings that specify cgroup options like resource limits.
     char** cgroupOptions;
+    /// @brief Optional path of a cgroup (relative to the cgroup root, e.g. "tenants/a") which the container cgroup is created in,
+    /// instead of the cgroup root. Limits set on it are shared by all containers in it. Missing cgroups on the path are created.
+    /// All cgroups on the path (also existing ones) get all controllers enabled for their children, so none of them may contain processes.
+    /// The cgroups are never removed by tinyjail, unless setting them up fails.
+    char* parentCgroup;
+    /// @brief NULL-terminated list of "filename=value" options which the parent cgroup is configured with when it is created, e.g. "memory.max=1G".
+    /// They are not applied again if the parent cgroup exists already.
+    char** parentCgroupOptions;
+    /// @brief If positive, the container is pinned to this many CPUs (cpuset.cpus) and the memory of their NUMA node (cpuset.mems).
+    /// The CPUs are picked to be close together, on one node if possible, and as little shared with other placed containers (in any parent cgroup) as possible.
+    /// The CPUs count as taken until the container is collected.
+    /// Only CPUs the parent cgroup may use are considered. cpuset options in cgroupOptions take precedence.
+    long cpuCount;
 
     /// @brief Set to nonzero if the container should use the host network namespace. All other network options are ignored.
     int useHostNetwork;
+    /// @brief The network interface of the container (see enum tinyjailNetworkMode). By default, it's a vEth pair.
+    /// macvlan and ipvlan interfaces skip the vEth pair and the bridge on the way to the parent device, but the host cannot reach
+    /// the container through the parent device itself (only through another macvlan/ipvlan interface on it).
+    /// The vEth tuning options (networkQueueCount, networkMtu, networkTxQueueLength, networkGro) only apply to vEth pairs.
+    int networkMode;
+    /// @brief The device the macvlan or ipvlan interface is created on. Required for those modes, cannot be combined with
+    /// networkBridgeName or networkPeerIpAddr.
+    char* networkParentDevice;
     /// @brief If networkBridgeName is not NULL, set the master of the container's vEth interface to the given bridge.
     char* networkBridgeName;
     /// @brief If networkIpAddr is not NULL, set the container's vEth interface IP address to this.
@@ -35,9 +99,122 @@ struct tinyjailContainerParams {
     char* networkPeerIpAddr;
     /// @brief If networkDefaultRoute is not NULL, set the default route of the container's vEth interface to the given destination.
     char* networkDefaultRoute;
+    /// @brief If positive, both ends of the vEth pair get this many TX and RX queues instead of one, so traffic can be spread over several CPUs.
+    int networkQueueCount;
+    /// @brief If positive, the MTU of both ends of the vEth pair. A large MTU (up to 65535) cuts the per-packet cost of local traffic.
+    int networkMtu;
+    /// @brief If positive, the TX queue length of both ends of the vEth pair.
+    int networkTxQueueLength;
+    /// @brief Set to nonzero to enable GRO on both ends of the vEth pair, which also switches vEth reception to NAPI.
+    int networkGro;
 
     /// @brief Sets the hostname inside the container. If set to NULL, it's set to "tinyjail".
     char* hostname;
+
+    /// @brief Optional NULL-terminated list of read-only directories which are stacked with overlayfs to form the container root, top-most first.
+    /// The directories can be shared by any number of containers. If set, containerDir is only the mount point of the overlay
+    /// (e.g. an empty directory) - its owner still determines the default UID and GID of the container.
+    char** rootfsLowerDirs;
+    /// @brief Optional directory which receives the container's changes to an overlay root, must be writeable by the container UID.
+    /// If NULL, the changes are kept on a tmpfs and discarded when the container exits.
+    char* rootfsUpperDir;
+    /// @brief Empty directory on the same filesystem as rootfsUpperDir, used internally by overlayfs. Required if rootfsUpperDir is set.
+    char* rootfsWorkDir;
+
+    /// @brief If positive, the container is killed once it has run for this many milliseconds (counted from when its command is started).
+    long timeoutMilliseconds;
+
+    /// @brief Optional pool of ready-made network namespaces (see tinyjailCreateNetworkPool()). If set, the container joins one of them
+    /// instead of getting a new one, and useHostNetwork and the other network parameters are ignored.
+    struct tinyjailNetworkPool *networkPool;
+
+    /// @brief Where stdout of the container goes (see enum tinyjailOutputMode). By default, the container inherits the caller's stdout.
+    int stdoutMode;
+    /// @brief File for TINYJAIL_OUTPUT_FILE. It is created if needed and appended to.
+    char* stdoutPath;
+    /// @brief Where stderr of the container goes, as for stdoutMode. TINYJAIL_OUTPUT_STDOUT sends it to the same place as stdout.
+    int stderrMode;
+    char* stderrPath;
+    /// @brief Size of the ring buffers of TINYJAIL_OUTPUT_RING in bytes. If 0, it is 1 MiB.
+    long outputRingSize;
+
+    /// @brief System call filter installed right before the container command is executed (see enum tinyjailSeccompProfile).
+    int seccompProfile;
+
+    /// @brief PSI triggers on the container cgroup, indexed by enum tinyjailPressureResource. Each time a trigger fires,
+    /// pressureCallback is called and the count in the extended result goes up. Triggers fire at most once per window.
+    struct tinyjailPressureTrigger pressureTriggers[TINYJAIL_PRESSURE_RESOURCE_COUNT];
+    /// @brief Optional callback for fired triggers, with pressureCallbackContext and the enum tinyjailPressureResource of the trigger.
+    /// It is called from tinyjailHandleEvents(), or while tinyjailCollect() and the blocking launch functions wait for the container.
+    /// It is not called for containers launched through the daemon.
+    void (*pressureCallback)(void* context, int resource);
+    void* pressureCallbackContext;
+
+    /// @brief If positive, the resource usage of the container is sampled at this interval while its command runs,
+    /// and each sample is written to telemetryFd as a struct tinyjailTelemetryRecord. A last record is written when the container exits.
+    /// Sampling happens while the container is supervised (see tinyjailHandleEvents()). Not supported through the daemon.
+    long telemetryIntervalMilliseconds;
+    /// @brief FD the telemetry records are written to, e.g. a file or a pipe. It is not closed by tinyjail.
+    /// Sampling stops if a write fails with anything other than EAGAIN (in which case only that record is dropped).
+    int telemetryFd;
+};
+
+/// @brief A sample of the resource usage of a running container (see telemetryIntervalMilliseconds).
+/// Records have a fixed size and are written with a single write(), so records of several containers sharing a pipe do not interleave.
+/// Counters of controllers which are not enabled for the container cgroup are 0.
+struct tinyjailTelemetryRecord {
+    /// @brief ID of the container, NUL-padded
+    char containerId[16];
+    /// @brief CLOCK_MONOTONIC time the sample was taken at, in nanoseconds
+    uint64_t timestampNanoseconds;
+    /// @brief Number of the record, counting from 0 for each container
+    uint32_t sequence;
+    /// @brief Set on the last record, which is taken after the container exited
+    uint32_t final;
+    /// @brief Total, user, system and throttled CPU time (cpu.stat usage_usec, user_usec, system_usec, throttled_usec)
+    uint64_t cpuUsageUsec;
+    uint64_t cpuUserUsec;
+    uint64_t cpuSystemUsec;
+    uint64_t cpuThrottledUsec;
+    /// @brief Current memory usage (memory.current), and its anonymous, page cache and kernel parts (memory.stat anon, file, kernel)
+    uint64_t memoryCurrentBytes;
+    uint64_t memoryAnonBytes;
+    uint64_t memoryFileBytes;
+    uint64_t memoryKernelBytes;
+    /// @brief Bytes and operations read and written so far, summed over all devices (io.stat rbytes, wbytes, rios, wios)
+    uint64_t ioReadBytes;
+    uint64_t ioWriteBytes;
+    uint64_t ioReadOperations;
+    uint64_t ioWriteOperations;
+    /// @brief Current number of processes in the container (pids.current)
+    uint64_t pidsCurrent;
+};
+
+/// @brief Where an output stream of a container goes.
+enum tinyjailOutputMode {
+    /// @brief The container inherits the stream from the library caller
+    TINYJAIL_OUTPUT_INHERIT,
+    /// @brief The container writes straight into a file
+    TINYJAIL_OUTPUT_FILE,
+    /// @brief The container writes straight into a memfd, which is returned in the extended result
+    TINYJAIL_OUTPUT_MEMFD,
+    /// @brief The output goes into a memfd used as a ring buffer, which keeps the last outputRingSize bytes and is returned in the extended result.
+    /// It is fed from a pipe with splice() whenever the container is supervised (see tinyjailHandleEvents()).
+    TINYJAIL_OUTPUT_RING,
+    /// @brief Only for stderr: the same destination as stdout
+    TINYJAIL_OUTPUT_STDOUT
+};
+
+/// @brief Built-in seccomp profiles. Blocked system calls fail with EPERM, processes of a foreign architecture (e.g. x32) are killed.
+/// A profile is compiled into a BPF binary search the first time it is used, and the program is cached for all later launches.
+enum tinyjailSeccompProfile {
+    /// @brief No filtering
+    TINYJAIL_SECCOMP_NONE,
+    /// @brief Blocks the system calls which act on the whole host: kernel modules, kexec, reboot, clocks, swap, keyrings, bpf(), perf events, io_uring, ...
+    TINYJAIL_SECCOMP_DEFAULT,
+    /// @brief Also keeps the container from changing its mounts, namespaces and hostname, and from accessing the memory of other processes
+    TINYJAIL_SECCOMP_STRICT,
+    TINYJAIL_SECCOMP_PROFILE_COUNT
 };
 
 // Try to keep this struct at 256 B
@@ -54,3 +231,359 @@ struct tinyjailContainerResult {
 __attribute__ ((visibility ("default"))) struct tinyjailContainerResult tinyjailLaunchContainer(
     struct tinyjailContainerParams programArgs
 );
+
+/// @brief Resource usage of a container, read from its cgroup right before the cgroup is removed.
+/// Counters cover the whole container cgroup including its sub-cgroups. Counters of controllers which are not enabled
+/// for the container cgroup (or not supported by the kernel) are left at 0.
+struct tinyjailContainerUsage {
+    /// @brief Total, user and system CPU time (cpu.stat usage_usec, user_usec, system_usec)
+    uint64_t cpuUsageUsec;
+    uint64_t cpuUserUsec;
+    uint64_t cpuSystemUsec;
+    /// @brief Number of periods in which the container was throttled, and the total throttled time (cpu.stat nr_throttled, throttled_usec)
+    uint64_t cpuThrottledPeriods;
+    uint64_t cpuThrottledUsec;
+    /// @brief Highest memory usage of the container (memory.peak)
+    uint64_t memoryPeakBytes;
+    /// @brief Number of times the container hit its memory limit and the OOM killer killed a process in it (memory.events oom, oom_kill)
+    uint64_t memoryOomEvents;
+    uint64_t memoryOomKillEvents;
+    /// @brief Bytes and operations read and written, summed over all devices (io.stat rbytes, wbytes, rios, wios)
+    uint64_t ioReadBytes;
+    uint64_t ioWriteBytes;
+    uint64_t ioReadOperations;
+    uint64_t ioWriteOperations;
+    /// @brief Highest number of processes in the container (pids.peak)
+    uint64_t pidsPeak;
+};
+
+/// @brief Points in time during a container launch, in the order they happen.
+/// The PREPARE phases run when the container is prepared, the others when it is started.
+/// Phases marked "launcher" are recorded by the short-lived launcher process, "child" ones by the container process before its execve().
+enum tinyjailLaunchPhase {
+    /// @brief tinyjailPrepareContainer() was called
+    TINYJAIL_PHASE_PREPARE_START,
+    /// @brief (launcher) The launcher process is running
+    TINYJAIL_PHASE_LAUNCHER_STARTED,
+    /// @brief (launcher) The launcher has its own mount namespace with private mounts, and the overlay root (if any) is mounted
+    TINYJAIL_PHASE_MOUNT_NAMESPACE_READY,
+    /// @brief (launcher) cgroupfs is mounted
+    TINYJAIL_PHASE_CGROUPFS_MOUNTED,
+    /// @brief (launcher) The container cgroup is created, delegated and configured
+    TINYJAIL_PHASE_CGROUP_READY,
+    /// @brief (launcher) procfs is mounted
+    TINYJAIL_PHASE_PROCFS_MOUNTED,
+    /// @brief (launcher) The container process is created with its namespaces
+    TINYJAIL_PHASE_CLONED,
+    /// @brief (launcher) UID and GID mappings of the container are written
+    TINYJAIL_PHASE_USER_NAMESPACE_READY,
+    /// @brief (launcher) The container network is configured
+    TINYJAIL_PHASE_NETWORK_READY,
+    /// @brief The container is prepared and the launcher has exited
+    TINYJAIL_PHASE_PREPARED,
+    /// @brief The command is being sent to the prepared container
+    TINYJAIL_PHASE_START,
+    /// @brief (child) The container process has received its command
+    TINYJAIL_PHASE_CHILD_COMMAND_RECEIVED,
+    /// @brief (child) The container root is bind-mounted and pivoted into, the old root is unmounted
+    TINYJAIL_PHASE_CHILD_ROOT_READY,
+    /// @brief (child) The container process is about to execve() the command
+    TINYJAIL_PHASE_CHILD_EXEC,
+    /// @brief The execve() succeeded
+    TINYJAIL_PHASE_STARTED,
+    /// @brief The container exited and was reaped
+    TINYJAIL_PHASE_EXITED,
+    TINYJAIL_LAUNCH_PHASE_COUNT
+};
+
+/// @brief The version of tinyjailContainerResultEx this header describes.
+/// Newer versions only add fields at the end of the struct, so older callers keep working with newer libraries.
+#define TINYJAIL_RESULT_EX_VERSION (5)
+
+/// @brief Output of a container which was captured with TINYJAIL_OUTPUT_MEMFD or TINYJAIL_OUTPUT_RING.
+struct tinyjailCapturedOutput {
+    /// @brief memfd holding the output, owned by the caller (who has to close it). -1 if the stream was not captured.
+    int32_t fd;
+    int32_t reserved;
+    /// @brief Offset of the oldest captured byte in the memfd. The data wraps around at the end of the memfd (only for TINYJAIL_OUTPUT_RING).
+    uint64_t offset;
+    /// @brief Number of captured bytes
+    uint64_t size;
+    /// @brief Number of bytes that were overwritten because the ring buffer was full
+    uint64_t droppedBytes;
+};
+
+/// @brief Stall times of one kind ("some" or "full") in a pressure file.
+struct tinyjailPressureTotals {
+    /// @brief Share of the time in percent in which tasks were stalled, as a running average over 10 s, 60 s and 300 s
+    double avg10;
+    double avg60;
+    double avg300;
+    /// @brief Total time in microseconds in which tasks were stalled
+    uint64_t totalUsec;
+};
+
+/// @brief Pressure stall information of a resource, read from its pressure file in the container cgroup.
+struct tinyjailPressureStats {
+    /// @brief Stalls of at least one task
+    struct tinyjailPressureTotals some;
+    /// @brief Stalls of all tasks at once. Always 0 for CPU pressure of the container cgroup on older kernels.
+    struct tinyjailPressureTotals full;
+};
+
+/// @brief Extended result of a container run. tinyjailContainerResult keeps its size, everything else goes here.
+struct tinyjailContainerResultEx {
+    /// @brief Set by the caller to TINYJAIL_RESULT_EX_VERSION. The library only fills fields which exist in that version,
+    /// and lowers the value if it is newer than the library.
+    uint32_t version;
+    /// @brief Set to nonzero if resourceUsage was read from the container cgroup.
+    int32_t resourceUsageAvailable;
+    /// @brief The basic result, as returned by tinyjailLaunchContainer()
+    struct tinyjailContainerResult result;
+    /// @brief Resource usage of the container (since version 1)
+    struct tinyjailContainerUsage resourceUsage;
+    /// @brief CLOCK_MONOTONIC timestamps (in nanoseconds) of each tinyjailLaunchPhase, 0 for phases that were not reached (since version 2)
+    uint64_t launchTimings[TINYJAIL_LAUNCH_PHASE_COUNT];
+    /// @brief Set to nonzero if the container was killed because it exceeded timeoutMilliseconds (since version 3)
+    int32_t timedOut;
+    /// @brief Captured stdout and stderr of the container (since version 4). With plain tinyjailCollect(), captured output is discarded.
+    struct tinyjailCapturedOutput capturedStdout;
+    struct tinyjailCapturedOutput capturedStderr;
+    /// @brief Set to nonzero if pressure was read from the container cgroup (since version 5). It is not available on kernels without PSI.
+    int32_t pressureAvailable;
+    int32_t reserved;
+    /// @brief Final pressure stall information of the container, indexed by enum tinyjailPressureResource (since version 5)
+    struct tinyjailPressureStats pressure[TINYJAIL_PRESSURE_RESOURCE_COUNT];
+    /// @brief Number of times each of the pressureTriggers fired (since version 5)
+    uint64_t pressureTriggerEvents[TINYJAIL_PRESSURE_RESOURCE_COUNT];
+};
+
+/// @brief Like tinyjailLaunchContainer(), but also returns the resource usage and launch timings of the container.
+/// @param programArgs Container parameters
+/// @param resultEx Output: the extended result. Its version field must be set by the caller.
+__attribute__ ((visibility ("default"))) void tinyjailLaunchContainerEx(
+    struct tinyjailContainerParams programArgs,
+    struct tinyjailContainerResultEx *resultEx
+);
+
+/// @brief Handle to a container. A container is first prepared (namespaces, cgroup, user mappings and network are set up),
+/// then started with a command, and finally collected once it exits.
+/// The container init process is a direct child of the library caller, so the caller must not reap it by other means
+/// (e.g. waitpid(-1, ...) or setting SIGCHLD to SIG_IGN).
+struct tinyjailContainerHandle;
+
+/// @brief Prepares a container: everything up to the pivot_root() and execve() of the container init process is done here.
+/// The commandList and environment fields of the parameters are ignored, they are given to tinyjailStartPrepared() instead.
+/// @param programArgs Container parameters
+/// @param result Output: on failure, containerStartedStatus is nonzero and errorInfo describes the error
+/// @return A handle to the prepared container, or NULL on failure. No launcher process is left running for it.
+/// The handle must be passed to one of tinyjailStartPrepared(), tinyjailStartPreparedAsync() or tinyjailReleasePrepared().
+__attribute__ ((visibility ("default"))) struct tinyjailContainerHandle* tinyjailPrepareContainer(
+    struct tinyjailContainerParams programArgs,
+    struct tinyjailContainerResult *result
+);
+
+/// @brief Runs a command in a prepared container and waits until the container exits.
+/// @param handle The prepared container. It is freed by this function.
+/// @param commandList Same layout as tinyjailContainerParams.commandList
+/// @param environment Same layout as tinyjailContainerParams.environment
+/// @return The result of the container run, as for tinyjailLaunchContainer()
+__attribute__ ((visibility ("default"))) struct tinyjailContainerResult tinyjailStartPrepared(
+    struct tinyjailContainerHandle *handle,
+    char** commandList,
+    char** environment
+);
+
+/// @brief Runs a command in a prepared container without waiting for the container to exit.
+/// The function returns once the command has been execve()-ed inside the container.
+/// @param handle The prepared container. On success, it must be passed to tinyjailCollect() later. On failure, it is freed.
+/// @param commandList Same layout as tinyjailContainerParams.commandList
+/// @param environment Same layout as tinyjailContainerParams.environment
+/// @param result Output: on failure, containerStartedStatus is nonzero and errorInfo describes the error
+/// @return 0 on success, -1 on failure
+__attribute__ ((visibility ("default"))) int tinyjailStartPreparedAsync(
+    struct tinyjailContainerHandle *handle,
+    char** commandList,
+    char** environment,
+    struct tinyjailContainerResult *result
+);
+
+/// @brief Launches a container without waiting for it to exit. Equivalent to tinyjailPrepareContainer() followed by tinyjailStartPreparedAsync().
+/// @param programArgs Container parameters
+/// @param result Output: on failure, containerStartedStatus is nonzero and errorInfo describes the error
+/// @return A handle to the running container, which must be passed to tinyjailCollect() later, or NULL on failure.
+__attribute__ ((visibility ("default"))) struct tinyjailContainerHandle* tinyjailLaunchContainerAsync(
+    struct tinyjailContainerParams programArgs,
+    struct tinyjailContainerResult *result
+);
+
+/// @brief Returns an FD which can be polled (e.g. with epoll) and becomes readable whenever the container needs attention:
+/// it exited, its deadline expired, its cgroup reported an event, or a pressure trigger fired. Call tinyjailHandleEvents() when it is readable.
+/// The FD belongs to the handle and is closed by tinyjailCollect().
+/// @param handle The container
+/// @return The FD
+__attribute__ ((visibility ("default"))) int tinyjailContainerFd(
+    struct tinyjailContainerHandle *handle
+);
+
+/// @brief Handles all pending events of a started container without blocking, e.g. kills it if its deadline expired.
+/// @param handle The container
+/// @return 1 if the container has exited (tinyjailCollect() will not block), 0 if it is still running
+__attribute__ ((visibility ("default"))) int tinyjailHandleEvents(
+    struct tinyjailContainerHandle *handle
+);
+
+/// @brief Waits for a started container to exit (this does not block if its FD is readable), removes its cgroup and frees the handle.
+/// @param handle The container
+/// @return The result of the container run, as for tinyjailLaunchContainer()
+__attribute__ ((visibility ("default"))) struct tinyjailContainerResult tinyjailCollect(
+    struct tinyjailContainerHandle *handle
+);
+
+/// @brief Like tinyjailCollect(), but also returns the resource usage and launch timings of the container.
+/// @param handle The container
+/// @param resultEx Output: the extended result. Its version field must be set by the caller.
+__attribute__ ((visibility ("default"))) void tinyjailCollectEx(
+    struct tinyjailContainerHandle *handle,
+    struct tinyjailContainerResultEx *resultEx
+);
+
+/// @brief Runs another command in a running container and waits until it exits. The command joins the namespaces and the cgroup
+/// of the container and runs as its root user, with the working directory and the seccomp profile of the container,
+/// so this costs about as much as a fork() and execve() instead of a whole container launch.
+/// The command writes to the stdout and stderr of the caller. It is killed when the container init exits.
+/// This can be called while another thread handles the events of the container, but it must return before the container is collected.
+/// Needs Linux 5.8 or later.
+/// @param handle The container, which has been started
+/// @param commandList Same layout as tinyjailContainerParams.commandList
+/// @param environment Same layout as tinyjailContainerParams.environment
+/// @return The result of the command: containerStartedStatus is nonzero if it could not be started, otherwise containerExitStatus is its exit status
+__attribute__ ((visibility ("default"))) struct tinyjailContainerResult tinyjailExec(
+    struct tinyjailContainerHandle *handle,
+    char** commandList,
+    char** environment
+);
+
+/// @brief Like tinyjailExec(), for a container which may have been launched by another process (e.g. by tinyjaild). The container is found by its cgroup.
+/// @param programArgs containerId and parentCgroup (if the container was launched with one) identify the container. commandList, environment,
+/// workDir and seccompProfile are used for the command. All other fields are ignored.
+/// @return The result of the command, as for tinyjailExec()
+__attribute__ ((visibility ("default"))) struct tinyjailContainerResult tinyjailExecById(
+    struct tinyjailContainerParams programArgs
+);
+
+/// @brief Tears down a prepared container without starting it.
+/// @param handle The prepared container. It is freed by this function.
+__attribute__ ((visibility ("default"))) void tinyjailReleasePrepared(
+    struct tinyjailContainerHandle *handle
+);
+
+/// @brief A fixed number of prepared containers that are all created from the same parameters.
+/// Launching through the pool only costs the pivot_root() and execve() of an already prepared container,
+/// the container is replaced with a freshly prepared one by a background thread of the pool.
+/// Launches can come from several threads at the same time, they take the prepared containers in turn.
+struct tinyjailContainerPool;
+
+/// @brief Creates a pool and prepares all of its containers.
+/// @param programArgs Parameters for every container in the pool. containerId must be NULL, so every container gets a random ID.
+/// networkIpAddr and networkPeerIpAddr must be NULL unless networkPool is set, since containers of the pool run at the same time.
+/// All strings in the parameters must stay valid until the pool is destroyed.
+/// @param size Number of containers to keep prepared
+/// @param result Output: on failure, containerStartedStatus is nonzero and errorInfo describes the error
+/// @return The pool, or NULL on failure
+__attribute__ ((visibility ("default"))) struct tinyjailContainerPool* tinyjailCreatePool(
+    struct tinyjailContainerParams programArgs,
+    int size,
+    struct tinyjailContainerResult *result
+);
+
+/// @brief Runs a command in one of the prepared containers of the pool and waits until the container exits.
+/// If the pool has no prepared container left (e.g. more launches than slots run at the same time), one is prepared on the spot.
+/// @param pool The pool
+/// @param commandList Same layout as tinyjailContainerParams.commandList
+/// @param environment Same layout as tinyjailContainerParams.environment
+/// @return The result of the container run, as for tinyjailLaunchContainer()
+__attribute__ ((visibility ("default"))) struct tinyjailContainerResult tinyjailPoolLaunch(
+    struct tinyjailContainerPool *pool,
+    char** commandList,
+    char** environment
+);
+
+/// @brief Tears down all prepared containers of the pool and frees it. No launch may be running on the pool.
+/// @param pool The pool
+__attribute__ ((visibility ("default"))) void tinyjailDestroyPool(
+    struct tinyjailContainerPool *pool
+);
+
+/// @brief A set of network namespaces which are set up ahead of time, each with its vEth pair attached to the bridge and addressed.
+/// A container using the pool joins an idle namespace when it is cloned and hands it back once it is collected, so launching it
+/// takes no RTNL lock at all. The namespaces belong to the host user namespace: processes in the container can use the network
+/// (including ports below 1024), but cannot change its configuration, so a namespace needs no cleanup between containers.
+/// If more containers run at the same time than there are idle namespaces, the pool grows, unless networkPeerIpAddr is set.
+struct tinyjailNetworkPool;
+
+/// @brief Creates a network pool and sets up its namespaces.
+/// @param programArgs Network parameters (networkBridgeName, networkIpAddr, networkPeerIpAddr, networkDefaultRoute and the vEth tuning options) for every namespace,
+/// all other fields are ignored. networkIpAddr is the address of the first namespace, every further namespace (including those added
+/// when the pool grows) gets the next address, e.g. 10.0.0.2/24, 10.0.0.3/24, ... Creating a namespace fails once the addresses leave the prefix.
+/// The host end of every vEth pair would need a subnet of its own, so with networkPeerIpAddr set, the pool must have size 1 and does not grow:
+/// launching a container while the namespace is in use fails.
+/// All strings in the parameters must stay valid until the pool is destroyed.
+/// @param size Number of namespaces to set up right away
+/// @param result Output: on failure, containerStartedStatus is nonzero and errorInfo describes the error
+/// @return The pool, or NULL on failure. It can be used from several threads at the same time.
+__attribute__ ((visibility ("default"))) struct tinyjailNetworkPool* tinyjailCreateNetworkPool(
+    struct tinyjailContainerParams programArgs,
+    int size,
+    struct tinyjailContainerResult *result
+);
+
+/// @brief Destroys all namespaces of the pool and frees it. All containers which use the pool must have been collected.
+/// @param pool The pool
+__attribute__ ((visibility ("default"))) void tinyjailDestroyNetworkPool(
+    struct tinyjailNetworkPool *pool
+);
+
+/// @brief Sets up resources which are otherwise created for every launch and keeps them for the lifetime of the process:
+/// the detached cgroupfs and procfs mounts used by the launcher, and the cgroup reaper.
+/// Meant for long-lived processes which launch many containers, like tinyjaild.
+/// Must be called before containers are launched from several threads.
+/// @param result Output: on failure, containerStartedStatus is nonzero and errorInfo describes the error
+/// @return 0 on success, -1 on failure
+__attribute__ ((visibility ("default"))) int tinyjailInitLaunchResources(
+    struct tinyjailContainerResult *result
+);
+
+/// @brief Connects to a tinyjaild daemon, which launches containers on behalf of its clients.
+/// Any number of requests can be submitted over one connection, their results come back as the containers exit.
+/// Paths in the container parameters are resolved by the daemon, so they should be absolute. networkPool is not passed on.
+/// @param socketPath Path of the daemon's Unix socket
+/// @param result Output: on failure, containerStartedStatus is nonzero and errorInfo describes the error
+/// @return The connection (close it with close() when done), or -1 on failure
+__attribute__ ((visibility ("default"))) int tinyjailDaemonConnect(
+    const char* socketPath,
+    struct tinyjailContainerResult *result
+);
+
+/// @brief Asks the daemon to launch a container. Does not wait for the container to start or exit.
+/// @param daemonFd Connection returned by tinyjailDaemonConnect()
+/// @param requestId Chosen by the caller, returned with the result of the launch by tinyjailDaemonReceive()
+/// @param programArgs Container parameters
+/// @return 0 on success, -1 on failure (errno is set, to ENOTSUP if telemetry is requested)
+__attribute__ ((visibility ("default"))) int tinyjailDaemonSubmit(
+    int daemonFd,
+    uint64_t requestId,
+    struct tinyjailContainerParams programArgs
+);
+
+/// @brief Waits for the result of the next container launched through the connection to exit (or to fail to launch).
+/// Results come back in the order the containers exit, not in the order they were submitted.
+/// @param daemonFd Connection returned by tinyjailDaemonConnect()
+/// @param requestId Output: the ID the request was submitted with
+/// @param resultEx Output: the extended result. Its version field must be set by the caller.
+/// @return 0 on success, -1 on failure or if the daemon closed the connection (errno is set)
+__attribute__ ((visibility ("default"))) int tinyjailDaemonReceive(
+    int daemonFd,
+    uint64_t *requestId,
+    struct tinyjailContainerResultEx *resultEx
+);
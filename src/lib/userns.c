@@ -3,21 +3,20 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <string.h>
-#include <sys/mount.h>
 #include <unistd.h>
 
 #include "userns.h"
 #include "utils.h"
 
-static int configureContainerUserNamespace(
-    const char* procfsPath,
+int setupContainerUserNamespace(
     int childPid, 
+    int procfsFd,
     const struct tinyjailContainerParams* containerParams,
     struct tinyjailContainerResult *result
 ) {
-    ALLOC_LOCAL_FORMAT_STRING(procfsProcPath, "%s/%d", procfsPath, childPid);
+    ALLOC_LOCAL_FORMAT_STRING(procfsProcPath, "%d", childPid);
 
-    RAII_FD procFd = open(procfsProcPath, 0);
+    RAII_FD procFd = openat(procfsFd, procfsProcPath, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
     if (procFd < 0) {
         snprintf(result->errorInfo, ERROR_INFO_SIZE, "Could not open child process's procfs: %s.", strerror(errno));
         return -1;
@@ -41,25 +40,3 @@ static int configureContainerUserNamespace(
     }
     return 0;
 }
-
-int setupContainerUserNamespace(
-    int childPid, 
-    const struct tinyjailContainerParams* containerParams,
-    struct tinyjailContainerResult *result
-) {
-    if (mount("proc", containerParams->containerDir, "proc", 0, NULL) != 0) {
-        snprintf(result->errorInfo, ERROR_INFO_SIZE, "Could not mount temporary procfs: %s", strerror(errno));
-        return -1;
-    }
-    int configureUsernsResult = configureContainerUserNamespace(containerParams->containerDir, childPid, containerParams, result);
-    int umount2Result = umount2(containerParams->containerDir, MNT_DETACH);
-    int umount2Errno = errno;
-    if (configureUsernsResult != 0) {
-        return -1;
-    }
-    if (umount2Result != 0) {
-        snprintf(result->errorInfo, ERROR_INFO_SIZE, "Could not umount temporary procfs mount: %s", strerror(umount2Errno));
-        return -1;
-    }
-    return 0;
-}
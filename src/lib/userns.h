@@ -6,11 +6,13 @@
 
 /// @brief Sets up the container's user namespace.
 /// @param childPid PID of the container process
+/// @param procfsFd FD of the root directory of a procfs mount
 /// @param containerParams Container parameters
 /// @param result Result object passed to the library caller
 /// @return 0 on success, -1 on failure
 int setupContainerUserNamespace(
     int childPid, 
+    int procfsFd,
     const struct tinyjailContainerParams* containerParams,
     struct tinyjailContainerResult *result
 );
@@ -1,10 +1,92 @@
 // SPDX-License-Identifier: MIT
 
-#include <unistd.h>
+// _GNU_SOURCE is needed for clone() and _NSIG
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdint.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
 
 #include "utils.h"
 
+// Upper bound for the size of a serialized command, so a corrupt header cannot make us map huge amounts of memory.
+#define MAX_COMMAND_STRINGS_SIZE (16 * 1024 * 1024)
+
+/// @brief Precedes the strings of a serialized command. The strings follow back-to-back, each NULL-terminated,
+/// first the command list and then the environment.
+struct commandHeader {
+    uint32_t commandCount;
+    uint32_t environmentCount;
+    uint32_t stringsSize;
+};
+
+// Stack of the processes started by runInSharedMemoryProcess(). The launcher needs a few tens of KB at most.
+#define SHARED_MEMORY_PROCESS_STACK_SIZE (256 * 1024)
+
+struct sharedMemoryProcessArgs {
+    int (*function)(void*);
+    void* arg;
+    const sigset_t *callerSignalMask;
+};
+
+static int runSharedMemoryProcess(void* rawArgs) {
+    struct sharedMemoryProcessArgs *args = rawArgs;
+    // Signal handlers of the caller must not run here, on memory shared with it. The handler table is our own copy, so the caller keeps its handlers.
+    struct sigaction defaultAction = { .sa_handler = SIG_DFL };
+    for (int signalNumber = 1; signalNumber < _NSIG; signalNumber++) {
+        struct sigaction action;
+        if (sigaction(signalNumber, NULL, &action) == 0 && action.sa_handler != SIG_DFL && action.sa_handler != SIG_IGN) {
+            sigaction(signalNumber, &defaultAction, NULL);
+        }
+    }
+    sigprocmask(SIG_SETMASK, args->callerSignalMask, NULL);
+    _exit(args->function(args->arg));
+}
+
+int runInSharedMemoryProcess(int (*function)(void*), void* arg) {
+    // The stack gets a guard page at its bottom, so an overflow faults instead of running into other memory of the caller
+    long pageSize = sysconf(_SC_PAGESIZE);
+    size_t mappingSize = SHARED_MEMORY_PROCESS_STACK_SIZE + pageSize;
+    char* stack = mmap(NULL, mappingSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_STACK, -1, 0);
+    if (stack == MAP_FAILED) {
+        return -1;
+    }
+    if (mprotect(stack, pageSize, PROT_NONE) != 0) {
+        int mprotectErrno = errno;
+        munmap(stack, mappingSize);
+        errno = mprotectErrno;
+        return -1;
+    }
+    // Block all signals until the child has reset the handlers it inherited
+    sigset_t allSignals;
+    sigset_t callerSignalMask;
+    sigfillset(&allSignals);
+    pthread_sigmask(SIG_SETMASK, &allSignals, &callerSignalMask);
+    struct sharedMemoryProcessArgs args = { .function = function, .arg = arg, .callerSignalMask = &callerSignalMask };
+    // The page tables of the caller are not copied, so this costs the same no matter how much memory the caller has.
+    // CLONE_VFORK suspends only the calling thread, until the child exits. This is what makes our stack frame (and arg) safe for the child to use.
+    int childPid = clone(runSharedMemoryProcess, stack + mappingSize, CLONE_VM | CLONE_VFORK | SIGCHLD, &args);
+    int cloneErrno = errno;
+    pthread_sigmask(SIG_SETMASK, &callerSignalMask, NULL);
+    munmap(stack, mappingSize);
+    if (childPid < 0) {
+        errno = cloneErrno;
+        return -1;
+    }
+    int exitStatus;
+    while (waitpid(childPid, &exitStatus, __WALL) < 0 && errno == EINTR) {}
+    return 0;
+}
+
 void closep(int* fd) {
     if (*fd >= 0) {
         close(*fd);
@@ -47,3 +129,336 @@ int stringIsRegularFilename(const char* filename) {
     }
     return 1;
 }
+
+int writeAll(int fd, const void* buffer, size_t size) {
+    const char* current = buffer;
+    while (size > 0) {
+        ssize_t written = send(fd, current, size, MSG_NOSIGNAL);
+        if (written < 0 && errno == ENOTSOCK) {
+            written = write(fd, current, size);
+        }
+        if (written < 0 && errno == EINTR) {
+            continue;
+        }
+        if (written <= 0) {
+            return -1;
+        }
+        current += written;
+        size -= written;
+    }
+    return 0;
+}
+
+int readAll(int fd, void* buffer, size_t size) {
+    char* current = buffer;
+    while (size > 0) {
+        ssize_t readBytes = read(fd, current, size);
+        if (readBytes < 0 && errno == EINTR) {
+            continue;
+        }
+        if (readBytes == 0) {
+            errno = EPIPE;
+            return -1;
+        }
+        if (readBytes < 0) {
+            return -1;
+        }
+        current += readBytes;
+        size -= readBytes;
+    }
+    return 0;
+}
+
+static size_t countStrings(char** list, size_t* totalSize) {
+    size_t count = 0;
+    for (; list[count] != NULL; count++) {
+        *totalSize += strlen(list[count]) + 1;
+    }
+    return count;
+}
+
+static int writeStrings(int fd, char** list) {
+    for (; *list != NULL; list++) {
+        if (writeAll(fd, *list, strlen(*list) + 1) != 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int writeCommand(int fd, char** commandList, char** environment) {
+    size_t stringsSize = 0;
+    size_t commandCount = countStrings(commandList, &stringsSize);
+    size_t environmentCount = countStrings(environment, &stringsSize);
+    if (stringsSize > MAX_COMMAND_STRINGS_SIZE) {
+        errno = E2BIG;
+        return -1;
+    }
+    struct commandHeader header = {
+        .commandCount = commandCount,
+        .environmentCount = environmentCount,
+        .stringsSize = stringsSize
+    };
+    if (writeAll(fd, &header, sizeof(header)) != 0) {
+        return -1;
+    }
+    if (writeStrings(fd, commandList) != 0 || writeStrings(fd, environment) != 0) {
+        return -1;
+    }
+    return 0;
+}
+
+static int commandHeaderIsValid(const struct commandHeader* header) {
+    // Every string takes up at least its NULL terminator
+    return header->stringsSize <= MAX_COMMAND_STRINGS_SIZE
+        && (uint64_t) header->commandCount + header->environmentCount <= header->stringsSize;
+}
+
+static int readCommandHeader(int fd, struct commandHeader* header) {
+    if (readAll(fd, header, sizeof(*header)) != 0) {
+        return -1;
+    }
+    if (!commandHeaderIsValid(header)) {
+        errno = EINVAL;
+        return -1;
+    }
+    return 0;
+}
+
+/// @brief readAll() with rawSyscall()
+/// @return 0 on success, -errno on failure
+static long rawReadAll(int fd, void* buffer, size_t size) {
+    char* current = buffer;
+    while (size > 0) {
+        long readBytes = rawSyscall(SYS_read, fd, (long) current, size, 0, 0, 0);
+        if (readBytes == -EINTR) {
+            continue;
+        }
+        if (readBytes == 0) {
+            return -EPIPE;
+        }
+        if (readBytes < 0) {
+            return readBytes;
+        }
+        current += readBytes;
+        size -= readBytes;
+    }
+    return 0;
+}
+
+/// @brief mmap() of anonymous memory with rawSyscall()
+/// @return The mapping, or -errno cast to a pointer on failure
+static void* rawMapAnonymous(size_t size) {
+#ifdef HAVE_RAW_SYSCALL
+    return (void*) rawSyscall(SYS_mmap, 0, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+#else
+    // Without HAVE_RAW_SYSCALL, the container process is not sharing our memory, so libc is fine
+    void* mapping = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    return (mapping == MAP_FAILED) ? (void*) (long) -errno : mapping;
+#endif
+}
+
+int forwardCommand(int inputFd, int outputFd) {
+    struct commandHeader header;
+    if (readCommandHeader(inputFd, &header) != 0) {
+        return -1;
+    }
+    if (writeAll(outputFd, &header, sizeof(header)) != 0) {
+        return -1;
+    }
+    char buffer[4096];
+    size_t remaining = header.stringsSize;
+    while (remaining > 0) {
+        size_t chunkSize = remaining < sizeof(buffer) ? remaining : sizeof(buffer);
+        if (readAll(inputFd, buffer, chunkSize) != 0 || writeAll(outputFd, buffer, chunkSize) != 0) {
+            return -1;
+        }
+        remaining -= chunkSize;
+    }
+    return 0;
+}
+
+int readCommand(int fd, char*** commandList, char*** environment, void** memoryOut, size_t* memorySizeOut) {
+    struct commandHeader header;
+    long readResult = rawReadAll(fd, &header, sizeof(header));
+    if (readResult != 0) {
+        return readResult;
+    }
+    if (!commandHeaderIsValid(&header)) {
+        return -EINVAL;
+    }
+    size_t pointersSize = (header.commandCount + header.environmentCount + 2) * sizeof(char*);
+    size_t memorySize = pointersSize + header.stringsSize + 1;
+    char* memory = rawMapAnonymous(memorySize);
+    // Addresses in the last page are error numbers
+    if ((unsigned long) memory > -4096UL) {
+        return (long) memory;
+    }
+    // Hand out the mapping right away, so that whoever has to release it (see below) also gets it on failure
+    *memoryOut = memory;
+    *memorySizeOut = memorySize;
+    char** pointers = (char**) memory;
+    char* strings = memory + pointersSize;
+    readResult = rawReadAll(fd, strings, header.stringsSize);
+    if (readResult != 0) {
+        return readResult;
+    }
+    // Walk the strings and make sure there are exactly as many as the header says.
+    // The mapping is zero-filled and one byte longer than the strings, so the walk cannot run off the end.
+    char* current = strings;
+    char* end = strings + header.stringsSize;
+    size_t pointerIndex = 0;
+    for (size_t i = 0; i < header.commandCount + header.environmentCount; i++) {
+        if (current >= end) {
+            return -EINVAL;
+        }
+        if (i == header.commandCount) {
+            pointers[pointerIndex++] = NULL;
+        }
+        pointers[pointerIndex++] = current;
+        current += strlen(current) + 1;
+    }
+    if (header.environmentCount == 0) {
+        pointers[pointerIndex++] = NULL;
+    }
+    pointers[pointerIndex] = NULL;
+    if (current != end) {
+        return -EINVAL;
+    }
+    *commandList = pointers;
+    *environment = pointers + header.commandCount + 1;
+    return 0;
+}
+
+int sendWithFds(int socket, const void* data, size_t size, const int* fds, int fdCount) {
+    union {
+        struct cmsghdr header;
+        char bytes[CMSG_SPACE(MAX_PASSED_FDS * sizeof(int))];
+    } control;
+    memset(&control, 0, sizeof(control));
+    struct iovec dataIov = { .iov_base = (void*) data, .iov_len = size };
+    struct msghdr message = {
+        .msg_iov = &dataIov,
+        .msg_iovlen = 1,
+    };
+    if (fdCount > MAX_PASSED_FDS) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (fdCount > 0) {
+        message.msg_control = control.bytes;
+        message.msg_controllen = CMSG_SPACE(fdCount * sizeof(int));
+        struct cmsghdr *controlHeader = CMSG_FIRSTHDR(&message);
+        controlHeader->cmsg_level = SOL_SOCKET;
+        controlHeader->cmsg_type = SCM_RIGHTS;
+        controlHeader->cmsg_len = CMSG_LEN(fdCount * sizeof(int));
+        memcpy(CMSG_DATA(controlHeader), fds, fdCount * sizeof(int));
+    }
+    ssize_t sent;
+    do {
+        sent = sendmsg(socket, &message, MSG_NOSIGNAL);
+    } while (sent < 0 && errno == EINTR);
+    if (sent < 0) {
+        return -1;
+    }
+    // Unix stream sockets send the FDs with the first byte, the rest of the message can follow normally
+    return writeAll(socket, (const char*) data + sent, size - sent);
+}
+
+int receiveWithFds(int socket, void* data, size_t size, int* fds, int maxFds) {
+    union {
+        struct cmsghdr header;
+        char bytes[CMSG_SPACE(MAX_PASSED_FDS * sizeof(int))];
+    } control;
+    struct iovec dataIov = { .iov_base = data, .iov_len = size };
+    struct msghdr message = {
+        .msg_iov = &dataIov,
+        .msg_iovlen = 1,
+        .msg_control = control.bytes,
+        .msg_controllen = sizeof(control.bytes)
+    };
+    ssize_t received;
+    do {
+        received = recvmsg(socket, &message, MSG_CMSG_CLOEXEC);
+    } while (received < 0 && errno == EINTR);
+    if (received <= 0) {
+        if (received == 0) {
+            errno = EPIPE;
+        }
+        return -1;
+    }
+    int fdCount = 0;
+    for (struct cmsghdr *controlHeader = CMSG_FIRSTHDR(&message); controlHeader != NULL; controlHeader = CMSG_NXTHDR(&message, controlHeader)) {
+        if (controlHeader->cmsg_level != SOL_SOCKET || controlHeader->cmsg_type != SCM_RIGHTS) {
+            continue;
+        }
+        int* receivedFds = (int*) CMSG_DATA(controlHeader);
+        int receivedCount = (controlHeader->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+        for (int i = 0; i < receivedCount; i++) {
+            if (fdCount < maxFds) {
+                fds[fdCount++] = receivedFds[i];
+            } else {
+                close(receivedFds[i]);
+            }
+        }
+    }
+    if (readAll(socket, (char*) data + received, size - received) != 0) {
+        for (int i = 0; i < fdCount; i++) {
+            close(fds[i]);
+        }
+        return -1;
+    }
+    return fdCount;
+}
+
+#if defined(__x86_64__)
+__asm__(
+    ".pushsection .text\n"
+    ".globl rawSyscall\n"
+    ".hidden rawSyscall\n"
+    ".type rawSyscall, @function\n"
+    "rawSyscall:\n"
+    // Shift the arguments from the function call registers into the system call registers, the sixth one comes from the stack
+    "    mov %rdi, %rax\n"
+    "    mov %rsi, %rdi\n"
+    "    mov %rdx, %rsi\n"
+    "    mov %rcx, %rdx\n"
+    "    mov %r8, %r10\n"
+    "    mov %r9, %r8\n"
+    "    mov 8(%rsp), %r9\n"
+    "    syscall\n"
+    "    ret\n"
+    ".size rawSyscall, .-rawSyscall\n"
+    ".popsection\n"
+);
+#elif defined(__aarch64__)
+__asm__(
+    ".pushsection .text\n"
+    ".globl rawSyscall\n"
+    ".hidden rawSyscall\n"
+    ".type rawSyscall, %function\n"
+    "rawSyscall:\n"
+    "    mov x8, x0\n"
+    "    mov x0, x1\n"
+    "    mov x1, x2\n"
+    "    mov x2, x3\n"
+    "    mov x3, x4\n"
+    "    mov x4, x5\n"
+    "    mov x5, x6\n"
+    "    svc #0\n"
+    "    ret\n"
+    ".size rawSyscall, .-rawSyscall\n"
+    ".popsection\n"
+);
+#else
+long rawSyscall(long number, long arg1, long arg2, long arg3, long arg4, long arg5, long arg6) {
+    long result = syscall(number, arg1, arg2, arg3, arg4, arg5, arg6);
+    return (result == -1) ? -errno : result;
+}
+#endif
+
+uint64_t monotonicNanoseconds(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t) now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
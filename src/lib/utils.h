@@ -3,6 +3,8 @@
 #pragma once
 
 #include <alloca.h>
+#include <stddef.h>
+#include <stdint.h>
 #include <stdio.h>
 
 /// @brief Allocates a locally-scoped (via alloca()) string using the provided format.
@@ -33,3 +35,87 @@ int splitString(char* input, char** output_1, char** output_2, char delim);
 /// Generally you can use this function to see if a user-supplied filename is safe to use.
 /// The function will reject filenames which can cause path traversal.
 int stringIsRegularFilename(const char* filename);
+
+/// @brief Writes the full buffer to a file descriptor, retrying on short writes. Sockets are written with MSG_NOSIGNAL, so a closed peer causes an error instead of SIGPIPE.
+/// @param fd The file descriptor to write to
+/// @param buffer The data to write
+/// @param size Number of bytes to write
+/// @return 0 on success, -1 on failure (errno is set)
+int writeAll(int fd, const void* buffer, size_t size);
+
+/// @brief Reads exactly size bytes from a file descriptor, retrying on short reads.
+/// @param fd The file descriptor to read from
+/// @param buffer Output buffer
+/// @param size Number of bytes to read
+/// @return 0 on success, -1 on failure or if the stream ended early (errno is set to EPIPE in that case)
+int readAll(int fd, void* buffer, size_t size);
+
+/// @brief Serializes a command (argv-style list plus environment) and writes it to a file descriptor.
+/// @param fd The file descriptor to write to
+/// @param commandList NULL-terminated command list, in the same layout as tinyjailContainerParams.commandList
+/// @param environment NULL-terminated list of KEY=VALUE strings
+/// @return 0 on success, -1 on failure (errno is set)
+int writeCommand(int fd, char** commandList, char** environment);
+
+/// @brief Reads a command serialized by writeCommand() and writes it unchanged to another file descriptor.
+/// @param inputFd The file descriptor to read from
+/// @param outputFd The file descriptor to write to
+/// @return 0 on success, -1 on failure (errno is set)
+int forwardCommand(int inputFd, int outputFd);
+
+/// @brief Reads and deserializes a command written by writeCommand().
+/// The memory for the lists is mmap()ed, so this is meant for processes that are about to execve().
+/// It only uses rawSyscall(), so it is safe to call from a process that shares memory with its parent -
+/// which then has to munmap() the memory once the process has exec'd or exited.
+/// @param fd The file descriptor to read from
+/// @param commandList Output: NULL-terminated command list
+/// @param environment Output: NULL-terminated environment list
+/// @param memory Output: the mapping which holds the lists, also set on failure if it was mapped already
+/// @param memorySize Output: size of the mapping
+/// @return 0 on success, -errno on failure (errno itself is left alone)
+int readCommand(int fd, char*** commandList, char*** environment, void** memory, size_t* memorySize);
+
+/// @brief Maximum number of FDs that can be passed with sendWithFds() / receiveWithFds()
+#define MAX_PASSED_FDS (8)
+
+/// @brief Sends a message over a Unix socket, together with a set of FDs (via SCM_RIGHTS).
+/// @param socket The socket
+/// @param data The message
+/// @param size Size of the message
+/// @param fds The FDs to pass along
+/// @param fdCount Number of FDs, at most MAX_PASSED_FDS. Can be 0.
+/// @return 0 on success, -1 on failure (errno is set)
+int sendWithFds(int socket, const void* data, size_t size, const int* fds, int fdCount);
+
+/// @brief Receives a message sent with sendWithFds(). Received FDs are close-on-exec.
+/// @param socket The socket
+/// @param data Output buffer for the message
+/// @param size Expected size of the message
+/// @param fds Output: the received FDs
+/// @param maxFds Size of the fds array
+/// @return Number of received FDs on success, -1 on failure (errno is set)
+int receiveWithFds(int socket, void* data, size_t size, int* fds, int maxFds);
+
+/// @brief Runs a function in a child process which shares the memory of the caller (clone() with CLONE_VM | CLONE_VFORK),
+/// on a dedicated stack, and waits for it to exit. Unlike fork(), this does not copy the address space of the caller, and it is safe
+/// to call from several threads at once. The calling thread is suspended until the child exits, the other threads keep running.
+/// The child has its own FD table, namespaces and signal handlers (reset to the default), but everything it writes to memory,
+/// the caller sees too: it must not leave memory allocated, change global state, or touch the caller's variables other than through arg.
+/// @param function The function to run. Its return value is the exit code of the child.
+/// @param arg Argument for the function
+/// @return 0 once the child has exited, -1 if it could not be started (errno is set)
+int runInSharedMemoryProcess(int (*function)(void*), void* arg);
+
+#if defined(__x86_64__) || defined(__aarch64__)
+/// @brief Set if rawSyscall() goes straight to the kernel. Otherwise, it is a wrapper around syscall().
+#define HAVE_RAW_SYSCALL
+#endif
+
+/// @brief Makes a system call without going through libc. Unused arguments should be 0.
+/// With HAVE_RAW_SYSCALL, it does not touch errno or any other thread-local state, so it can be used by a process
+/// which shares the memory of the library caller but not its thread (see runContainerInit()).
+/// @return The result of the system call, or -errno on failure
+long rawSyscall(long number, long arg1, long arg2, long arg3, long arg4, long arg5, long arg6);
+
+/// @brief Returns the current CLOCK_MONOTONIC time in nanoseconds.
+uint64_t monotonicNanoseconds(void);
@@ -5,11 +5,20 @@
 #include <stdlib.h>
 #include <alloca.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <pthread.h>
+#include <sys/random.h>
+#include <time.h>
+#include <unistd.h>
 
 #include "lib/tinyjail.h"
 
 static int parseInt(const char* input, long* output) {
     char *endptr = NULL;
+    // strtol() only sets errno on failure, so it must not be left over from an earlier call
+    errno = 0;
     *output = strtol(input, &endptr, 0);
     if (*endptr != 0 || errno != 0) {
         return 1;
@@ -18,16 +27,60 @@ static int parseInt(const char* input, long* output) {
     }
 }
 
+static const char* pressureResourceNames[TINYJAIL_PRESSURE_RESOURCE_COUNT] = {
+    [TINYJAIL_PRESSURE_CPU] = "cpu",
+    [TINYJAIL_PRESSURE_MEMORY] = "memory",
+    [TINYJAIL_PRESSURE_IO] = "io",
+};
+
+/// @brief Parses a "<resource>=<stall microseconds>" pressure trigger
+static int parsePressureTrigger(char* input, struct tinyjailContainerParams *parsedArgs) {
+    char* stall = strchr(input, '=');
+    if (stall == NULL) {
+        return 1;
+    }
+    *(stall++) = 0;
+    for (int resource = 0; resource < TINYJAIL_PRESSURE_RESOURCE_COUNT; resource++) {
+        if (strcmp(input, pressureResourceNames[resource]) == 0) {
+            return parseInt(stall, &parsedArgs->pressureTriggers[resource].stallMicroseconds);
+        }
+    }
+    return 1;
+}
+
+static void reportPressure(void* context, int resource) {
+    (void) context;
+    fprintf(stderr, "Container is stalled on %s\n", pressureResourceNames[resource]);
+}
+
+/// @brief Options that control what the binary prints after the container exits.
+struct reportOptions {
+    int printResourceUsage;
+    int printTimings;
+    /// @brief If set, the container is launched by the tinyjaild listening on this socket
+    char* daemonSocketPath;
+    /// @brief If set, telemetry records of the container are appended to this file
+    char* telemetryPath;
+    /// @brief If set, the binary runs the jobs in this file (see runBatch()) instead of a single container, batchJobs of them at a time
+    char* batchPath;
+    long batchJobs;
+};
+
 static int parseArgs(char** argv,
               struct tinyjailContainerParams *parsedArgs, 
               char** envStringsBuffer, 
-              char** cgroupOptionsBuffer) {
+              char** cgroupOptionsBuffer,
+              char** lowerDirsBuffer,
+              char** parentCgroupOptionsBuffer,
+              struct reportOptions *reportOptions) {
     if (*argv == NULL) {
         return -1;
     }
 
     parsedArgs->environment = envStringsBuffer;
     parsedArgs->cgroupOptions = cgroupOptionsBuffer;
+    parsedArgs->rootfsLowerDirs = lowerDirsBuffer;
+    parsedArgs->parentCgroupOptions = parentCgroupOptionsBuffer;
 
     char** currentArg = argv + 1;
     while (*currentArg != NULL) {
@@ -43,12 +96,43 @@ static int parseArgs(char** argv,
             parsedArgs->containerId = *(currentArg++);
         } else if (strcmp(command, "--use-host-network") == 0) {
             parsedArgs->useHostNetwork = 1;
+        } else if (strcmp(command, "--resource-usage") == 0) {
+            reportOptions->printResourceUsage = 1;
+        } else if (strcmp(command, "--timings") == 0) {
+            reportOptions->printTimings = 1;
+        } else if (strcmp(command, "--batch") == 0) {
+            reportOptions->batchPath = *(currentArg++);
+        } else if (strcmp(command, "--jobs") == 0) {
+            if (parseInt(*(currentArg++), &(reportOptions->batchJobs)) != 0 || reportOptions->batchJobs <= 0) {
+                printf("Unable to parse --jobs\n");
+                return 1;
+            }
+        } else if (strcmp(command, "--daemon-socket") == 0) {
+            reportOptions->daemonSocketPath = *(currentArg++);
         } else if (strcmp(command, "--root") == 0) {
             parsedArgs->containerDir = *(currentArg++);
+        } else if (strcmp(command, "--lower-dir") == 0) {
+            *(lowerDirsBuffer++) = *(currentArg++);
+        } else if (strcmp(command, "--idmap-root") == 0) {
+            parsedArgs->idmapRootfs = 1;
+        } else if (strcmp(command, "--upper-dir") == 0) {
+            parsedArgs->rootfsUpperDir = *(currentArg++);
+        } else if (strcmp(command, "--overlay-work-dir") == 0) {
+            parsedArgs->rootfsWorkDir = *(currentArg++);
         } else if (strcmp(command, "--env") == 0) {
             *(envStringsBuffer++) = *(currentArg++);
         } else if (strcmp(command, "--cgroup") == 0) {
             *(cgroupOptionsBuffer++) = *(currentArg++);
+        } else if (strcmp(command, "--parent-cgroup") == 0) {
+            parsedArgs->parentCgroup = *(currentArg++);
+        } else if (strcmp(command, "--parent-cgroup-option") == 0) {
+            *(parentCgroupOptionsBuffer++) = *(currentArg++);
+        } else if (strcmp(command, "--stdout") == 0) {
+            parsedArgs->stdoutMode = TINYJAIL_OUTPUT_FILE;
+            parsedArgs->stdoutPath = *(currentArg++);
+        } else if (strcmp(command, "--stderr") == 0) {
+            parsedArgs->stderrMode = TINYJAIL_OUTPUT_FILE;
+            parsedArgs->stderrPath = *(currentArg++);
         } else if (strcmp(command, "--workdir") == 0) {
             parsedArgs->workDir = *(currentArg++);
         } else if (strcmp(command, "--uid") == 0) {
@@ -61,6 +145,39 @@ static int parseArgs(char** argv,
                 printf("Unable to parse --gid: %s\n", strerror(errno));
                 return 1;
             }
+        } else if (strcmp(command, "--cpus") == 0) {
+            if (parseInt(*(currentArg++), &(parsedArgs->cpuCount)) != 0) {
+                printf("Unable to parse --cpus: %s\n", strerror(errno));
+                return 1;
+            }
+        } else if (strcmp(command, "--pressure-trigger") == 0) {
+            if (parsePressureTrigger(*(currentArg++), parsedArgs) != 0) {
+                printf("Unable to parse --pressure-trigger\n");
+                return 1;
+            }
+            parsedArgs->pressureCallback = reportPressure;
+        } else if (strcmp(command, "--telemetry") == 0) {
+            reportOptions->telemetryPath = *(currentArg++);
+        } else if (strcmp(command, "--telemetry-interval") == 0) {
+            if (parseInt(*(currentArg++), &(parsedArgs->telemetryIntervalMilliseconds)) != 0) {
+                printf("Unable to parse --telemetry-interval: %s\n", strerror(errno));
+                return 1;
+            }
+        } else if (strcmp(command, "--timeout") == 0) {
+            if (parseInt(*(currentArg++), &(parsedArgs->timeoutMilliseconds)) != 0) {
+                printf("Unable to parse --timeout: %s\n", strerror(errno));
+                return 1;
+            }
+        } else if (strcmp(command, "--seccomp") == 0) {
+            char* profile = *(currentArg++);
+            if (strcmp(profile, "default") == 0) {
+                parsedArgs->seccompProfile = TINYJAIL_SECCOMP_DEFAULT;
+            } else if (strcmp(profile, "strict") == 0) {
+                parsedArgs->seccompProfile = TINYJAIL_SECCOMP_STRICT;
+            } else {
+                printf("Unknown seccomp profile: %s\n", profile);
+                return -1;
+            }
         } else if (strcmp(command, "--network-bridge") == 0) {
             parsedArgs->networkBridgeName = *(currentArg++);
         } else if (strcmp(command, "--ip-address") == 0) {
@@ -69,6 +186,38 @@ static int parseArgs(char** argv,
             parsedArgs->networkPeerIpAddr = *(currentArg++);
         } else if (strcmp(command, "--default-route") == 0) {
             parsedArgs->networkDefaultRoute = *(currentArg++);
+        } else if (strcmp(command, "--macvlan") == 0) {
+            parsedArgs->networkMode = TINYJAIL_NETWORK_MACVLAN;
+            parsedArgs->networkParentDevice = *(currentArg++);
+        } else if (strcmp(command, "--ipvlan") == 0) {
+            parsedArgs->networkMode = TINYJAIL_NETWORK_IPVLAN_L2;
+            parsedArgs->networkParentDevice = *(currentArg++);
+        } else if (strcmp(command, "--ipvlan-l3") == 0) {
+            parsedArgs->networkMode = TINYJAIL_NETWORK_IPVLAN_L3;
+            parsedArgs->networkParentDevice = *(currentArg++);
+        } else if (strcmp(command, "--network-queues") == 0) {
+            long queueCount;
+            if (parseInt(*(currentArg++), &queueCount) != 0 || queueCount <= 0 || queueCount > INT_MAX) {
+                printf("Unable to parse --network-queues\n");
+                return 1;
+            }
+            parsedArgs->networkQueueCount = queueCount;
+        } else if (strcmp(command, "--network-mtu") == 0) {
+            long mtu;
+            if (parseInt(*(currentArg++), &mtu) != 0 || mtu <= 0 || mtu > INT_MAX) {
+                printf("Unable to parse --network-mtu\n");
+                return 1;
+            }
+            parsedArgs->networkMtu = mtu;
+        } else if (strcmp(command, "--network-txqueuelen") == 0) {
+            long txQueueLength;
+            if (parseInt(*(currentArg++), &txQueueLength) != 0 || txQueueLength <= 0 || txQueueLength > INT_MAX) {
+                printf("Unable to parse --network-txqueuelen\n");
+                return 1;
+            }
+            parsedArgs->networkTxQueueLength = txQueueLength;
+        } else if (strcmp(command, "--network-gro") == 0) {
+            parsedArgs->networkGro = 1;
         } else if (strcmp(command, "--hostname") == 0) {
             parsedArgs->hostname = *(currentArg++);
         } else {
@@ -79,6 +228,331 @@ static int parseArgs(char** argv,
     return 0;
 }
 
+static void printContainerUsage(const struct tinyjailContainerResultEx *resultEx) {
+    if (!resultEx->resourceUsageAvailable) {
+        fprintf(stderr, "Container resource usage not available\n");
+        return;
+    }
+    const struct tinyjailContainerUsage *usage = &resultEx->resourceUsage;
+    fprintf(
+        stderr,
+        "cpu usage_usec=%" PRIu64 " user_usec=%" PRIu64 " system_usec=%" PRIu64 " nr_throttled=%" PRIu64 " throttled_usec=%" PRIu64 "\n",
+        usage->cpuUsageUsec, usage->cpuUserUsec, usage->cpuSystemUsec, usage->cpuThrottledPeriods, usage->cpuThrottledUsec
+    );
+    fprintf(
+        stderr,
+        "memory peak=%" PRIu64 " oom=%" PRIu64 " oom_kill=%" PRIu64 "\n",
+        usage->memoryPeakBytes, usage->memoryOomEvents, usage->memoryOomKillEvents
+    );
+    fprintf(
+        stderr,
+        "io rbytes=%" PRIu64 " wbytes=%" PRIu64 " rios=%" PRIu64 " wios=%" PRIu64 "\n",
+        usage->ioReadBytes, usage->ioWriteBytes, usage->ioReadOperations, usage->ioWriteOperations
+    );
+    fprintf(stderr, "pids peak=%" PRIu64 "\n", usage->pidsPeak);
+    for (int resource = 0; resource < TINYJAIL_PRESSURE_RESOURCE_COUNT && resultEx->pressureAvailable; resource++) {
+        const struct tinyjailPressureStats *pressure = &resultEx->pressure[resource];
+        fprintf(
+            stderr,
+            "%s_pressure some_avg10=%.2f some_total_usec=%" PRIu64 " full_avg10=%.2f full_total_usec=%" PRIu64 " trigger_events=%" PRIu64 "\n",
+            pressureResourceNames[resource], pressure->some.avg10, pressure->some.totalUsec,
+            pressure->full.avg10, pressure->full.totalUsec, resultEx->pressureTriggerEvents[resource]
+        );
+    }
+}
+
+static void printLaunchTimings(const struct tinyjailContainerResultEx *resultEx) {
+    static const char* phaseNames[TINYJAIL_LAUNCH_PHASE_COUNT] = {
+        [TINYJAIL_PHASE_PREPARE_START] = "prepare_start",
+        [TINYJAIL_PHASE_LAUNCHER_STARTED] = "launcher_started",
+        [TINYJAIL_PHASE_MOUNT_NAMESPACE_READY] = "mount_namespace_ready",
+        [TINYJAIL_PHASE_CGROUPFS_MOUNTED] = "cgroupfs_mounted",
+        [TINYJAIL_PHASE_CGROUP_READY] = "cgroup_ready",
+        [TINYJAIL_PHASE_PROCFS_MOUNTED] = "procfs_mounted",
+        [TINYJAIL_PHASE_CLONED] = "cloned",
+        [TINYJAIL_PHASE_USER_NAMESPACE_READY] = "user_namespace_ready",
+        [TINYJAIL_PHASE_NETWORK_READY] = "network_ready",
+        [TINYJAIL_PHASE_PREPARED] = "prepared",
+        [TINYJAIL_PHASE_START] = "start",
+        [TINYJAIL_PHASE_CHILD_COMMAND_RECEIVED] = "child_command_received",
+        [TINYJAIL_PHASE_CHILD_ROOT_READY] = "child_root_ready",
+        [TINYJAIL_PHASE_CHILD_EXEC] = "child_exec",
+        [TINYJAIL_PHASE_STARTED] = "started",
+        [TINYJAIL_PHASE_EXITED] = "exited",
+    };
+    // Print each phase relative to the start of the launch, and the time since the previous phase
+    uint64_t launchStart = resultEx->launchTimings[TINYJAIL_PHASE_PREPARE_START];
+    uint64_t previous = launchStart;
+    for (int phase = 0; phase < TINYJAIL_LAUNCH_PHASE_COUNT; phase++) {
+        uint64_t timestamp = resultEx->launchTimings[phase];
+        if (timestamp == 0) {
+            continue;
+        }
+        fprintf(
+            stderr,
+            "timing %-24s +%9.3f ms (%8.3f ms)\n",
+            phaseNames[phase], (timestamp - launchStart) / 1e6, (timestamp - previous) / 1e6
+        );
+        previous = timestamp;
+    }
+}
+
+/// @brief Has the container launched by a running tinyjaild instead of launching it from this process.
+static void launchThroughDaemon(const char* socketPath, struct tinyjailContainerParams programArgs, struct tinyjailContainerResultEx *resultEx) {
+    // The daemon resolves paths in its own working directory
+    char resolvedRootPath[PATH_MAX];
+    if (programArgs.containerDir != NULL && realpath(programArgs.containerDir, resolvedRootPath) != NULL) {
+        programArgs.containerDir = resolvedRootPath;
+    }
+    int daemonFd = tinyjailDaemonConnect(socketPath, &resultEx->result);
+    if (daemonFd < 0) {
+        return;
+    }
+    uint64_t requestId;
+    if (tinyjailDaemonSubmit(daemonFd, 0, programArgs) != 0 || tinyjailDaemonReceive(daemonFd, &requestId, resultEx) != 0) {
+        resultEx->result.containerStartedStatus = -1;
+        snprintf(resultEx->result.errorInfo, ERROR_INFO_SIZE, "Communication with daemon failed: %s", strerror(errno));
+    }
+    close(daemonFd);
+}
+
+/// @brief Launches a container as described by the parsed options and waits until it exits.
+static void launchFromOptions(
+    struct tinyjailContainerParams programArgs,
+    const struct reportOptions *reportOptions,
+    struct tinyjailContainerResultEx *resultEx
+) {
+    if (reportOptions->telemetryPath != NULL) {
+        programArgs.telemetryFd = open(reportOptions->telemetryPath, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+        if (programArgs.telemetryFd < 0) {
+            resultEx->result.containerStartedStatus = -1;
+            snprintf(resultEx->result.errorInfo, ERROR_INFO_SIZE, "Could not open %s: %s", reportOptions->telemetryPath, strerror(errno));
+            return;
+        }
+        if (programArgs.telemetryIntervalMilliseconds <= 0) {
+            programArgs.telemetryIntervalMilliseconds = 1000;
+        }
+    }
+    if (reportOptions->daemonSocketPath != NULL) {
+        launchThroughDaemon(reportOptions->daemonSocketPath, programArgs, resultEx);
+    } else {
+        tinyjailLaunchContainerEx(programArgs, resultEx);
+    }
+    if (reportOptions->telemetryPath != NULL) {
+        close(programArgs.telemetryFd);
+    }
+}
+
+/// @brief The jobs of a batch run, which worker threads take in order.
+struct batchRun {
+    /// @brief NULL-terminated command line of each job: the options given to the binary, followed by the options from the line of the job
+    char*** jobArgs;
+    /// @brief Line of each job in the job file
+    long *jobLines;
+    long jobCount;
+    /// @brief Index of the next job, taken by the worker threads with an atomic increment
+    long nextJob;
+    long failures;
+};
+
+static uint64_t monotonicNow(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t) now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+/// @brief Prints the summary line of a finished job and counts it if it failed.
+static void reportBatchJob(
+    struct batchRun *batch,
+    long job,
+    const char* containerId,
+    uint64_t durationNanoseconds,
+    const struct tinyjailContainerResultEx *resultEx
+) {
+    const struct tinyjailContainerResult *result = &resultEx->result;
+    char status[ERROR_INFO_SIZE + 16];
+    if (result->containerStartedStatus != 0) {
+        snprintf(status, sizeof(status), "error=%s", result->errorInfo[0] == '\0' ? "(no error info)" : result->errorInfo);
+    } else if (resultEx->timedOut) {
+        snprintf(status, sizeof(status), "timeout=1");
+    } else if (WIFEXITED(result->containerExitStatus)) {
+        snprintf(status, sizeof(status), "exit=%d", WEXITSTATUS(result->containerExitStatus));
+    } else {
+        snprintf(status, sizeof(status), "signal=%d", WTERMSIG(result->containerExitStatus));
+    }
+    if (result->containerStartedStatus != 0 || resultEx->timedOut || !WIFEXITED(result->containerExitStatus) || WEXITSTATUS(result->containerExitStatus) != 0) {
+        __atomic_add_fetch(&batch->failures, 1, __ATOMIC_RELAXED);
+    }
+    // One call per line, so that lines of jobs finishing at the same time do not get mixed up
+    fprintf(stderr, "job line=%ld id=%s duration_ms=%.3f %s\n", batch->jobLines[job], containerId, durationNanoseconds / 1e6, status);
+}
+
+static void* runBatchWorker(void* arg) {
+    struct batchRun *batch = arg;
+    long job;
+    while ((job = __atomic_fetch_add(&batch->nextJob, 1, __ATOMIC_RELAXED)) < batch->jobCount) {
+        char** jobArgs = batch->jobArgs[job];
+        int argCount = 0;
+        while (jobArgs[argCount] != NULL) {
+            argCount++;
+        }
+        char* envStringsBuf[argCount + 1];
+        char* cgroupOptionsBuf[argCount + 1];
+        char* lowerDirsBuf[argCount + 1];
+        char* parentCgroupOptionsBuf[argCount + 1];
+        memset(envStringsBuf, 0, sizeof(envStringsBuf));
+        memset(cgroupOptionsBuf, 0, sizeof(cgroupOptionsBuf));
+        memset(lowerDirsBuf, 0, sizeof(lowerDirsBuf));
+        memset(parentCgroupOptionsBuf, 0, sizeof(parentCgroupOptionsBuf));
+        struct tinyjailContainerParams programArgs = { .uid = -1, .gid = -1 };
+        struct reportOptions reportOptions = {0};
+        struct tinyjailContainerResultEx resultEx = { .version = TINYJAIL_RESULT_EX_VERSION };
+        char randomContainerId[13] = "-";
+        uint64_t startTime = monotonicNow();
+        if (parseArgs(jobArgs, &programArgs, envStringsBuf, cgroupOptionsBuf, lowerDirsBuf, parentCgroupOptionsBuf, &reportOptions) != 0
+            || reportOptions.batchPath != NULL) {
+            resultEx.result.containerStartedStatus = -1;
+            snprintf(resultEx.result.errorInfo, ERROR_INFO_SIZE, "Invalid job options.");
+        } else {
+            // The ID goes into the summary, so it is picked here rather than by the library
+            if (programArgs.containerId == NULL) {
+                uint64_t randomId = 0;
+                getrandom(&randomId, sizeof(randomId), 0);
+                snprintf(randomContainerId, sizeof(randomContainerId), "%012" PRIx64, randomId & 0xffffffffffff);
+                programArgs.containerId = randomContainerId;
+            }
+            launchFromOptions(programArgs, &reportOptions, &resultEx);
+        }
+        const char* containerId = (programArgs.containerId != NULL) ? programArgs.containerId : randomContainerId;
+        reportBatchJob(batch, job, containerId, monotonicNow() - startTime, &resultEx);
+    }
+    return NULL;
+}
+
+/// @brief Reads a job file: one job per line, given as options (separated by whitespace, without quoting) ending with "-- <command>".
+/// Empty lines and lines starting with '#' are skipped. Each job gets the common options in front of its own.
+/// @return 0 on success, -1 on failure
+static int readBatchJobs(FILE* jobFile, char** commonArgs, int commonArgCount, struct batchRun *batch) {
+    long capacity = 0;
+    char* line = NULL;
+    size_t lineSize = 0;
+    for (long lineNumber = 1; getline(&line, &lineSize, jobFile) >= 0; lineNumber++) {
+        char* firstToken = line + strspn(line, " \t\r\n");
+        if (*firstToken == '\0' || *firstToken == '#') {
+            continue;
+        }
+        if (batch->jobCount == capacity) {
+            capacity = (capacity == 0) ? 64 : capacity * 2;
+            char*** jobArgs = realloc(batch->jobArgs, capacity * sizeof(char**));
+            long *jobLines = realloc(batch->jobLines, capacity * sizeof(long));
+            if (jobArgs != NULL) {
+                batch->jobArgs = jobArgs;
+            }
+            if (jobLines != NULL) {
+                batch->jobLines = jobLines;
+            }
+            if (jobArgs == NULL || jobLines == NULL) {
+                free(line);
+                return -1;
+            }
+        }
+        // The arguments point into the line, which is kept for as long as the job. It starts with the first argument, which is how it is freed.
+        memmove(line, firstToken, strlen(firstToken) + 1);
+        size_t maxTokens = strlen(line) / 2 + 1;
+        char** jobArgs = malloc((commonArgCount + maxTokens + 1) * sizeof(char*));
+        if (jobArgs == NULL) {
+            free(line);
+            return -1;
+        }
+        memcpy(jobArgs, commonArgs, commonArgCount * sizeof(char*));
+        int argCount = commonArgCount;
+        char* savePtr = NULL;
+        for (char* token = strtok_r(line, " \t\r\n", &savePtr); token != NULL; token = strtok_r(NULL, " \t\r\n", &savePtr)) {
+            jobArgs[argCount++] = token;
+        }
+        jobArgs[argCount] = NULL;
+        batch->jobArgs[batch->jobCount] = jobArgs;
+        batch->jobLines[batch->jobCount] = lineNumber;
+        batch->jobCount++;
+        line = NULL;
+        lineSize = 0;
+    }
+    free(line);
+    return ferror(jobFile) ? -1 : 0;
+}
+
+/// @brief Runs the jobs of a job file (see readBatchJobs()), up to reportOptions->batchJobs at a time, each on its own thread.
+/// For each job, a summary line with its container ID, duration and exit status is printed to stderr once it is done.
+/// @param argv The arguments of the binary. All of them but the batch options are given to every job.
+/// @return 0 if all jobs ran and exited with status 0, 1 if any did not, -1 if the batch could not be run
+static int runBatch(char** argv, const struct reportOptions *reportOptions) {
+    FILE* jobFile = (strcmp(reportOptions->batchPath, "-") == 0) ? stdin : fopen(reportOptions->batchPath, "re");
+    if (jobFile == NULL) {
+        fprintf(stderr, "Could not open %s: %s\n", reportOptions->batchPath, strerror(errno));
+        return -1;
+    }
+    // The options of the binary (minus the batch options) come first in the command line of every job
+    int argc = 0;
+    while (argv[argc] != NULL) {
+        argc++;
+    }
+    char* commonArgs[argc + 1];
+    int commonArgCount = 0;
+    for (int i = 0; i < argc; i++) {
+        if (i > 0 && (strcmp(argv[i], "--batch") == 0 || strcmp(argv[i], "--jobs") == 0)) {
+            i++;
+            continue;
+        }
+        commonArgs[commonArgCount++] = argv[i];
+    }
+    struct batchRun batch = {0};
+    int readResult = readBatchJobs(jobFile, commonArgs, commonArgCount, &batch);
+    if (jobFile != stdin) {
+        fclose(jobFile);
+    }
+    if (readResult != 0) {
+        fprintf(stderr, "Could not read jobs from %s.\n", reportOptions->batchPath);
+        return -1;
+    }
+
+    // This has to happen before containers are launched from several threads
+    struct tinyjailContainerResult result;
+    if (tinyjailInitLaunchResources(&result) != 0) {
+        fprintf(stderr, "Could not set up launch resources: %s\n", result.errorInfo);
+        return -1;
+    }
+    long threadCount = (reportOptions->batchJobs > 0) ? reportOptions->batchJobs : sysconf(_SC_NPROCESSORS_ONLN);
+    if (threadCount > batch.jobCount) {
+        threadCount = batch.jobCount;
+    }
+    uint64_t startTime = monotonicNow();
+    pthread_t threads[threadCount > 0 ? threadCount : 1];
+    long startedThreads = 0;
+    for (long i = 0; i < threadCount; i++) {
+        if (pthread_create(&threads[startedThreads], NULL, runBatchWorker, &batch) == 0) {
+            startedThreads++;
+        }
+    }
+    // If no thread could be started, run the jobs on this one
+    if (startedThreads == 0) {
+        runBatchWorker(&batch);
+    }
+    for (long i = 0; i < startedThreads; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    fprintf(
+        stderr, "batch jobs=%ld failed=%ld duration_ms=%.3f\n",
+        batch.jobCount, batch.failures, (monotonicNow() - startTime) / 1e6
+    );
+    for (long job = 0; job < batch.jobCount; job++) {
+        free(batch.jobArgs[job][commonArgCount]);
+        free(batch.jobArgs[job]);
+    }
+    free(batch.jobArgs);
+    free(batch.jobLines);
+    return (batch.failures == 0) ? 0 : 1;
+}
+
 int main(int argc, char** argv) {
     // We can have at most argc env pointers specified, so just allocate space for that many.
     // We will definitely allocate too much space here, but it's just 8 B per pointer...
@@ -89,27 +563,82 @@ int main(int argc, char** argv) {
     char** cgroupOptionsBuf = alloca((argc + 1) * sizeof(char*));
     memset(cgroupOptionsBuf, 0, (argc + 1) * sizeof(char*));
 
+    // ... and the list of overlay lower directories
+    char** lowerDirsBuf = alloca((argc + 1) * sizeof(char*));
+    memset(lowerDirsBuf, 0, (argc + 1) * sizeof(char*));
+
+    // ... and the options of the parent cgroup
+    char** parentCgroupOptionsBuf = alloca((argc + 1) * sizeof(char*));
+    memset(parentCgroupOptionsBuf, 0, (argc + 1) * sizeof(char*));
+
     struct tinyjailContainerParams programArgs = {0};
     programArgs.uid = -1;
     programArgs.gid = -1;
-    if (parseArgs(argv, &programArgs, envStringsBuf, cgroupOptionsBuf) != 0) {
+    struct reportOptions reportOptions = {0};
+    // "exec" runs another command in a running container instead of launching a container. It takes the same options.
+    int execMode = (argc > 1 && strcmp(argv[1], "exec") == 0);
+    if (parseArgs(argv + execMode, &programArgs, envStringsBuf, cgroupOptionsBuf, lowerDirsBuf, parentCgroupOptionsBuf, &reportOptions) != 0
+        || (execMode && (programArgs.containerId == NULL || reportOptions.batchPath != NULL))
+        || (reportOptions.batchPath != NULL && programArgs.commandList != NULL)) {
         printf(
             "Usage: ./jail --root <root directory> "
             "[--id <container ID>] "
+            "[--lower-dir <directory>]* "
+            "[--upper-dir <directory> --overlay-work-dir <directory>] "
+            "[--uid <host UID> --gid <host GID> [--idmap-root]] "
             "[--env <key>=<value>]* "
             "[--workdir <directory>] "
+            "[--stdout <file>] "
+            "[--stderr <file>] "
             "[--cgroup <option>=<value>] "
+            "[--parent-cgroup <path> [--parent-cgroup-option <option>=<value>]*] "
+            "[--cpus <count>] "
+            "[--pressure-trigger cpu|memory|io=<stall microseconds per 2 s>]* "
             "[--use-host-network] "
-            "[--network-bridge <device name>] "
+            "[--network-bridge <device name> | --macvlan <parent device> | --ipvlan <parent device> | --ipvlan-l3 <parent device>] "
             "[--ip-address <address>] "
             "[--peer-ip-address <address>] "
             "[--default-route <address>] "
+            "[--network-queues <count>] "
+            "[--network-mtu <bytes>] "
+            "[--network-txqueuelen <packets>] "
+            "[--network-gro] "
             "[--hostname <hostname>] "
-            "-- <command>\n");
+            "[--timeout <milliseconds>] "
+            "[--telemetry <file> [--telemetry-interval <milliseconds>]] "
+            "[--seccomp default|strict] "
+            "[--resource-usage] "
+            "[--timings] "
+            "[--daemon-socket <path>] "
+            "-- <command>\n"
+            "       ./jail exec --id <container ID> "
+            "[--parent-cgroup <path>] "
+            "[--env <key>=<value>]* "
+            "[--workdir <directory>] "
+            "[--seccomp default|strict] "
+            "-- <command>\n"
+            "       ./jail --batch <job file or -> [--jobs <parallel jobs>] [<options for every job>]\n"
+            "Each line of the job file has the options of one job, followed by -- <command>.\n");
         return -1;
     }
 
-    struct tinyjailContainerResult result = tinyjailLaunchContainer(programArgs);
+    if (reportOptions.batchPath != NULL) {
+        return runBatch(argv, &reportOptions);
+    }
+
+    struct tinyjailContainerResultEx resultEx = { .version = TINYJAIL_RESULT_EX_VERSION };
+    if (execMode) {
+        resultEx.result = tinyjailExecById(programArgs);
+    } else {
+        launchFromOptions(programArgs, &reportOptions, &resultEx);
+    }
+    struct tinyjailContainerResult result = resultEx.result;
+    if (result.containerStartedStatus == 0 && reportOptions.printResourceUsage) {
+        printContainerUsage(&resultEx);
+    }
+    if (result.containerStartedStatus == 0 && reportOptions.printTimings) {
+        printLaunchTimings(&resultEx);
+    }
     if (result.containerStartedStatus != 0) {
         fprintf(
             stderr, 
@@ -117,6 +646,9 @@ int main(int argc, char** argv) {
             result.errorInfo[0] == '\0' ? "(no error info)" : result.errorInfo
         );
         return -1;
+    } else if (resultEx.timedOut) {
+        fprintf(stderr, "Container timed out: %s\n", result.errorInfo);
+        return 124;
     } else if (WIFEXITED(result.containerExitStatus)) {
         return WEXITSTATUS(result.containerExitStatus);
     } else if (WIFSIGNALED(result.containerExitStatus)) {